@@ -0,0 +1,76 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// insert/erase throughput of the malloc path (aligned_allocator) versus the slab pools
+
+namespace {
+
+using malloc_list = skip_list<int32_t, void*, 6, aligned_allocator>;
+using pool_list = skip_list<int32_t, void*, 6, pool_allocator>;
+using thread_pool_list = skip_list<int32_t, void*, 6, thread_pool_allocator>;
+
+constexpr int book_depth = 10000;
+constexpr int rounds = 20;
+
+// fill a book, then repeatedly cancel and re-add random levels (add/cancel bursts)
+template<typename list_type> void add_cancel(bench::state & st)
+{
+	list_type x(0);
+	bench::xorshift rnd;
+	for(int i = 0; i < book_depth; ++i) x.insert(2 * i, nullptr);
+
+	std::vector<int32_t> keys(book_depth);
+	for(int r = 0; r < rounds; ++r)
+	{
+		for(auto & k : keys) k = 2 * int32_t(rnd() % book_depth);
+		st.measure(2 * keys.size(), [&]{
+			for(auto k : keys) bench::do_not_optimize(x.erase(k));
+			for(auto k : keys) bench::do_not_optimize(x.insert(k, nullptr));
+		});
+	}
+}
+
+// build a book from scratch and tear it down again
+template<typename list_type> void build_clear(bench::state & st)
+{
+	for(int r = 0; r < rounds; ++r)
+	{
+		list_type x(1);
+		st.measure(book_depth + 1, [&]{
+			for(int i = 0; i < book_depth; ++i) x.insert(i, nullptr);
+			x.clear();
+		});
+	}
+}
+
+// top-of-book churn: new best level arrives, best level gets consumed
+template<typename list_type> void head_churn(bench::state & st)
+{
+	list_type x(0);
+	for(int i = 0; i < book_depth; ++i) x.insert(i + book_depth, nullptr);
+
+	st.measure(2 * book_depth * rounds, [&]{
+		for(int r = 0; r < rounds; ++r) {
+			for(int i = 0; i < book_depth; ++i) {
+				x.insert(book_depth - 1, nullptr);
+				x.erase_head();
+			}
+		}
+	});
+}
+
+} // namespace
+
+BENCH(alloc_add_cancel_malloc) { add_cancel<malloc_list>(st); }
+BENCH(alloc_add_cancel_pool) { add_cancel<pool_list>(st); }
+BENCH(alloc_add_cancel_thread_pool) { add_cancel<thread_pool_list>(st); }
+
+BENCH(alloc_build_clear_malloc) { build_clear<malloc_list>(st); }
+BENCH(alloc_build_clear_pool) { build_clear<pool_list>(st); }
+BENCH(alloc_build_clear_thread_pool) { build_clear<thread_pool_list>(st); }
+
+BENCH(alloc_head_churn_malloc) { head_churn<malloc_list>(st); }
+BENCH(alloc_head_churn_pool) { head_churn<pool_list>(st); }
+BENCH(alloc_head_churn_thread_pool) { head_churn<thread_pool_list>(st); }
@@ -0,0 +1,71 @@
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Market data packets: a batch of level updates clustered near the top of a deep
+ * book, applied key by key or through the batch calls, with and without prefetching.
+ * Every packet adds its levels and the next one takes them out again.
+ */
+
+namespace {
+
+using list_type = ascending_skip_list<int32_t, void*, pool_allocator>;
+
+constexpr int depth = 100000;
+constexpr size_t keys_per_case = 1 << 18;
+
+enum class mode { loop, batch, batch_prefetch };
+
+std::vector<int32_t> packet_keys()
+{
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(keys_per_case);
+	for(auto & k : keys) k = 2 * int32_t(rnd() % 2000) + 1; // odd ticks between the resting levels
+	return keys;
+}
+
+template<mode m> void apply(bench::state & st, size_t batch)
+{
+	list_type x(std::less<int32_t>(), 1);
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, nullptr);
+	auto const keys = packet_keys();
+	std::vector< std::pair<int32_t, void*> > kv(batch);
+	std::unique_ptr<bool[]> inserted(new bool[batch]);
+	std::vector< std::pair<void*, size_t> > erased(batch);
+	std::vector<void**> found(batch);
+
+	st.measure(3 * keys.size(), [&]{
+		for(size_t b = 0; b + batch <= keys.size(); b += batch) {
+			int32_t const * k = keys.data() + b;
+			for(size_t i = 0; i < batch; ++i) kv[i] = std::make_pair(k[i], nullptr);
+			if ( m == mode::loop ) {
+				for(size_t i = 0; i < batch; ++i) inserted[i] = x.insert(k[i], nullptr);
+				for(size_t i = 0; i < batch; ++i) found[i] = x.find(k[i]);
+				for(size_t i = 0; i < batch; ++i) erased[i] = x.erase(k[i]);
+			}
+			else {
+				constexpr bool pf = m == mode::batch_prefetch;
+				x.insert_batch<pf>(kv.data(), batch, inserted.get());
+				x.find_batch<pf>(k, batch, found.data());
+				x.erase_batch<pf>(k, batch, erased.data());
+			}
+			bench::do_not_optimize(found.back());
+		}
+	});
+}
+
+bench::registrar const batch_cases([]{
+	for(size_t batch : { 4, 16, 64, 256 }) {
+		std::string const n = "/" + std::to_string(batch);
+		bench::add("batch_loop" + n, [=](bench::state & st){ apply<mode::loop>(st, batch); });
+		bench::add("batch_sorted" + n, [=](bench::state & st){ apply<mode::batch>(st, batch); });
+		bench::add("batch_sorted_prefetch" + n, [=](bench::state & st){ apply<mode::batch_prefetch>(st, batch); });
+	}
+});
+
+} // namespace
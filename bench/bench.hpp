@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Minimal self-contained benchmark harness: BENCH(name) (or add()) registers a case,
+// the case times its hot loop with state::measure() for throughput, or state::sample()
+// to also record per-operation latency, and main() reports ns/op and percentiles.
+
+namespace bench {
+
+using clock = std::chrono::steady_clock;
+
+template<typename T> inline void do_not_optimize(T const & v)
+{
+	asm volatile("" : : "r,m"(v) : "memory");
+}
+
+inline void clobber() { asm volatile("" : : : "memory"); }
+
+inline double elapsed_ns(clock::time_point t0, clock::time_point t1)
+{
+	return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+// cost of the two clock reads around a sampled operation
+inline double clock_overhead_ns()
+{
+	static double const overhead = []{
+		std::vector<double> v(1000);
+		for(auto & x : v) {
+			auto const t0 = clock::now();
+			clobber();
+			x = elapsed_ns(t0, clock::now());
+		}
+		std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+		return v[v.size() / 2];
+	}();
+	return overhead;
+}
+
+// a hardware counter for this thread in user space; a no-op where the kernel (or the
+// virtual machine) does not expose one
+struct perf_counter
+{
+	int fd = -1;
+
+	perf_counter() = default;
+	perf_counter(uint32_t type, uint64_t config)
+	{
+		perf_event_attr a{};
+		a.type = type;
+		a.size = sizeof(a);
+		a.config = config;
+		a.disabled = 1;
+		a.exclude_kernel = 1;
+		a.exclude_hv = 1;
+		fd = int(syscall(__NR_perf_event_open, &a, 0, -1, -1, 0));
+	}
+	~perf_counter() { if ( fd >= 0 ) close(fd); }
+	perf_counter(perf_counter const &) = delete;
+	perf_counter & operator=(perf_counter const &) = delete;
+	perf_counter(perf_counter && o) noexcept : fd(o.fd) { o.fd = -1; }
+
+	static perf_counter llc_misses() { return perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES); }
+
+	bool ok() const { return fd >= 0; }
+	void start()
+	{
+		if ( fd < 0 ) return;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	uint64_t stop()
+	{
+		uint64_t v = 0;
+		if ( fd < 0 ) return v;
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if ( read(fd, &v, sizeof(v)) != sizeof(v) ) v = 0;
+		return v;
+	}
+};
+
+struct state
+{
+	std::string name;
+	size_t ops = 0;
+	double ns = 0;
+	std::vector<float> latencies; // ns, one per sampled operation
+
+	// cases set count_misses to have measure() count last level cache misses as well
+	bool count_misses = false;
+	bool misses_counted = false;
+	uint64_t misses = 0;
+
+	// anything else a case wants reported per operation, as (unit, total) pairs
+	std::vector< std::pair<std::string, double> > counters;
+	void count(std::string unit, double total) { counters.emplace_back(std::move(unit), total); }
+
+	// times f(), which is expected to perform n operations; repeated calls accumulate
+	template<typename F> void measure(size_t n, F && f)
+	{
+		perf_counter pc = count_misses ? perf_counter::llc_misses() : perf_counter();
+		pc.start();
+		auto const t0 = clock::now();
+		f();
+		auto const t1 = clock::now();
+		misses += pc.stop();
+		misses_counted |= pc.ok();
+		ops += n;
+		ns += elapsed_ns(t0, t1);
+	}
+
+	// times f(i) for i in [0, n) one by one, keeping each latency for the percentiles
+	template<typename F> void sample(size_t n, F && f)
+	{
+		double const overhead = clock_overhead_ns();
+		latencies.reserve(latencies.size() + n);
+		for(size_t i = 0; i < n; ++i) {
+			auto const t0 = clock::now();
+			f(i);
+			auto const t1 = clock::now();
+			double const d = std::max(0.0, elapsed_ns(t0, t1) - overhead);
+			latencies.push_back(float(d));
+			ns += d;
+		}
+		ops += n;
+	}
+
+	double ns_per_op() const { return ops ? ns / ops : 0; }
+
+	// q in [0, 1]; sorts the samples on first use
+	double percentile(double q)
+	{
+		if ( latencies.empty() ) return 0;
+		if ( !sorted_ ) {
+			std::sort(latencies.begin(), latencies.end());
+			sorted_ = true;
+		}
+		size_t const i = std::min(latencies.size() - 1, size_t(q * latencies.size()));
+		return latencies[i];
+	}
+
+	private:
+		bool sorted_ = false;
+};
+
+using bench_fn = std::function<void(state &)>;
+
+struct entry
+{
+	std::string name;
+	bench_fn fn;
+};
+
+inline std::vector<entry> & registry()
+{
+	static std::vector<entry> r;
+	return r;
+}
+
+inline void add(std::string name, bench_fn fn) { registry().push_back(entry{std::move(name), std::move(fn)}); }
+
+struct registrar
+{
+	registrar(char const * name, void (*fn)(state &)) { add(name, fn); }
+	// runs f() at static initialization, for cases registered in bulk through add()
+	template<typename F> explicit registrar(F && f) { f(); }
+};
+
+// deterministic key stream shared by the cases, so runs are comparable
+struct xorshift
+{
+	using result_type = uint64_t;
+	uint64_t s;
+	explicit xorshift(uint64_t seed = 0x9E3779B97F4A7C15ULL) : s(seed) {}
+	uint64_t operator()() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+
+	static constexpr result_type min() { return 1; }
+	static constexpr result_type max() { return UINT64_MAX; }
+};
+
+} // namespace bench
+
+#define BENCH(name) \
+	static void bench_##name(::bench::state &); \
+	static ::bench::registrar bench_registrar_##name(#name, bench_##name); \
+	static void bench_##name(::bench::state & st)
@@ -0,0 +1,202 @@
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Order book workloads over skip_list and the usual alternatives: std::map and a
+ * sorted std::vector keeping the best level at the back. Levels sit on even ticks;
+ * bids (sd=1) are best at the highest tick, asks (sd=0) at the lowest.
+ */
+
+namespace {
+
+using key_type = int32_t;
+
+struct side_less
+{
+	uint8_t sd;
+	bool operator()(key_type a, key_type b) const { return sd ? b < a : a < b; }
+};
+
+struct skip_book
+{
+	skip_list<key_type, void*, skip_list_levels<key_type, void*>(4), pool_allocator> l;
+
+	explicit skip_book(uint8_t sd) : l(sd, 1) {}
+	void insert(key_type k) { bench::do_not_optimize(l.insert(k, nullptr)); }
+	void erase(key_type k) { bench::do_not_optimize(l.erase(k)); }
+	bool find(key_type k) const { return l.find(k) != nullptr; }
+	key_type best() const { return l.begin()->key; }
+	void pop_best() { l.erase_head(); }
+	int64_t walk() const
+	{
+		int64_t r = 0;
+		for(auto & e : l) r += e.key;
+		return r;
+	}
+	size_t snapshot() const { return l.to_vector().size(); }
+};
+
+struct map_book
+{
+	std::map<key_type, void*, side_less> m;
+
+	explicit map_book(uint8_t sd) : m(side_less{sd}) {}
+	void insert(key_type k) { bench::do_not_optimize(m.emplace(k, nullptr).second); }
+	void erase(key_type k) { bench::do_not_optimize(m.erase(k)); }
+	bool find(key_type k) const { return m.find(k) != m.end(); }
+	key_type best() const { return m.begin()->first; }
+	void pop_best() { m.erase(m.begin()); }
+	int64_t walk() const
+	{
+		int64_t r = 0;
+		for(auto & e : m) r += e.first;
+		return r;
+	}
+	size_t snapshot() const { return std::vector< std::pair<key_type, void*> >(m.begin(), m.end()).size(); }
+};
+
+struct vector_book
+{
+	using level = std::pair<key_type, void*>;
+	std::vector<level> v; // worst first, best at the back
+	side_less worse;
+
+	explicit vector_book(uint8_t sd) : worse{uint8_t(!sd)} {}
+	std::vector<level>::iterator lower(key_type k)
+	{
+		return std::lower_bound(v.begin(), v.end(), k, [&](level const & a, key_type b){ return worse(a.first, b); });
+	}
+	void insert(key_type k)
+	{
+		auto it = lower(k);
+		if ( it == v.end() || it->first != k ) v.insert(it, level(k, nullptr));
+	}
+	void erase(key_type k)
+	{
+		auto it = lower(k);
+		if ( it != v.end() && it->first == k ) v.erase(it);
+	}
+	bool find(key_type k) const
+	{
+		auto it = std::lower_bound(v.begin(), v.end(), k, [&](level const & a, key_type b){ return worse(a.first, b); });
+		return it != v.end() && it->first == k;
+	}
+	key_type best() const { return v.back().first; }
+	void pop_best() { v.pop_back(); }
+	int64_t walk() const
+	{
+		int64_t r = 0;
+		for(auto it = v.rbegin(); it != v.rend(); ++it) r += it->first;
+		return r;
+	}
+	size_t snapshot() const { return std::vector<level>(v.rbegin(), v.rend()).size(); }
+};
+
+constexpr size_t ops = 1 << 16;
+
+// keys of a book of `depth` levels: 0, 2, ..., 2 * (depth - 1)
+template<typename book> void fill(book & b, int depth)
+{
+	for(int i = 0; i < depth; ++i) b.insert(2 * i);
+}
+
+// even tick at most `depth` levels away from the best price, skewed towards it
+key_type near_head(bench::xorshift & rnd, uint8_t sd, int depth)
+{
+	int const d = std::min(depth - 1, int(__builtin_ctzll(rnd() | (1ULL << 40))) * 2 + int(rnd() % 3));
+	return 2 * (sd ? depth - 1 - d : d);
+}
+
+key_type uniform(bench::xorshift & rnd, uint8_t, int depth) { return 2 * key_type(rnd() % depth); }
+
+// the best level trades away and is replenished
+template<typename book> void top_churn(bench::state & st, uint8_t sd, int depth)
+{
+	book b(sd);
+	fill(b, depth);
+	st.sample(ops, [&](size_t){
+		key_type const k = b.best();
+		b.pop_best();
+		b.insert(k);
+	});
+}
+
+// a level is cancelled and added back
+template<typename book, key_type (*dist)(bench::xorshift &, uint8_t, int)>
+void cancel(bench::state & st, uint8_t sd, int depth)
+{
+	book b(sd);
+	fill(b, depth);
+	bench::xorshift rnd;
+	std::vector<key_type> keys(ops);
+	for(auto & k : keys) k = dist(rnd, sd, depth);
+	st.sample(ops, [&](size_t i){
+		b.erase(keys[i]);
+		b.insert(keys[i]);
+	});
+}
+
+template<typename book, key_type (*dist)(bench::xorshift &, uint8_t, int)>
+void lookup(bench::state & st, uint8_t sd, int depth)
+{
+	book b(sd);
+	fill(b, depth);
+	bench::xorshift rnd;
+	std::vector<key_type> keys(ops);
+	for(auto & k : keys) k = dist(rnd, sd, depth) + int(rnd() % 2); // half of them miss
+	st.sample(ops, [&](size_t i){ bench::do_not_optimize(b.find(keys[i])); });
+}
+
+template<typename book> void iterate(bench::state & st, uint8_t sd, int depth)
+{
+	book b(sd);
+	fill(b, depth);
+	for(int r = 0; r < 20; ++r) {
+		st.measure(depth, [&]{ bench::do_not_optimize(b.walk()); });
+	}
+}
+
+template<typename book> void snapshot(bench::state & st, uint8_t sd, int depth)
+{
+	book b(sd);
+	fill(b, depth);
+	for(int r = 0; r < 20; ++r) {
+		st.measure(depth, [&]{ bench::do_not_optimize(b.snapshot()); });
+	}
+}
+
+template<typename book> void add_cases(char const * container)
+{
+	using workload = void (*)(bench::state &, uint8_t, int);
+	struct { char const * name; workload fn; } const workloads[] = {
+		{ "top_churn", top_churn<book> },
+		{ "cancel_uniform", cancel<book, uniform> },
+		{ "cancel_near_head", cancel<book, near_head> },
+		{ "find_uniform", lookup<book, uniform> },
+		{ "find_near_head", lookup<book, near_head> },
+		{ "iterate", iterate<book> },
+		{ "to_vector", snapshot<book> },
+	};
+	for(int depth : { 1000, 100000 }) {
+		for(auto const & w : workloads) {
+			for(uint8_t sd : { 0, 1 }) {
+				std::string const name = std::string("book_") + w.name + "/" + container + "/"
+					+ (sd ? "bid/" : "ask/") + std::to_string(depth);
+				workload const fn = w.fn;
+				bench::add(name, [=](bench::state & st){ fn(st, sd, depth); });
+			}
+		}
+	}
+}
+
+bench::registrar const book_cases([]{
+	add_cases<skip_book>("skip_list");
+	add_cases<map_book>("map");
+	add_cases<vector_book>("vector");
+});
+
+} // namespace
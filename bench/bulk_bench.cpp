@@ -0,0 +1,75 @@
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// rebuilding a 1M level snapshot: insert() per level against assign_sorted() and
+// append_back(), and what the balanced towers do to lookups afterwards
+
+namespace {
+
+using list_type = ascending_skip_list<int32_t, void*, pool_allocator>;
+using snapshot = std::vector< std::pair<int32_t, void*> >;
+
+constexpr int depth = 1000000;
+constexpr int rounds = 5;
+
+snapshot make_snapshot()
+{
+	snapshot s(depth);
+	for(int i = 0; i < depth; ++i) s[i] = std::make_pair(2 * i, nullptr);
+	return s;
+}
+
+void build_insert(bench::state & st)
+{
+	auto const s = make_snapshot();
+	list_type x(std::less<int32_t>(), 1);
+	for(int r = 0; r < rounds; ++r) {
+		x.clear();
+		st.measure(s.size(), [&]{
+			for(auto const & e : s) x.insert(e.first, e.second);
+		});
+	}
+}
+
+void build_append(bench::state & st)
+{
+	auto const s = make_snapshot();
+	list_type x(std::less<int32_t>(), 1);
+	for(int r = 0; r < rounds; ++r) {
+		x.clear();
+		st.measure(s.size(), [&]{
+			for(auto const & e : s) x.append_back(e.first, e.second);
+		});
+	}
+}
+
+void build_assign(bench::state & st)
+{
+	auto const s = make_snapshot();
+	list_type x(std::less<int32_t>(), 1);
+	for(int r = 0; r < rounds; ++r) {
+		st.measure(s.size(), [&]{ x.assign_sorted(s.begin(), s.end()); });
+	}
+}
+
+template<bool balanced> void find_after_build(bench::state & st)
+{
+	auto const s = make_snapshot();
+	list_type x(std::less<int32_t>(), 1);
+	if ( balanced ) x.assign_sorted(s.begin(), s.end());
+	else for(auto const & e : s) x.insert(e.first, e.second);
+
+	bench::xorshift rnd;
+	st.sample(1 << 18, [&](size_t) { bench::do_not_optimize(x.find(int32_t(rnd() % (2 * depth)))); });
+}
+
+} // namespace
+
+BENCH(bulk_build_1m_insert) { build_insert(st); }
+BENCH(bulk_build_1m_append_back) { build_append(st); }
+BENCH(bulk_build_1m_assign_sorted) { build_assign(st); }
+BENCH(bulk_find_1m_random_towers) { find_after_build<false>(st); }
+BENCH(bulk_find_1m_balanced_towers) { find_after_build<true>(st); }
@@ -0,0 +1,53 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// search loop cost with the runtime side_compare versus std::less / std::greater
+
+namespace {
+
+using runtime_list = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4), pool_allocator>;
+using ask_list = ascending_skip_list<int32_t, void*, pool_allocator>;
+using bid_list = descending_skip_list<int32_t, void*, pool_allocator>;
+
+template<typename list_type> void find_random(bench::state & st, list_type & x, int depth)
+{
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, nullptr);
+
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(1 << 20);
+	for(auto & k : keys) k = int32_t(rnd() % (2 * depth));
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(x.find(k));
+	});
+}
+
+template<typename list_type> void insert_erase(bench::state & st, list_type & x, int depth)
+{
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, nullptr);
+
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(1 << 18);
+	for(auto & k : keys) k = 2 * int32_t(rnd() % depth) + 1;
+	st.measure(2 * keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(x.insert(k, nullptr));
+		for(auto k : keys) bench::do_not_optimize(x.erase(k));
+	});
+}
+
+} // namespace
+
+BENCH(compare_find_1k_runtime_ask) { runtime_list x(0, 1); find_random(st, x, 1000); }
+BENCH(compare_find_1k_runtime_bid) { runtime_list x(1, 1); find_random(st, x, 1000); }
+BENCH(compare_find_1k_less) { ask_list x(std::less<int32_t>(), 1); find_random(st, x, 1000); }
+BENCH(compare_find_1k_greater) { bid_list x(std::greater<int32_t>(), 1); find_random(st, x, 1000); }
+BENCH(compare_find_100k_runtime_ask) { runtime_list x(0, 1); find_random(st, x, 100000); }
+BENCH(compare_find_100k_runtime_bid) { runtime_list x(1, 1); find_random(st, x, 100000); }
+BENCH(compare_find_100k_less) { ask_list x(std::less<int32_t>(), 1); find_random(st, x, 100000); }
+BENCH(compare_find_100k_greater) { bid_list x(std::greater<int32_t>(), 1); find_random(st, x, 100000); }
+
+BENCH(compare_insert_erase_1k_runtime_ask) { runtime_list x(0, 1); insert_erase(st, x, 1000); }
+BENCH(compare_insert_erase_1k_runtime_bid) { runtime_list x(1, 1); insert_erase(st, x, 1000); }
+BENCH(compare_insert_erase_1k_less) { ask_list x(std::less<int32_t>(), 1); insert_erase(st, x, 1000); }
+BENCH(compare_insert_erase_1k_greater) { bid_list x(std::greater<int32_t>(), 1); insert_erase(st, x, 1000); }
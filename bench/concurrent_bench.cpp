@@ -0,0 +1,124 @@
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+#include "concurrent_skip_list.hpp"
+
+/*
+ * Reader scaling with one writer churning the book: strategy threads read the top
+ * levels and look up random ones, either lock-free through concurrent_skip_list or
+ * the way it is done without it, copying out of a skip_list under a mutex. ns/op is
+ * wall time over the reads of all reader threads together.
+ */
+
+namespace {
+
+using key_type = int32_t;
+
+constexpr int depth = 1000;
+constexpr size_t reads = 1 << 16; // per reader
+constexpr size_t top_levels = 5;
+
+struct lock_free_book
+{
+	concurrent_skip_list<key_type, int64_t, skip_list_levels<key_type, int64_t>(4), pool_allocator> l{uint8_t(1), 1};
+
+	struct reader
+	{
+		decltype(l)::reader r;
+		explicit reader(lock_free_book & b) : r(b.l) {}
+		int64_t top() const
+		{
+			int64_t s = 0;
+			r.top(top_levels, [&](key_type, int64_t v) { s += v; });
+			return s;
+		}
+		bool find(key_type k) const { int64_t v; return r.find(k, v); }
+	};
+
+	void insert(key_type k) { l.insert(k, k); }
+	void erase(key_type k) { l.erase(k); }
+};
+
+struct mutex_book
+{
+	skip_list<key_type, int64_t, skip_list_levels<key_type, int64_t>(4), pool_allocator> l{uint8_t(1), 1};
+	std::mutex m;
+
+	struct reader
+	{
+		mutex_book & b;
+		explicit reader(mutex_book & b_) : b(b_) {}
+		int64_t top() const
+		{
+			std::lock_guard<std::mutex> g(b.m);
+			int64_t s = 0;
+			size_t n = 0;
+			for(auto it = b.l.begin(); it != b.l.end() && n < top_levels; ++it, ++n) s += it->value;
+			return s;
+		}
+		bool find(key_type k) const
+		{
+			std::lock_guard<std::mutex> g(b.m);
+			return b.l.find(k) != nullptr;
+		}
+	};
+
+	void insert(key_type k) { std::lock_guard<std::mutex> g(m); l.insert(k, k); }
+	void erase(key_type k) { std::lock_guard<std::mutex> g(m); l.erase(k); }
+};
+
+template<typename book> void readers_with_writer(bench::state & st, size_t readers)
+{
+	book b;
+	for(int i = 0; i < depth; ++i) b.insert(2 * i);
+
+	std::atomic<bool> done{false};
+	std::thread writer([&]{
+		bench::xorshift rnd(7);
+		while( !done.load(std::memory_order_relaxed) ) {
+			key_type const k = 2 * key_type(rnd() % depth) + 1;
+			b.insert(k);
+			b.erase(k);
+		}
+	});
+
+	std::atomic<size_t> ready{0};
+	std::atomic<bool> go{false};
+	std::vector<std::thread> threads;
+	st.measure(readers * reads, [&]{
+		for(size_t t = 0; t < readers; ++t) {
+			threads.emplace_back([&, t]{
+				typename book::reader r(b);
+				bench::xorshift rnd(t + 1);
+				ready++;
+				while( !go.load(std::memory_order_acquire) );
+				for(size_t i = 0; i < reads; i += 2) {
+					bench::do_not_optimize(r.top());
+					bench::do_not_optimize(r.find(key_type(rnd() % (2 * depth))));
+				}
+			});
+		}
+		while( ready.load() != readers );
+		go.store(true, std::memory_order_release);
+		for(auto & t : threads) t.join();
+	});
+
+	done.store(true, std::memory_order_relaxed);
+	writer.join();
+}
+
+bench::registrar const concurrent_cases([]{
+	size_t const cores = std::max(4u, std::thread::hardware_concurrency());
+	for(size_t readers = 1; readers <= cores; readers *= 2) {
+		std::string const n = std::to_string(readers);
+		bench::add("concurrent_readers/lock_free/" + n, [=](bench::state & st){ readers_with_writer<lock_free_book>(st, readers); });
+		bench::add("concurrent_readers/mutex/" + n, [=](bench::state & st){ readers_with_writer<mutex_book>(st, readers); });
+	}
+});
+
+} // namespace
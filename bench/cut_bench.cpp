@@ -0,0 +1,115 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Whole-range operations on a 100K level bid book, one call per op against the
+ * element-wise loops they replace: dropping all but the best 1000 levels, splitting
+ * the book in half, joining the halves back, and copying it. With aligned_allocator
+ * split_at() and join() only relink the cut; with pool_allocator the nodes move into
+ * the other list's pool.
+ */
+
+namespace {
+
+template<template<typename, size_t> class Allocator>
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), Allocator>;
+
+constexpr int depth = 100000;
+constexpr int keep = 1000;
+constexpr size_t rounds = 32;
+
+template<typename L> L const & book()
+{
+	static L x(uint8_t(1), 1);
+	if ( x.empty() ) {
+		for(int i = 0; i < depth; ++i) x.insert(2 * (depth - i), i % 100 + 1);
+	}
+	return x;
+}
+
+// bids: the i-th best level
+int32_t level(int i) { return 2 * (depth - i); }
+
+// the copies of the book are made outside the timed part
+template<typename L> void truncate(bench::state & st, bool loop)
+{
+	for(size_t r = 0; r < rounds; ++r) {
+		L x = book<L>();
+		st.measure(1, [&]{
+			if ( !loop ) bench::do_not_optimize(x.truncate_after(level(keep - 1)));
+			else for(int i = keep; i < depth; ++i) x.erase(level(i));
+		});
+	}
+}
+
+template<typename L> void split(bench::state & st, bool loop)
+{
+	for(size_t r = 0; r < rounds; ++r) {
+		L x = book<L>();
+		L y{uint8_t(1)};
+		st.measure(1, [&]{
+			if ( !loop ) y = x.split_at(level(depth / 2));
+			else {
+				for(int i = depth / 2; i < depth; ++i) y.append_back(level(i), x.erase(level(i)).first);
+			}
+		});
+		bench::do_not_optimize(y.size());
+	}
+}
+
+template<typename L> void join(bench::state & st, bool loop)
+{
+	for(size_t r = 0; r < rounds; ++r) {
+		L x = book<L>();
+		L y = x.split_at(level(depth / 2));
+		st.measure(1, [&]{
+			if ( !loop ) x.join(y);
+			else {
+				for(auto const & e : y) x.append_back(e.key, e.value);
+				y.clear();
+			}
+		});
+		bench::do_not_optimize(x.size());
+	}
+}
+
+template<typename L> void copy(bench::state & st, bool loop)
+{
+	L const & x = book<L>();
+	st.measure(rounds, [&]{
+		for(size_t r = 0; r < rounds; ++r) {
+			L y{uint8_t(1)};
+			if ( !loop ) y = x.clone();
+			else {
+				auto const v = x.to_vector();
+				y.assign_sorted(v.begin(), v.end());
+			}
+			bench::do_not_optimize(y.size());
+		}
+	});
+}
+
+template<template<typename, size_t> class Allocator> void add_cases(char const * allocator)
+{
+	using L = list_type<Allocator>;
+	std::string const a = std::string("/") + allocator;
+	bench::add("cut_truncate/truncate_after" + a, [](bench::state & st){ truncate<L>(st, false); });
+	bench::add("cut_truncate/erase_loop" + a, [](bench::state & st){ truncate<L>(st, true); });
+	bench::add("cut_split/split_at" + a, [](bench::state & st){ split<L>(st, false); });
+	bench::add("cut_split/erase_append_loop" + a, [](bench::state & st){ split<L>(st, true); });
+	bench::add("cut_join/join" + a, [](bench::state & st){ join<L>(st, false); });
+	bench::add("cut_join/append_loop" + a, [](bench::state & st){ join<L>(st, true); });
+	bench::add("cut_copy/clone" + a, [](bench::state & st){ copy<L>(st, false); });
+	bench::add("cut_copy/to_vector_assign" + a, [](bench::state & st){ copy<L>(st, true); });
+}
+
+bench::registrar const cut_cases([]{
+	add_cases<aligned_allocator>("aligned");
+	add_cases<pool_allocator>("pool");
+});
+
+} // namespace
@@ -0,0 +1,76 @@
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Tower height distributions against each other: random finds on books of 1K to 1M
+ * levels built by random inserts, in ns per lookup, and the forward steps per lookup
+ * counted on a twin list with sl_stats, built from the same seed and keys so its
+ * towers come out the same. Uniform, log, sqrt and rev_sqrt put a fixed share of the
+ * nodes on the top level, so searches there take O(n) steps and building the big
+ * books would take minutes; they stop at 64K, log, half of whose nodes are full
+ * height, at 8K.
+ */
+
+namespace {
+
+template<unsigned options>
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4, options), pool_allocator,
+	xorshift64star, side_compare<int32_t>, options>;
+
+constexpr size_t ops = 1 << 18;
+
+template<typename L> void build(L & x, int depth)
+{
+	bench::xorshift rnd;
+	std::vector<int32_t> v(depth);
+	for(int i = 0; i < depth; ++i) v[i] = 2 * i;
+	for(int i = depth - 1; i > 0; --i) std::swap(v[i], v[rnd() % ( i + 1 )]);
+	for(int32_t k : v) x.insert(k, k);
+}
+
+template<unsigned options> void find(bench::state & st, int depth)
+{
+	using L = list_type<options>;
+	L x(uint8_t(1), 1);
+	build(x, depth);
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(ops);
+	for(auto & k : keys) k = int32_t(rnd() % (2 * depth));
+	L const & c = x;
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(c.find(k));
+	});
+
+	using S = list_type<options | sl_stats>;
+	S s(uint8_t(1), 1);
+	build(s, depth);
+	// the inserts' steps are counted too, so only the difference is the finds'
+	uint64_t hops = 0;
+	for(uint64_t n : s.stats().hops) hops -= n;
+	for(auto k : keys) bench::do_not_optimize(s.find(k));
+	for(uint64_t n : s.stats().hops) hops += n;
+	st.count("hops", double(hops));
+}
+
+template<unsigned options> void add_cases(char const * dist, int max_depth)
+{
+	for(int depth : { 1000, 8000, 64000, 1000000 }) {
+		if ( depth > max_depth ) break;
+		std::string const name = std::string("distribution_find/") + dist + "/" + std::to_string(depth);
+		bench::add(name, [=](bench::state & st){ find<options>(st, depth); });
+	}
+}
+
+bench::registrar const distribution_cases([]{
+	add_cases<0>("rev_log", 1000000);
+	add_cases<sl_uniform_levels>("uniform", 64000);
+	add_cases<sl_log_levels>("log", 8000);
+	add_cases<sl_sqrt_levels>("sqrt", 64000);
+	add_cases<sl_rev_sqrt_levels>("rev_sqrt", 64000);
+	add_cases<sl_adaptive_levels>("adaptive", 1000000);
+});
+
+} // namespace
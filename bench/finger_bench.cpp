@@ -0,0 +1,84 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// cold top-down searches versus searches started from a hint or from the cached finger
+
+namespace {
+
+using list_type = ascending_skip_list<int32_t, void*, pool_allocator>;
+
+constexpr int depth = 1000000;
+constexpr size_t ops = 1 << 18;
+
+// odd ticks close to the best (lowest) level, most of them within a few dozen levels
+std::vector<int32_t> near_head_keys()
+{
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(ops);
+	for(auto & k : keys) k = 2 * int32_t(__builtin_ctzll(rnd() | (1ULL << 12)) * 4 + rnd() % 8) + 1;
+	return keys;
+}
+
+// a slowly drifting price: each key a few levels away from the previous one
+std::vector<int32_t> drifting_keys()
+{
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(ops);
+	int32_t k = depth;
+	for(auto & x : keys) {
+		k = std::max(1, std::min(2 * depth - 1, k + 2 * int32_t(rnd() % 17) - 16));
+		x = k | 1;
+	}
+	return keys;
+}
+
+void fill(list_type & x)
+{
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, nullptr);
+}
+
+enum class mode { cold, hint, finger };
+
+template<mode m> void find(bench::state & st, std::vector<int32_t> const & keys)
+{
+	list_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const head = x.begin();
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) {
+			if ( m == mode::cold ) bench::do_not_optimize(x.find(k));
+			if ( m == mode::hint ) bench::do_not_optimize(x.find_from(head, k));
+			if ( m == mode::finger ) bench::do_not_optimize(x.find_near(k));
+		}
+	});
+}
+
+template<mode m> void add_cancel(bench::state & st, std::vector<int32_t> const & keys)
+{
+	list_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const head = x.begin();
+	st.measure(2 * keys.size(), [&]{
+		for(auto k : keys) {
+			if ( m == mode::cold ) { x.insert(k, nullptr); x.erase(k); }
+			if ( m == mode::hint ) { x.insert(head, k, nullptr); x.erase(k); }
+			if ( m == mode::finger ) { x.insert_near(k, nullptr); x.erase_near(k); }
+		}
+	});
+}
+
+} // namespace
+
+BENCH(finger_find_near_head_cold) { find<mode::cold>(st, near_head_keys()); }
+BENCH(finger_find_near_head_hint) { find<mode::hint>(st, near_head_keys()); }
+BENCH(finger_find_near_head_finger) { find<mode::finger>(st, near_head_keys()); }
+BENCH(finger_find_drifting_cold) { find<mode::cold>(st, drifting_keys()); }
+BENCH(finger_find_drifting_finger) { find<mode::finger>(st, drifting_keys()); }
+
+BENCH(finger_add_cancel_near_head_cold) { add_cancel<mode::cold>(st, near_head_keys()); }
+BENCH(finger_add_cancel_near_head_hint) { add_cancel<mode::hint>(st, near_head_keys()); }
+BENCH(finger_add_cancel_near_head_finger) { add_cancel<mode::finger>(st, near_head_keys()); }
+BENCH(finger_add_cancel_drifting_cold) { add_cancel<mode::cold>(st, drifting_keys()); }
+BENCH(finger_add_cancel_drifting_finger) { add_cancel<mode::finger>(st, drifting_keys()); }
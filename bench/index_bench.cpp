@@ -0,0 +1,99 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// depth snapshots and level ranks from span counters versus walking level 0,
+// and what keeping the spans up to date costs on add/cancel
+
+namespace {
+
+using plain_type = ascending_skip_list<int32_t, void*, pool_allocator>;
+using indexed_type = indexable_skip_list<int32_t, void*, std::less<int32_t>, pool_allocator>;
+
+constexpr int depth = 100000;
+constexpr size_t ops = 1 << 16;
+constexpr size_t snapshot = 10; // levels per snapshot
+
+template<typename L> void fill(L & x)
+{
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, nullptr);
+}
+
+// snapshot offsets skewed towards the top of the book
+std::vector<size_t> offsets()
+{
+	bench::xorshift rnd;
+	std::vector<size_t> r(ops);
+	for(auto & o : r) o = rnd() % (rnd() % 2 ? 100 : depth - snapshot);
+	return r;
+}
+
+void snapshot_walk(bench::state & st)
+{
+	plain_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const offs = offsets();
+	st.sample(offs.size(), [&](size_t i) {
+		auto it = x.begin();
+		for(size_t j = 0; j < offs[i]; ++j) ++it;
+		for(size_t j = 0; j < snapshot; ++j, ++it) bench::do_not_optimize(it->key);
+	});
+}
+
+void snapshot_at(bench::state & st)
+{
+	indexed_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const offs = offsets();
+	st.sample(offs.size(), [&](size_t i) {
+		auto it = x.at(offs[i]);
+		for(size_t j = 0; j < snapshot; ++j, ++it) bench::do_not_optimize(it->key);
+	});
+}
+
+void rank_walk(bench::state & st)
+{
+	plain_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const offs = offsets();
+	st.sample(offs.size(), [&](size_t i) {
+		int32_t const k = int32_t(2 * offs[i] + 1);
+		size_t r = 0;
+		for(auto it = x.begin(); it != x.end() && it->key < k; ++it) ++r;
+		bench::do_not_optimize(r);
+	});
+}
+
+void rank_spans(bench::state & st)
+{
+	indexed_type x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const offs = offsets();
+	st.sample(offs.size(), [&](size_t i) {
+		bench::do_not_optimize(x.rank(int32_t(2 * offs[i] + 1)));
+	});
+}
+
+template<typename L> void add_cancel(bench::state & st)
+{
+	L x(std::less<int32_t>(), 1);
+	fill(x);
+	auto const offs = offsets();
+	st.measure(2 * offs.size(), [&]{
+		for(auto o : offs) {
+			int32_t const k = int32_t(2 * o + 1);
+			x.insert(k, nullptr);
+			x.erase(k);
+		}
+	});
+}
+
+} // namespace
+
+BENCH(index_snapshot_walk) { snapshot_walk(st); }
+BENCH(index_snapshot_at) { snapshot_at(st); }
+BENCH(index_rank_walk) { rank_walk(st); }
+BENCH(index_rank_spans) { rank_spans(st); }
+BENCH(index_add_cancel_plain) { add_cancel<plain_type>(st); }
+BENCH(index_add_cancel_indexed) { add_cancel<indexed_type>(st); }
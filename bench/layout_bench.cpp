@@ -0,0 +1,57 @@
+#include <vector>
+#include <algorithm>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// variable-height towers (default N, up to 4 cache lines) versus the former one-line, 6 level cap
+
+namespace {
+
+using capped_list = skip_list<int32_t, void*, 6, pool_allocator>;
+using tall_list = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4), pool_allocator>;
+
+template<typename list_type> void find_random(bench::state & st, int n)
+{
+	list_type x(0, 1);
+	std::vector<int32_t> keys(n);
+	for(int i = 0; i < n; ++i) keys[i] = 2 * i;
+	std::shuffle(keys.begin(), keys.end(), bench::xorshift());
+	for(auto k : keys) x.insert(k, nullptr);
+
+	bench::xorshift rnd(7);
+	size_t const lookups = 1 << 20;
+	st.measure(lookups, [&]{
+		for(size_t i = 0; i < lookups; ++i) bench::do_not_optimize(x.find(2 * int32_t(rnd() % n)));
+	});
+}
+
+template<typename list_type> void insert_random(bench::state & st, int n)
+{
+	std::vector<int32_t> keys(n);
+	for(int i = 0; i < n; ++i) keys[i] = i;
+	std::shuffle(keys.begin(), keys.end(), bench::xorshift());
+
+	list_type x(0, 1);
+	st.measure(n, [&]{
+		for(auto k : keys) x.insert(k, nullptr);
+	});
+}
+
+} // namespace
+
+BENCH(layout_find_1k_capped) { find_random<capped_list>(st, 1000); }
+BENCH(layout_find_1k_tall) { find_random<tall_list>(st, 1000); }
+BENCH(layout_find_10k_capped) { find_random<capped_list>(st, 10000); }
+BENCH(layout_find_10k_tall) { find_random<tall_list>(st, 10000); }
+BENCH(layout_find_100k_capped) { find_random<capped_list>(st, 100000); }
+BENCH(layout_find_100k_tall) { find_random<tall_list>(st, 100000); }
+BENCH(layout_find_1m_tall) { find_random<tall_list>(st, 1000000); }
+BENCH(layout_find_10m_tall) { find_random<tall_list>(st, 10000000); }
+
+BENCH(layout_insert_10k_capped) { insert_random<capped_list>(st, 10000); }
+BENCH(layout_insert_10k_tall) { insert_random<tall_list>(st, 10000); }
+BENCH(layout_insert_100k_capped) { insert_random<capped_list>(st, 100000); }
+BENCH(layout_insert_100k_tall) { insert_random<tall_list>(st, 100000); }
+BENCH(layout_insert_1m_tall) { insert_random<tall_list>(st, 1000000); }
+BENCH(layout_insert_10m_tall) { insert_random<tall_list>(st, 10000000); }
@@ -0,0 +1,67 @@
+#include <random>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+// insert latency with the old per-insert std::random_device draw versus the inline generators
+
+namespace {
+
+// what random_level() used to pay for: a random_device read per insert
+struct random_device_levels
+{
+	using result_type = uint64_t;
+	std::random_device rd;
+
+	explicit random_device_levels(uint64_t) {}
+	result_type operator()() { return (uint64_t(rd()) << 32) ^ rd(); }
+};
+
+template<typename generator>
+using list_type = skip_list<int32_t, void*, 6, pool_allocator, generator>;
+
+constexpr int book_depth = 2000;
+
+template<typename generator> void insert_seq(bench::state & st)
+{
+	for(int r = 0; r < 5; ++r)
+	{
+		list_type<generator> x(0, 1);
+		st.measure(book_depth, [&]{
+			for(int i = 0; i < book_depth; ++i) x.insert(i, nullptr);
+		});
+	}
+}
+
+template<typename generator> void insert_random(bench::state & st)
+{
+	bench::xorshift rnd;
+	for(int r = 0; r < 5; ++r)
+	{
+		list_type<generator> x(0, 1);
+		st.measure(book_depth, [&]{
+			for(int i = 0; i < book_depth; ++i) x.insert(int32_t(rnd() >> 40), nullptr);
+		});
+	}
+}
+
+template<typename generator> void draw(bench::state & st)
+{
+	generator g(1);
+	size_t const n = 1 << 22;
+	st.measure(n, [&]{
+		for(size_t i = 0; i < n; ++i) bench::do_not_optimize(level_distribution<6>::rev_log(g()));
+	});
+}
+
+} // namespace
+
+BENCH(level_draw_random_device) { draw<random_device_levels>(st); }
+BENCH(level_draw_mt19937_64) { draw<std::mt19937_64>(st); }
+BENCH(level_draw_splitmix64) { draw<splitmix64>(st); }
+BENCH(level_draw_xorshift64star) { draw<xorshift64star>(st); }
+
+BENCH(level_insert_seq_random_device) { insert_seq<random_device_levels>(st); }
+BENCH(level_insert_seq_xorshift64star) { insert_seq<xorshift64star>(st); }
+BENCH(level_insert_random_random_device) { insert_random<random_device_levels>(st); }
+BENCH(level_insert_random_xorshift64star) { insert_random<xorshift64star>(st); }
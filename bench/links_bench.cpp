@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Pointer links against sl_compact_links: with 32-bit links a head of the same size
+ * holds twice the levels, so one-line nodes search a 12 level list instead of a 6
+ * level one. Random lookups on books built in random order, reporting the nodes a
+ * search visits next to its latency.
+ */
+
+namespace {
+
+template<size_t lines, unsigned Options, template<typename, size_t> class Allocator>
+using list_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(lines, Options),
+	Allocator, xorshift64star, std::less<int32_t>, Options>;
+
+// counts the nodes a find() visits: every node whose key is compared
+template<typename L> struct hop_probe : L
+{
+	using L::L;
+
+	size_t hops(int32_t k) const
+	{
+		auto const * p = this->head_;
+		if ( !p || !this->lt( p->key, k ) ) return 1;
+		size_t r = 1;
+		for(size_t lvl = L::max_levels; lvl > 0;) {
+			--lvl;
+			for(auto const * q = p->next(lvl); q; q = p->next(lvl)) {
+				++r;
+				if ( !this->lt( q->key, k ) ) break;
+				p = q;
+			}
+		}
+		return r;
+	}
+};
+
+template<typename L> void find_random(bench::state & st, int n)
+{
+	hop_probe<L> x(std::less<int32_t>(), 1);
+	std::vector<int32_t> keys(n);
+	for(int i = 0; i < n; ++i) keys[i] = 2 * i;
+	std::shuffle(keys.begin(), keys.end(), bench::xorshift(3));
+	for(auto k : keys) x.insert(k, nullptr);
+
+	bench::xorshift rnd(7);
+	std::vector<int32_t> lookups(1 << 20);
+	for(auto & k : lookups) k = 2 * int32_t(rnd() % n);
+	st.measure(lookups.size(), [&]{
+		for(auto k : lookups) bench::do_not_optimize(x.find(k));
+	});
+
+	size_t hops = 0;
+	for(size_t i = 0; i < lookups.size(); i += 16) hops += 16 * x.hops(lookups[i]);
+	st.count("hops", double(hops));
+	st.count("levels", double(L::max_levels) * lookups.size());
+}
+
+template<size_t lines> void add_cases(std::string const & head, std::initializer_list<int> sizes)
+{
+	for(int n : sizes) {
+		std::string const suffix = "/" + head + "/" + std::to_string(n);
+		bench::add("links_find_pointers" + suffix, [=](bench::state & st){
+			find_random< list_type<lines, 0, pool_allocator> >(st, n); });
+		bench::add("links_find_compact" + suffix, [=](bench::state & st){
+			find_random< list_type<lines, sl_compact_links, arena_allocator> >(st, n); });
+	}
+}
+
+bench::registrar const links_cases([]{
+	// 6 pointer levels run out long before 4M entries
+	add_cases<1>("1_line", { 10000, 100000 });
+	add_cases<4>("4_lines", { 100000, 4000000 });
+});
+
+} // namespace
@@ -0,0 +1,95 @@
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+#include "lock_free_skip_list.hpp"
+
+/*
+ * Aggregated book fed by several gateway threads: each one adds and cancels levels
+ * and looks some up, on lock_free_skip_list or on a skip_list behind a mutex.
+ * ns/op is wall time over the operations of all threads together.
+ */
+
+namespace {
+
+using key_type = int32_t;
+
+constexpr int depth = 1000;
+constexpr size_t ops = 1 << 17; // per thread
+
+struct lock_free_book
+{
+	lock_free_skip_list<key_type, int64_t> l{uint8_t(1)};
+
+	struct handle
+	{
+		decltype(l)::handle h;
+		handle(lock_free_book & b, uint64_t seed) : h(b.l, seed) {}
+		void insert(key_type k) { h.insert(k, k); }
+		void erase(key_type k) { h.erase(k); }
+		bool find(key_type k) const { int64_t v; return h.find(k, v); }
+	};
+};
+
+struct mutex_book
+{
+	skip_list<key_type, int64_t> l{uint8_t(1), 1};
+	std::mutex m;
+
+	struct handle
+	{
+		mutex_book & b;
+		handle(mutex_book & b_, uint64_t) : b(b_) {}
+		void insert(key_type k) { std::lock_guard<std::mutex> g(b.m); b.l.insert(k, k); }
+		void erase(key_type k) { std::lock_guard<std::mutex> g(b.m); b.l.erase(k); }
+		bool find(key_type k) const { std::lock_guard<std::mutex> g(b.m); return b.l.find(k) != nullptr; }
+	};
+};
+
+template<typename book> void writers(bench::state & st, size_t threads)
+{
+	book b;
+	{
+		typename book::handle h(b, 0);
+		for(int i = 0; i < depth; ++i) h.insert(2 * i);
+	}
+
+	std::atomic<size_t> ready{0};
+	std::atomic<bool> go{false};
+	std::vector<std::thread> ts;
+	st.measure(threads * ops, [&]{
+		for(size_t t = 0; t < threads; ++t) {
+			ts.emplace_back([&, t]{
+				typename book::handle h(b, t + 1);
+				bench::xorshift rnd(t + 1);
+				ready++;
+				while( !go.load(std::memory_order_acquire) );
+				for(size_t i = 0; i < ops; i += 4) {
+					key_type const k = 2 * key_type(rnd() % depth) + 1;
+					h.insert(k);
+					bench::do_not_optimize(h.find(key_type(rnd() % (2 * depth))));
+					bench::do_not_optimize(h.find(k));
+					h.erase(k);
+				}
+			});
+		}
+		while( ready.load() != threads );
+		go.store(true, std::memory_order_release);
+		for(auto & t : ts) t.join();
+	});
+}
+
+bench::registrar const lock_free_cases([]{
+	size_t const cores = std::max(4u, std::thread::hardware_concurrency());
+	for(size_t threads = 1; threads <= cores; threads *= 2) {
+		std::string const n = std::to_string(threads);
+		bench::add("lock_free_writers/lock_free/" + n, [=](bench::state & st){ writers<lock_free_book>(st, threads); });
+		bench::add("lock_free_writers/mutex/" + n, [=](bench::state & st){ writers<mutex_book>(st, threads); });
+	}
+});
+
+} // namespace
@@ -0,0 +1,36 @@
+#include <cstdio>
+#include <cstring>
+
+#include "bench.hpp"
+
+// usage: bench [substring]  - runs the cases whose name contains the substring
+
+int main(int argc, char ** argv)
+{
+	char const * filter = argc > 1 ? argv[1] : "";
+
+	std::printf("%-48s %10s %10s %9s %9s %9s %9s %9s\n",
+			"benchmark", "ops", "ns/op", "p50", "p90", "p99", "p99.9", "max");
+	for(auto & e : bench::registry())
+	{
+		if ( !std::strstr(e.name.c_str(), filter) ) continue;
+
+		bench::state st;
+		st.name = e.name;
+		e.fn(st);
+		std::printf("%-48s %10zu %10.2f", e.name.c_str(), st.ops, st.ns_per_op());
+		if ( !st.latencies.empty() ) {
+			std::printf(" %9.0f %9.0f %9.0f %9.0f %9.0f", st.percentile(0.5), st.percentile(0.9),
+					st.percentile(0.99), st.percentile(0.999), st.percentile(1));
+		}
+		if ( st.misses_counted ) {
+			std::printf("  %.2f LLC misses/op", double(st.misses) / st.ops);
+		}
+		for(auto const & c : st.counters) {
+			std::printf("  %.2f %s/op", c.second / st.ops, c.first.c_str());
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+	return 0;
+}
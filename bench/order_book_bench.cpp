@@ -0,0 +1,139 @@
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.hpp"
+#include "order_book.hpp"
+
+/*
+ * L3 message replay on a bid book of about 100K resting orders near the touch: adds,
+ * cancels of random resting orders and executions against the front order, in two
+ * mixes. order_book against std::map of std::list queues with an std::unordered_map
+ * from order id to list position. Cancels can name orders the executions already took,
+ * as late cancels on a feed do.
+ */
+
+namespace {
+
+struct message
+{
+	uint8_t type;   // 0 add, 1 cancel, 2 execute
+	int32_t px;
+	int64_t qty;
+	uint32_t pick;  // which resting order a cancel takes
+};
+
+constexpr size_t resting = 100000;
+constexpr size_t messages = 1 << 20;
+
+// prices fall off away from the touch
+int32_t draw_price(bench::xorshift & rnd)
+{
+	uint32_t const a = rnd() % 64, b = rnd() % 64;
+	return 100000 - int32_t(a * b / 4);
+}
+
+std::vector<message> stream(unsigned add_pct, unsigned cancel_pct)
+{
+	bench::xorshift rnd(3);
+	std::vector<message> r(messages);
+	for(auto & m : r) {
+		unsigned const x = rnd() % 100;
+		m.type = x < add_pct ? 0 : x < add_pct + cancel_pct ? 1 : 2;
+		m.px = draw_price(rnd);
+		m.qty = int64_t(1 + rnd() % 100);
+		m.pick = uint32_t(rnd());
+	}
+	return r;
+}
+
+struct l3_book
+{
+	order_book<int32_t, int64_t, uint64_t> b{uint8_t(1), 1};
+
+	void reserve(size_t n) { b.reserve(n); }
+	void add(uint64_t id, int32_t px, int64_t qty) { b.add(id, px, qty); }
+	void cancel(uint64_t id) { b.cancel(id); }
+	void execute(int64_t qty) { if ( auto o = b.front() ) b.reduce(o->id, qty); }
+};
+
+struct map_book
+{
+	struct order { uint64_t id; int64_t qty; };
+	using queue = std::list<order>;
+	std::map<int32_t, queue, std::greater<int32_t> > levels;
+	std::unordered_map<uint64_t, std::pair<int32_t, queue::iterator> > index;
+
+	void reserve(size_t n) { index.reserve(n); }
+	void add(uint64_t id, int32_t px, int64_t qty)
+	{
+		queue & q = levels[px];
+		q.push_back(order{id, qty});
+		index.emplace(id, std::make_pair(px, std::prev(q.end())));
+	}
+	void remove(std::unordered_map<uint64_t, std::pair<int32_t, queue::iterator> >::iterator it)
+	{
+		auto const l = levels.find(it->second.first);
+		l->second.erase(it->second.second);
+		if ( l->second.empty() ) levels.erase(l);
+		index.erase(it);
+	}
+	void cancel(uint64_t id)
+	{
+		auto const it = index.find(id);
+		if ( it != index.end() ) remove(it);
+	}
+	void execute(int64_t qty)
+	{
+		if ( levels.empty() ) return;
+		order & o = levels.begin()->second.front();
+		if ( qty < o.qty ) o.qty -= qty;
+		else remove(index.find(o.id));
+	}
+};
+
+template<typename book> void replay(bench::state & st, unsigned add_pct, unsigned cancel_pct)
+{
+	book b;
+	b.reserve(2 * resting);
+	bench::xorshift rnd(5);
+	std::vector<uint64_t> ids;
+	uint64_t next_id = 1;
+	for(; next_id <= resting; ++next_id) {
+		b.add(next_id, draw_price(rnd), int64_t(1 + rnd() % 100));
+		ids.push_back(next_id);
+	}
+	auto const s = stream(add_pct, cancel_pct);
+	st.measure(s.size(), [&]{
+		for(auto const & m : s) {
+			switch( m.type ) {
+				case 0:
+					b.add(next_id, m.px, m.qty);
+					ids.push_back(next_id++);
+					break;
+				case 1:
+					if ( !ids.empty() ) {
+						uint64_t & id = ids[m.pick % ids.size()];
+						b.cancel(id);
+						id = ids.back();
+						ids.pop_back();
+					}
+					break;
+				case 2:
+					b.execute(m.qty);
+					break;
+			}
+		}
+	});
+}
+
+bench::registrar const order_book_cases([]{
+	bench::add("l3_replay_balanced/order_book", [](bench::state & st){ replay<l3_book>(st, 48, 42); });
+	bench::add("l3_replay_balanced/map_list", [](bench::state & st){ replay<map_book>(st, 48, 42); });
+	bench::add("l3_replay_cancel_heavy/order_book", [](bench::state & st){ replay<l3_book>(st, 50, 49); });
+	bench::add("l3_replay_cancel_heavy/map_list", [](bench::state & st){ replay<map_book>(st, 50, 49); });
+});
+
+} // namespace
@@ -0,0 +1,95 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Warm restart: a book of n levels comes back either by rebuilding it from the venue
+ * snapshot, through insert() or assign_sorted(), or by attaching to the file a
+ * persistent list left behind. One op is one restart. Attaching maps the file and
+ * touches nothing, so the walk case adds the page faults of a first full pass.
+ */
+
+namespace {
+
+using key_type = int32_t;
+
+constexpr unsigned options = sl_compact_links;
+using persistent_book = skip_list<key_type, int64_t, skip_list_levels<key_type, int64_t>(4, options),
+	mapped_arena_allocator, xorshift64star, side_compare<key_type>, options>;
+using plain_book = skip_list<key_type, int64_t, skip_list_levels<key_type, int64_t>(4), pool_allocator>;
+
+std::vector< std::pair<key_type, int64_t> > snapshot(int depth)
+{
+	std::vector< std::pair<key_type, int64_t> > v(depth);
+	for(int i = 0; i < depth; ++i) v[i] = std::make_pair(key_type(2 * (depth - i)), int64_t(i));
+	return v;
+}
+
+std::string book_file(int depth)
+{
+	std::string const dir = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+	return dir + "/persist_bench." + std::to_string(getpid()) + "." + std::to_string(depth);
+}
+
+void rebuild_insert(bench::state & st, int depth)
+{
+	auto const v = snapshot(depth);
+	st.measure(1, [&]{
+		plain_book x(uint8_t(1), 1);
+		for(auto const & e : v) x.insert(e.first, e.second);
+		bench::do_not_optimize(x.size());
+	});
+}
+
+void rebuild_sorted(bench::state & st, int depth)
+{
+	auto const v = snapshot(depth);
+	st.measure(1, [&]{
+		plain_book x(uint8_t(1), 1);
+		x.assign_sorted(v.begin(), v.end());
+		bench::do_not_optimize(x.size());
+	});
+}
+
+template<bool walk> void attach(bench::state & st, int depth)
+{
+	std::string const path = book_file(depth);
+	unlink(path.c_str());
+	{
+		persistent_book x(uint8_t(1), 1);
+		if ( !x.attach(path.c_str()) ) return;
+		auto const v = snapshot(depth);
+		x.assign_sorted(v.begin(), v.end());
+	}
+	size_t const restarts = walk ? 4 : 100;
+	st.measure(restarts, [&]{
+		for(size_t i = 0; i < restarts; ++i) {
+			persistent_book x(uint8_t(1), 1);
+			x.attach(path.c_str());
+			if ( walk ) {
+				int64_t sum = 0;
+				for(auto & e : x) sum += e.value;
+				bench::do_not_optimize(sum);
+			}
+			bench::do_not_optimize(x.find(2));
+		}
+	});
+	unlink(path.c_str());
+}
+
+bench::registrar const persist_cases([]{
+	for(int depth : { 100000, 1000000, 4000000 }) {
+		std::string const n = "/" + std::to_string(depth);
+		bench::add("persist_rebuild_insert" + n, [=](bench::state & st){ rebuild_insert(st, depth); });
+		bench::add("persist_rebuild_assign_sorted" + n, [=](bench::state & st){ rebuild_sorted(st, depth); });
+		bench::add("persist_attach" + n, [=](bench::state & st){ attach<false>(st, depth); });
+		bench::add("persist_attach_walk" + n, [=](bench::state & st){ attach<true>(st, depth); });
+	}
+});
+
+} // namespace
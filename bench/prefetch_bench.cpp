@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Lookups on a book several times the size of the last level cache, nodes allocated
+ * in random order so that hops land on cold lines: plain find(), the sl_prefetch
+ * search, sl_cached_keys deciding from the current node, and find_many() overlapping
+ * the misses of a group of lookups. measure() reports LLC misses per lookup where the
+ * machine exposes the counter.
+ */
+
+namespace {
+
+constexpr int depth = 4 << 20;
+constexpr size_t lookups = 1 << 20;
+
+template<unsigned Options>
+using list_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, Options),
+	aligned_allocator, xorshift64star, std::less<int32_t>, Options>;
+
+template<typename L> L & book()
+{
+	static L x(std::less<int32_t>(), 1);
+	if ( x.empty() ) {
+		std::vector<int32_t> keys(depth);
+		for(int i = 0; i < depth; ++i) keys[i] = 2 * i;
+		std::shuffle(keys.begin(), keys.end(), bench::xorshift(3));
+		for(auto k : keys) x.insert(k, nullptr);
+	}
+	return x;
+}
+
+std::vector<int32_t> random_keys()
+{
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(lookups);
+	for(auto & k : keys) k = int32_t(rnd() % (2 * depth));
+	return keys;
+}
+
+template<unsigned Options> void find_each(bench::state & st)
+{
+	auto & x = book< list_type<Options> >();
+	auto const keys = random_keys();
+	st.count_misses = true;
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(x.find(k));
+	});
+}
+
+template<size_t G> void find_many(bench::state & st)
+{
+	auto & x = book< list_type<0> >();
+	auto const keys = random_keys();
+	std::vector<void**> found(keys.size());
+	st.count_misses = true;
+	st.measure(keys.size(), [&]{
+		x.find_many<G>(keys.data(), keys.size(), found.data());
+		bench::do_not_optimize(found.back());
+	});
+}
+
+} // namespace
+
+BENCH(prefetch_find_4m) { find_each<0>(st); }
+BENCH(prefetch_find_4m_sl_prefetch) { find_each<sl_prefetch>(st); }
+BENCH(prefetch_find_4m_sl_cached_keys) { find_each<sl_cached_keys>(st); }
+BENCH(prefetch_find_4m_sl_cached_keys_prefetch) { find_each<sl_cached_keys | sl_prefetch>(st); }
+BENCH(prefetch_find_many_4m_group_4) { find_many<4>(st); }
+BENCH(prefetch_find_many_4m_group_8) { find_many<8>(st); }
+BENCH(prefetch_find_many_4m_group_16) { find_many<16>(st); }
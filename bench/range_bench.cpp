@@ -0,0 +1,69 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Cumulative volume within n ticks of the touch on a 100K level bid book: copying
+ * through to_vector() and filtering, against for_each_in_range() walking level 0 in
+ * place, and against the same range taken from a key inside the book.
+ */
+
+namespace {
+
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), pool_allocator>;
+
+constexpr int depth = 100000;
+constexpr size_t queries = 1 << 12;
+
+list_type & book()
+{
+	static list_type x(uint8_t(1), 1);
+	if ( x.empty() ) {
+		for(int i = 0; i < depth; ++i) x.insert(2 * i, i % 100 + 1);
+	}
+	return x;
+}
+
+void to_vector_filter(bench::state & st, int32_t ticks)
+{
+	auto const & x = book();
+	st.measure(queries, [&]{
+		for(size_t q = 0; q < queries; ++q) {
+			int32_t const touch = x.begin()->key;
+			int64_t sum = 0;
+			for(auto const & e : x.to_vector()) {
+				if ( e.first > touch - ticks ) sum += e.second;
+			}
+			bench::do_not_optimize(sum);
+		}
+	});
+}
+
+void for_each_in_range(bench::state & st, int32_t ticks, bool from_touch)
+{
+	auto const & x = book();
+	bench::xorshift rnd;
+	std::vector<int32_t> from(queries);
+	for(auto & k : from) k = from_touch ? x.begin()->key : int32_t(rnd() % (2 * depth));
+	st.measure(queries, [&]{
+		for(auto k : from) {
+			int64_t sum = 0;
+			x.for_each_in_range(k, k - ticks, [&](int32_t, int64_t v) { sum += v; });
+			bench::do_not_optimize(sum);
+		}
+	});
+}
+
+bench::registrar const range_cases([]{
+	for(int32_t ticks : { 10, 100, 1000 }) {
+		std::string const n = "/" + std::to_string(ticks);
+		if ( ticks == 10 ) bench::add("range_to_vector_filter" + n, [=](bench::state & st){ to_vector_filter(st, ticks); });
+		bench::add("range_for_each_touch" + n, [=](bench::state & st){ for_each_in_range(st, ticks, true); });
+		bench::add("range_for_each_inside" + n, [=](bench::state & st){ for_each_in_range(st, ticks, false); });
+	}
+});
+
+} // namespace
@@ -0,0 +1,105 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Shipping a book to a replay machine: save() into a buffer, load() back from it,
+ * with and without the tower heights, against to_vector() as the export baseline.
+ * The book is built by random inserts, so its nodes are scattered over the heap.
+ * One op is one element; bytes/op over ns/op gives GB/s.
+ */
+
+namespace {
+
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), pool_allocator>;
+
+constexpr int depth = 1000000;
+constexpr int rounds = 10;
+
+list_type & book()
+{
+	static list_type x(uint8_t(1), 1);
+	if ( x.empty() ) {
+		bench::xorshift rnd;
+		while( x.size() < size_t(depth) ) x.insert(int32_t(rnd() % (4 * depth)), int64_t(rnd()));
+	}
+	return x;
+}
+
+struct buffer
+{
+	std::vector<char> bytes;
+	size_t at = 0;
+
+	bool write(char const * p, size_t n)
+	{
+		std::memcpy(bytes.data() + at, p, n);
+		at += n;
+		return true;
+	}
+	bool read(char * p, size_t n)
+	{
+		if ( bytes.size() - at < n ) return false;
+		std::memcpy(p, bytes.data() + at, n);
+		at += n;
+		return true;
+	}
+};
+
+// sequential: nodes allocated in list order, as after load(), so the walk itself is
+// cheap and the copying shows
+template<bool towers, bool sequential = false> void save(bench::state & st)
+{
+	list_type y(uint8_t(1), 2);
+	if ( sequential ) {
+		auto const v = book().to_vector();
+		y.assign_sorted(v.begin(), v.end());
+	}
+	auto const & x = sequential ? y : book();
+	buffer b;
+	b.bytes.resize(sizeof(skip_list_snapshot) + x.size() * (sizeof(int32_t) + sizeof(int64_t) + 1));
+	st.measure(rounds * x.size(), [&]{
+		for(int r = 0; r < rounds; ++r) {
+			b.at = 0;
+			x.save([&](char const * p, size_t n) { return b.write(p, n); }, towers);
+		}
+	});
+	st.count("bytes", double(rounds) * b.at);
+}
+
+template<bool towers> void load(bench::state & st)
+{
+	auto const & x = book();
+	buffer b;
+	b.bytes.resize(sizeof(skip_list_snapshot) + x.size() * (sizeof(int32_t) + sizeof(int64_t) + 1));
+	x.save([&](char const * p, size_t n) { return b.write(p, n); }, towers);
+	b.bytes.resize(b.at);
+
+	list_type y(uint8_t(1), 2);
+	st.measure(rounds * x.size(), [&]{
+		for(int r = 0; r < rounds; ++r) {
+			b.at = 0;
+			y.load([&](char * p, size_t n) { return b.read(p, n); });
+		}
+	});
+	st.count("bytes", double(rounds) * b.bytes.size());
+}
+
+} // namespace
+
+BENCH(snapshot_to_vector_1m)
+{
+	auto const & x = book();
+	st.measure(rounds * x.size(), [&]{
+		for(int r = 0; r < rounds; ++r) bench::do_not_optimize(x.to_vector().size());
+	});
+	st.count("bytes", double(rounds) * x.size() * sizeof(std::pair<int32_t, int64_t>));
+}
+BENCH(snapshot_save_1m) { save<false>(st); }
+BENCH(snapshot_save_1m_towers) { save<true>(st); }
+BENCH(snapshot_save_1m_sequential) { save<false, true>(st); }
+BENCH(snapshot_load_1m) { load<false>(st); }
+BENCH(snapshot_load_1m_towers) { load<true>(st); }
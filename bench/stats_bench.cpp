@@ -0,0 +1,89 @@
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * What sl_stats costs: random finds and add/cancel pairs on a 100K level bid book,
+ * without the option, with the counters, and with the latency histograms on top.
+ * Without the option the list holds an empty recorder whose hooks are empty inline
+ * functions, checked below, so the first case measures the list as it was before
+ * stats existed. The counting runs report the forward steps of the measured
+ * operations only.
+ */
+
+namespace {
+
+template<unsigned options>
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4, options), pool_allocator,
+	xorshift64star, side_compare<int32_t>, options>;
+
+constexpr int depth = 100000;
+constexpr size_t ops = 1 << 20;
+
+static_assert( std::is_empty< detail::stats_recorder<list_type<0>::max_levels, false, false> >::value,
+		"without sl_stats the list carries no counters" );
+static_assert( std::is_empty< detail::stats_recorder<list_type<0>::max_levels, false, false>::timer >::value,
+		"and times nothing" );
+
+template<typename L> uint64_t total_hops(L const &, std::false_type) { return 0; }
+template<typename L> uint64_t total_hops(L const & x, std::true_type)
+{
+	uint64_t hops = 0;
+	for(uint64_t n : x.stats().hops) hops += n;
+	return hops;
+}
+
+// the steps since before, the build's inserts are counted too
+template<typename L> void count_hops(bench::state & st, L const & x, uint64_t before)
+{
+	using counting = std::integral_constant<bool, L::collect_stats>;
+	if ( L::collect_stats ) st.count("hops", double(total_hops(x, counting{}) - before));
+}
+
+template<unsigned options> void find(bench::state & st)
+{
+	using L = list_type<options>;
+	L x(uint8_t(1), 1);
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, i);
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(ops);
+	for(auto & k : keys) k = int32_t(rnd() % (2 * depth));
+	L const & c = x;
+	uint64_t const before = total_hops(x, std::integral_constant<bool, L::collect_stats>{});
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(c.find(k));
+	});
+	count_hops(st, x, before);
+}
+
+template<unsigned options> void add_cancel(bench::state & st)
+{
+	using L = list_type<options>;
+	L x(uint8_t(1), 1);
+	for(int i = 0; i < depth; ++i) x.insert(2 * i, i);
+	bench::xorshift rnd;
+	std::vector<int32_t> keys(ops / 2);
+	for(auto & k : keys) k = 2 * int32_t(rnd() % depth) + 1;
+	uint64_t const before = total_hops(x, std::integral_constant<bool, L::collect_stats>{});
+	st.measure(2 * keys.size(), [&]{
+		for(auto k : keys) {
+			x.insert(k, 1);
+			x.erase(k);
+		}
+	});
+	count_hops(st, x, before);
+}
+
+bench::registrar const stats_cases([]{
+	bench::add("stats_find/off", find<0>);
+	bench::add("stats_find/counters", find<sl_stats>);
+	bench::add("stats_find/latency", find<sl_stats_latency>);
+	bench::add("stats_add_cancel/off", add_cancel<0>);
+	bench::add("stats_add_cancel/counters", add_cancel<sl_stats>);
+	bench::add("stats_add_cancel/latency", add_cancel<sl_stats_latency>);
+});
+
+} // namespace
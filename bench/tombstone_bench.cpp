@@ -0,0 +1,52 @@
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Cancel latency on a 100K level bid book: a random resting level is cancelled, timed,
+ * and a new one added in its place, untimed. erase() unlinking at once against
+ * sl_tombstones marking the node, with compact() run every 64 cancels outside the
+ * timed part, its cost reported per unlinked node.
+ */
+
+namespace {
+
+template<unsigned options>
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4, options), pool_allocator,
+	xorshift64star, side_compare<int32_t>, options>;
+
+constexpr int depth = 100000;
+constexpr size_t cancels = 1 << 18;
+
+size_t compact(list_type<0> &, size_t) { return 0; }
+size_t compact(list_type<sl_tombstones> & x, size_t budget) { return x.compact(budget); }
+
+template<unsigned options> void cancel(bench::state & st, size_t budget)
+{
+	list_type<options> x(uint8_t(1), 1);
+	std::vector<int32_t> resting(depth);
+	for(int i = 0; i < depth; ++i) x.insert(resting[i] = 2 * i, 1);
+	bench::xorshift rnd;
+	double compact_ns = 0;
+	size_t compacted = 0;
+	for(size_t i = 0; i < cancels; ++i) {
+		int32_t & k = resting[rnd() % depth];
+		st.sample(1, [&](size_t) { bench::do_not_optimize(x.erase(k)); });
+		do k = int32_t(rnd() % (4 * depth)); while( !x.insert(k, 1) );
+		if ( budget && i % 64 == 63 ) {
+			auto const t0 = bench::clock::now();
+			compacted += compact(x, budget);
+			compact_ns += bench::elapsed_ns(t0, bench::clock::now());
+		}
+	}
+	if ( compacted ) st.count("compact_ns", compact_ns / compacted * cancels);
+}
+
+bench::registrar const tombstone_cases([]{
+	bench::add("cancel_unlink", [](bench::state & st){ cancel<0>(st, 0); });
+	bench::add("cancel_tombstone/64", [](bench::state & st){ cancel<sl_tombstones>(st, 64); });
+});
+
+} // namespace
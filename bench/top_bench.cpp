@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Latency of a read of the best 5 levels of a 100K level bid book: following the
+ * links from begin(), top_k() on the plain list, and top_k() on a list with
+ * sl_top_cache. Back to back, and each read after sweeping 4 MiB of other data, as a
+ * quote handler would find the book between two market data bursts.
+ */
+
+namespace {
+
+using plain_list = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), pool_allocator>;
+using cached_list = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4, sl_top_cache), pool_allocator,
+	xorshift64star, side_compare<int32_t>, sl_top_cache>;
+
+constexpr int depth = 100000;
+constexpr size_t top = 5;
+constexpr size_t reads = 1 << 14;
+
+// levels inserted in random order, so that neighbours in the book are not neighbours in memory
+template<typename list> list & book()
+{
+	static list x(uint8_t(1), 1);
+	if ( x.empty() ) {
+		std::vector<int32_t> k(depth);
+		for(int i = 0; i < depth; ++i) k[i] = 2 * i;
+		std::shuffle(k.begin(), k.end(), bench::xorshift());
+		for(auto i : k) x.insert(i, i % 100 + 1);
+	}
+	return x;
+}
+
+template<typename list> int64_t iterate(list const & x)
+{
+	int64_t r = 0;
+	size_t n = 0;
+	for(auto it = x.begin(); it != x.end() && n < top; ++it, ++n) r += it->value;
+	return r;
+}
+
+template<typename list> int64_t top_k(list const & x)
+{
+	std::pair<int32_t, int64_t> out[top];
+	int64_t r = 0;
+	for(size_t i = 0, n = x.top_k(top, out); i < n; ++i) r += out[i].second;
+	return r;
+}
+
+template<typename list, int64_t (*read)(list const &)> void top_reads(bench::state & st, bool cold)
+{
+	auto const & x = book<list>();
+	if ( !cold ) {
+		st.sample(reads, [&](size_t) { bench::do_not_optimize(read(x)); });
+		return;
+	}
+	std::vector<int64_t> other(4 << 20 >> 3, 1);
+	int64_t sink = 0;
+	for(size_t i = 0; i < reads / 16; ++i) {
+		for(size_t j = 0; j < other.size(); j += cache_line_size / sizeof(int64_t)) sink += other[j]++;
+		st.sample(1, [&](size_t) { bench::do_not_optimize(read(x)); });
+	}
+	bench::do_not_optimize(sink);
+}
+
+bench::registrar const top_cases([]{
+	for(bool cold : { false, true }) {
+		std::string const n = cold ? "/cold" : "/hot";
+		bench::add("top5_iterate" + n, [=](bench::state & st){ top_reads<plain_list, iterate<plain_list> >(st, cold); });
+		bench::add("top5_top_k" + n, [=](bench::state & st){ top_reads<plain_list, top_k<plain_list> >(st, cold); });
+		bench::add("top5_top_k_cached" + n, [=](bench::state & st){ top_reads<cached_list, top_k<cached_list> >(st, cold); });
+	}
+});
+
+} // namespace
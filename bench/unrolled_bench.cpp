@@ -0,0 +1,109 @@
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+#include "unrolled_skip_list.hpp"
+
+/*
+ * One key per node against blocks of a cache line of keys: random lookups, add/cancel
+ * of levels between the resting ones, and a full walk, at 10K to 10M levels. Bids
+ * (descending), which the blocks search with the flipped vector compare.
+ */
+
+namespace {
+
+using key_type = int32_t;
+
+struct skip_book
+{
+	skip_list<key_type, void*, skip_list_levels<key_type, void*>(4), pool_allocator> l{uint8_t(1), 1};
+
+	void build(int depth)
+	{
+		std::vector< std::pair<key_type, void*> > v(depth);
+		for(int i = 0; i < depth; ++i) v[i] = std::make_pair(2 * (depth - 1 - i), nullptr);
+		l.assign_sorted(v.begin(), v.end());
+	}
+	bool find(key_type k) const { return l.find(k) != nullptr; }
+	void insert(key_type k) { l.insert(k, nullptr); }
+	void erase(key_type k) { l.erase(k); }
+	int64_t walk() const
+	{
+		int64_t r = 0;
+		for(auto & e : l) r += e.key;
+		return r;
+	}
+};
+
+struct unrolled_book
+{
+	unrolled_skip_list<key_type, void*, 16, 24, pool_allocator> l{uint8_t(1), 1};
+
+	void build(int depth) { for(int i = 0; i < depth; ++i) l.insert(2 * i, nullptr); }
+	bool find(key_type k) const { return l.find(k) != nullptr; }
+	void insert(key_type k) { l.insert(k, nullptr); }
+	void erase(key_type k) { l.erase(k); }
+	int64_t walk() const
+	{
+		int64_t r = 0;
+		for(auto it = l.begin(); it != l.end(); ++it) r += it->key;
+		return r;
+	}
+};
+
+constexpr size_t ops = 1 << 18;
+
+template<typename book> void find(bench::state & st, int depth)
+{
+	book b;
+	b.build(depth);
+	bench::xorshift rnd;
+	std::vector<key_type> keys(ops);
+	for(auto & k : keys) k = key_type(rnd() % (2 * depth));
+	st.measure(keys.size(), [&]{
+		for(auto k : keys) bench::do_not_optimize(b.find(k));
+	});
+}
+
+template<typename book> void add_cancel(bench::state & st, int depth)
+{
+	book b;
+	b.build(depth);
+	bench::xorshift rnd;
+	std::vector<key_type> keys(ops);
+	for(auto & k : keys) k = 2 * key_type(rnd() % depth) + 1;
+	st.measure(2 * keys.size(), [&]{
+		for(auto k : keys) {
+			b.insert(k);
+			b.erase(k);
+		}
+	});
+}
+
+template<typename book> void iterate(bench::state & st, int depth)
+{
+	book b;
+	b.build(depth);
+	size_t const rounds = std::max<size_t>(1, 10000000 / depth);
+	st.measure(rounds * depth, [&]{
+		for(size_t r = 0; r < rounds; ++r) bench::do_not_optimize(b.walk());
+	});
+}
+
+template<typename book> void add_cases(char const * container)
+{
+	for(int depth : { 10000, 100000, 1000000, 10000000 }) {
+		std::string const suffix = std::string("/") + container + "/" + std::to_string(depth);
+		bench::add("unrolled_find" + suffix, [=](bench::state & st){ find<book>(st, depth); });
+		bench::add("unrolled_add_cancel" + suffix, [=](bench::state & st){ add_cancel<book>(st, depth); });
+		bench::add("unrolled_iterate" + suffix, [=](bench::state & st){ iterate<book>(st, depth); });
+	}
+}
+
+bench::registrar const unrolled_cases([]{
+	add_cases<skip_book>("skip_list");
+	add_cases<unrolled_book>("unrolled");
+});
+
+} // namespace
@@ -0,0 +1,107 @@
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Level updates on a 100K level bid book, the most common market data message: set a
+ * level's quantity, adding the level if new and removing it at zero. find() and then
+ * a write, insert() or erase(), against insert_or_assign() or erase() alone. And fills
+ * taking quantity off a level: find() and a later erase() at zero, against erase_if().
+ */
+
+namespace {
+
+using list_type = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), pool_allocator>;
+
+constexpr int depth = 100000;
+constexpr size_t updates = 1 << 19;
+
+struct update
+{
+	int32_t k;
+	int64_t q;
+};
+
+std::vector<update> stream(bool fills)
+{
+	bench::xorshift rnd;
+	std::vector<update> r(updates);
+	for(auto & u : r) {
+		u.k = int32_t(rnd() % (2 * depth));
+		u.q = fills ? int64_t(1 + rnd() % 40) : ( rnd() % 4 ? int64_t(1 + rnd() % 100) : 0 );
+	}
+	return r;
+}
+
+void book(list_type & x)
+{
+	bench::xorshift rnd(7);
+	for(int i = 0; i < depth; ++i) x.insert(int32_t(rnd() % (2 * depth)), int64_t(1 + rnd() % 100));
+}
+
+void set_find(bench::state & st)
+{
+	list_type x(uint8_t(1), 1);
+	book(x);
+	auto const s = stream(false);
+	st.measure(s.size(), [&]{
+		for(auto const & u : s) {
+			if ( int64_t * v = x.find(u.k) ) {
+				if ( u.q ) *v = u.q;
+				else x.erase(u.k);
+			}
+			else if ( u.q ) x.insert(u.k, u.q);
+		}
+	});
+}
+
+void set_upsert(bench::state & st)
+{
+	list_type x(uint8_t(1), 1);
+	book(x);
+	auto const s = stream(false);
+	st.measure(s.size(), [&]{
+		for(auto const & u : s) {
+			if ( u.q ) x.insert_or_assign(u.k, u.q);
+			else x.erase(u.k);
+		}
+	});
+}
+
+// fills hit resting levels only, the rest of the stream refills the book
+void fill_find(bench::state & st)
+{
+	list_type x(uint8_t(1), 1);
+	book(x);
+	auto const s = stream(true);
+	st.measure(s.size(), [&]{
+		for(auto const & u : s) {
+			int64_t * v = x.find(u.k);
+			if ( !v ) x.insert(u.k, u.q);
+			else if ( ( *v -= std::min(*v, u.q) ) == 0 ) x.erase(u.k);
+		}
+	});
+}
+
+void fill_erase_if(bench::state & st)
+{
+	list_type x(uint8_t(1), 1);
+	book(x);
+	auto const s = stream(true);
+	st.measure(s.size(), [&]{
+		for(auto const & u : s) {
+			bool found = false;
+			x.erase_if(u.k, [&](int64_t & v) { found = true; return ( v -= std::min(v, u.q) ) == 0; });
+			if ( !found ) x.insert(u.k, u.q);
+		}
+	});
+}
+
+BENCH(upsert_set_find_then_write) { set_find(st); }
+BENCH(upsert_set_insert_or_assign) { set_upsert(st); }
+BENCH(upsert_fill_find_then_erase) { fill_find(st); }
+BENCH(upsert_fill_erase_if) { fill_erase_if(st); }
+
+} // namespace
@@ -3,6 +3,11 @@
 #include <cstdlib>
 #include <cassert>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "utils.hpp"
 
 void* detail::allocate_aligned_memory(size_t align, size_t size)
@@ -29,3 +34,60 @@ void detail::deallocate_aligned_memory(void *ptr) noexcept
 {
     return free(ptr);
 }
+
+
+void* detail::reserve_address_space(size_t size) noexcept
+{
+    void* ptr = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+
+bool detail::commit_address_space(void* ptr, size_t size) noexcept
+{
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+
+void detail::release_address_space(void* ptr, size_t size) noexcept
+{
+    munmap(ptr, size);
+}
+
+
+int detail::open_file(char const* path) noexcept
+{
+    return open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+
+void detail::close_file(int fd) noexcept
+{
+    close(fd);
+}
+
+
+size_t detail::file_size(int fd) noexcept
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 ? size_t(st.st_size) : 0;
+}
+
+
+bool detail::resize_file(int fd, size_t size) noexcept
+{
+    return ftruncate(fd, off_t(size)) == 0;
+}
+
+
+bool detail::map_file(void* at, size_t size, int fd, size_t offset) noexcept
+{
+    void* ptr = mmap(at, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, off_t(offset));
+    return ptr == at;
+}
+
+
+bool detail::sync_memory(void* ptr, size_t size) noexcept
+{
+    return msync(ptr, size, MS_SYNC) == 0;
+}
@@ -2,13 +2,46 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <type_traits>
 #include <utility>
+#include <algorithm>
 
 namespace detail {
     void* allocate_aligned_memory(size_t align, size_t size);
     void deallocate_aligned_memory(void* ptr) noexcept;
+
+    // allocators able to drop everything they handed out in one go expose release()
+    template <typename A, typename = void> struct has_release : std::false_type {};
+    template <typename A> struct has_release<A, decltype(std::declval<A&>().release())> : std::true_type {};
+
+    template <typename A> inline void release(A & a, std::true_type) { a.release(); }
+    template <typename A> inline void release(A &, std::false_type) {}
+    template <typename A> inline void release(A & a) { release(a, has_release<A>{}); }
+
+    // address space reserved up front and backed on demand, for allocators that keep
+    // all their blocks within one region
+    void* reserve_address_space(size_t size) noexcept;
+    bool commit_address_space(void* ptr, size_t size) noexcept;
+    void release_address_space(void* ptr, size_t size) noexcept;
+
+    // file backing for mapped_arena_allocator; the mapping lands at a fixed address
+    // inside a reservation, so the arena can grow in place
+    int open_file(char const* path) noexcept;
+    void close_file(int fd) noexcept;
+    size_t file_size(int fd) noexcept;
+    bool resize_file(int fd, size_t size) noexcept;
+    bool map_file(void* at, size_t size, int fd, size_t offset) noexcept;
+    bool sync_memory(void* ptr, size_t size) noexcept;
+
+    // allocators whose blocks all lie within reserve_bytes of each other say so
+    template <typename A, typename = void> struct is_arena : std::false_type {};
+    template <typename A> struct is_arena<A, decltype(void(A::reserve_bytes))> : std::true_type {};
+
+    // allocators that can keep their blocks in a file past the container's lifetime
+    template <typename A, typename = void> struct is_persistent : std::false_type {};
+    template <typename A> struct is_persistent<A, decltype(void(std::declval<A&>().open("")))> : std::true_type {};
 }
 
 
@@ -130,3 +163,536 @@ inline bool operator!= (const aligned_allocator<T,TAlign>&, const aligned_alloca
 	return TAlign != UAlign;
 }
 
+
+/*
+ * Slab pool: carves Align-ed blocks of sizeof(T) out of large aligned slabs and
+ * recycles them through intrusive free lists, one per run length up to max_run
+ * blocks (variable sized skip_list nodes come in 1, 2, 4 cache line classes).
+ * Every instance owns its slabs, so a container holding one gets O(slabs)
+ * release() instead of a free() per node. Copies start with an empty pool;
+ * longer requests go straight to the aligned heap.
+ */
+template <typename T, size_t Align>
+class pool_allocator
+{
+	public:
+		typedef T         value_type;
+		typedef T*        pointer;
+		typedef const T*  const_pointer;
+		typedef T&        reference;
+		typedef const T&  const_reference;
+		typedef size_t    size_type;
+		typedef ptrdiff_t difference_type;
+
+		typedef std::true_type propagate_on_container_move_assignment;
+
+		template <class U> struct rebind { typedef pool_allocator<U, Align> other; };
+
+		constexpr static size_type block_size = (sizeof(T) + Align - 1) / Align * Align;
+		constexpr static size_type slab_size = block_size > 4096 ? 16 * block_size : 64 * 1024;
+		constexpr static size_type blocks_per_slab = slab_size / block_size - 1; // first block is the slab header
+		constexpr static size_type max_run = 8;
+
+	protected:
+		struct free_block { free_block * next; };
+		struct slab { slab * next; };
+
+		static_assert( Align >= sizeof(void*) && block_size >= sizeof(slab), "block too small for the links" );
+
+		slab * slabs_ = nullptr;
+		free_block * free_[max_run + 1] = {};
+		char * bump_ = nullptr;
+		char * bump_end_ = nullptr;
+		size_type slab_count_ = 0;
+
+		void push(pointer p, size_type n) noexcept
+		{
+			free_block * b = reinterpret_cast<free_block*>(p);
+			b->next = free_[n];
+			free_[n] = b;
+		}
+
+		char * grow() noexcept
+		{
+			void * ptr = detail::allocate_aligned_memory(Align, slab_size);
+			if ( !ptr ) return nullptr;
+
+			slab * s = reinterpret_cast<slab*>(ptr);
+			s->next = slabs_;
+			slabs_ = s;
+			++slab_count_;
+
+			bump_ = reinterpret_cast<char*>(ptr) + block_size;
+			// whole blocks only, or the tail loop in allocate() would step past the end
+			bump_end_ = reinterpret_cast<char*>(ptr) + ( blocks_per_slab + 1 ) * block_size;
+			return bump_;
+		}
+
+	public:
+		pool_allocator() noexcept = default;
+		pool_allocator(const pool_allocator&) noexcept {}
+		template <class U> pool_allocator(const pool_allocator<U, Align>&) noexcept {}
+		pool_allocator(pool_allocator&& o) noexcept
+			: slabs_(o.slabs_), bump_(o.bump_), bump_end_(o.bump_end_), slab_count_(o.slab_count_)
+		{
+			std::copy(o.free_, o.free_ + max_run + 1, free_);
+			std::fill(o.free_, o.free_ + max_run + 1, nullptr);
+			o.slabs_ = nullptr; o.bump_ = o.bump_end_ = nullptr; o.slab_count_ = 0;
+		}
+		pool_allocator & operator=(const pool_allocator&) noexcept { return *this; }
+		pool_allocator & operator=(pool_allocator&& o) noexcept
+		{
+			if ( this != &o ) {
+				release();
+				std::swap(slabs_, o.slabs_); std::swap_ranges(free_, free_ + max_run + 1, o.free_);
+				std::swap(bump_, o.bump_); std::swap(bump_end_, o.bump_end_);
+				std::swap(slab_count_, o.slab_count_);
+			}
+			return *this;
+		}
+		~pool_allocator() { release(); }
+
+		static size_type max_size() noexcept { return (size_type(~0) - size_type(Align)) / sizeof(T); }
+		static pointer address(reference x) noexcept { return std::addressof(x); }
+		static const_pointer address(const_reference x) noexcept { return std::addressof(x); }
+
+		size_type slab_count() const noexcept { return slab_count_; }
+		size_type capacity_bytes() const noexcept { return slab_count_ * slab_size; }
+
+		pointer allocate(size_type n, typename aligned_allocator<void, Align>::const_pointer = 0) noexcept
+		{
+			if ( n == 0 || n > max_run ) {
+				return reinterpret_cast<pointer>(detail::allocate_aligned_memory(Align, n * sizeof(T)));
+			}
+			if ( free_block * b = free_[n] ) {
+				free_[n] = b->next;
+				return reinterpret_cast<pointer>(b);
+			}
+			size_type const bytes = n * block_size;
+			if ( size_type(bump_end_ - bump_) < bytes ) {
+				// the tail of the current slab is still good for single blocks
+				for( ; bump_ != bump_end_; bump_ += block_size ) {
+					push(reinterpret_cast<pointer>(bump_), 1);
+				}
+				if ( !grow() ) return nullptr;
+			}
+			char * ptr = bump_;
+			bump_ += bytes;
+			return reinterpret_cast<pointer>(ptr);
+		}
+
+		void deallocate(pointer p, size_type n) noexcept
+		{
+			if ( n == 0 || n > max_run ) {
+				return detail::deallocate_aligned_memory(p);
+			}
+			push(p, n);
+		}
+
+		// returns every slab at once; blocks handed out earlier must not be touched afterwards
+		void release() noexcept
+		{
+			while( slab * s = slabs_ ) {
+				slabs_ = s->next;
+				detail::deallocate_aligned_memory(s);
+			}
+			std::fill(free_, free_ + max_run + 1, nullptr);
+			bump_ = bump_end_ = nullptr;
+			slab_count_ = 0;
+		}
+
+		template <class U, class ...Args> static void construct(U* p, Args&&... args)
+		{
+			::new(reinterpret_cast<void*>(p)) U(std::forward<Args>(args)...);
+		}
+
+		static void destroy(pointer p) { p->~T(); }
+
+		friend bool operator==(const pool_allocator& a, const pool_allocator& b) noexcept { return &a == &b; }
+		friend bool operator!=(const pool_allocator& a, const pool_allocator& b) noexcept { return &a != &b; }
+};
+
+
+/*
+ * Arena: like pool_allocator, but every block comes out of a single region of
+ * reserve_bytes of address space, reserved on first use and backed by memory
+ * commit_bytes at a time as the arena grows. Blocks never move and any two of them
+ * are less than reserve_bytes apart, so containers can link them with small
+ * relative offsets instead of pointers. Runs longer than max_run blocks come out
+ * of the arena too and are recycled as single blocks. Copies start empty.
+ */
+template <typename T, size_t Align>
+class arena_allocator
+{
+	public:
+		typedef T         value_type;
+		typedef T*        pointer;
+		typedef const T*  const_pointer;
+		typedef T&        reference;
+		typedef const T&  const_reference;
+		typedef size_t    size_type;
+		typedef ptrdiff_t difference_type;
+
+		typedef std::true_type propagate_on_container_move_assignment;
+
+		template <class U> struct rebind { typedef arena_allocator<U, Align> other; };
+
+		constexpr static size_type block_size = (sizeof(T) + Align - 1) / Align * Align;
+		constexpr static size_type reserve_bytes = size_type(16) << 30;
+		constexpr static size_type commit_bytes = block_size > 4096 ? 256 * block_size : 1 << 20;
+		constexpr static size_type max_run = 8;
+
+	protected:
+		struct free_block { free_block * next; };
+
+		static_assert( Align >= sizeof(void*) && block_size >= sizeof(free_block), "block too small for the links" );
+
+		char * base_ = nullptr;
+		size_type used_ = 0;       // bytes handed out from the front of the arena
+		size_type committed_ = 0;  // bytes backed by memory
+		free_block * free_[max_run + 1] = {};
+
+		void push(pointer p, size_type n) noexcept
+		{
+			free_block * b = reinterpret_cast<free_block*>(p);
+			b->next = free_[n];
+			free_[n] = b;
+		}
+
+	public:
+		arena_allocator() noexcept = default;
+		arena_allocator(const arena_allocator&) noexcept {}
+		template <class U> arena_allocator(const arena_allocator<U, Align>&) noexcept {}
+		arena_allocator(arena_allocator&& o) noexcept
+			: base_(o.base_), used_(o.used_), committed_(o.committed_)
+		{
+			std::copy(o.free_, o.free_ + max_run + 1, free_);
+			std::fill(o.free_, o.free_ + max_run + 1, nullptr);
+			o.base_ = nullptr; o.used_ = o.committed_ = 0;
+		}
+		arena_allocator & operator=(const arena_allocator&) noexcept { return *this; }
+		arena_allocator & operator=(arena_allocator&& o) noexcept
+		{
+			if ( this != &o ) {
+				release();
+				std::swap(base_, o.base_); std::swap_ranges(free_, free_ + max_run + 1, o.free_);
+				std::swap(used_, o.used_); std::swap(committed_, o.committed_);
+			}
+			return *this;
+		}
+		~arena_allocator() { release(); }
+
+		static size_type max_size() noexcept { return reserve_bytes / block_size; }
+		static pointer address(reference x) noexcept { return std::addressof(x); }
+		static const_pointer address(const_reference x) noexcept { return std::addressof(x); }
+
+		char const * base() const noexcept { return base_; }
+		size_type capacity_bytes() const noexcept { return committed_; }
+
+		pointer allocate(size_type n, typename aligned_allocator<void, Align>::const_pointer = 0) noexcept
+		{
+			if ( n == 0 ) return nullptr;
+			if ( n <= max_run ) {
+				if ( free_block * b = free_[n] ) {
+					free_[n] = b->next;
+					return reinterpret_cast<pointer>(b);
+				}
+			}
+			size_type const bytes = n * block_size;
+			if ( !base_ ) {
+				base_ = reinterpret_cast<char*>(detail::reserve_address_space(reserve_bytes));
+				if ( !base_ ) return nullptr;
+			}
+			if ( reserve_bytes - used_ < bytes ) return nullptr;
+			if ( committed_ - used_ < bytes ) {
+				size_type const want = std::min(size_type(reserve_bytes),
+						(used_ + bytes + commit_bytes - 1) / commit_bytes * commit_bytes);
+				if ( !detail::commit_address_space(base_ + committed_, want - committed_) ) return nullptr;
+				committed_ = want;
+			}
+			char * ptr = base_ + used_;
+			used_ += bytes;
+			return reinterpret_cast<pointer>(ptr);
+		}
+
+		void deallocate(pointer p, size_type n) noexcept
+		{
+			if ( n <= max_run ) return push(p, n);
+			char * c = reinterpret_cast<char*>(p);
+			for(size_type i = 0; i < n; ++i) push(reinterpret_cast<pointer>(c + i * block_size), 1);
+		}
+
+		// returns the whole arena at once; blocks handed out earlier must not be touched afterwards
+		void release() noexcept
+		{
+			if ( base_ ) detail::release_address_space(base_, reserve_bytes);
+			base_ = nullptr;
+			used_ = committed_ = 0;
+			std::fill(free_, free_ + max_run + 1, nullptr);
+		}
+
+		template <class U, class ...Args> static void construct(U* p, Args&&... args)
+		{
+			::new(reinterpret_cast<void*>(p)) U(std::forward<Args>(args)...);
+		}
+
+		static void destroy(pointer p) { p->~T(); }
+
+		friend bool operator==(const arena_allocator& a, const arena_allocator& b) noexcept { return &a == &b; }
+		friend bool operator!=(const arena_allocator& a, const arena_allocator& b) noexcept { return &a != &b; }
+};
+
+
+/*
+ * arena_allocator whose arena can live in a file: after open() every block is carved
+ * out of a shared mapping of it, and a later open() of the same file, in this or
+ * another process, finds the blocks where they were, possibly at another address.
+ * The bookkeeping is kept in a header at the front of the arena and links blocks by
+ * offset, as must whatever the blocks themselves link to each other; root() is a
+ * few words of the header left to the container, to find its data again. Without
+ * open() the arena is anonymous and behaves like arena_allocator.
+ */
+template <typename T, size_t Align>
+class mapped_arena_allocator
+{
+	public:
+		typedef T         value_type;
+		typedef T*        pointer;
+		typedef const T*  const_pointer;
+		typedef T&        reference;
+		typedef const T&  const_reference;
+		typedef size_t    size_type;
+		typedef ptrdiff_t difference_type;
+
+		typedef std::true_type propagate_on_container_move_assignment;
+
+		template <class U> struct rebind { typedef mapped_arena_allocator<U, Align> other; };
+
+		constexpr static size_type block_size = (sizeof(T) + Align - 1) / Align * Align;
+		constexpr static size_type reserve_bytes = size_type(16) << 30;
+		constexpr static size_type commit_bytes = block_size > 4096 ? 256 * block_size : 1 << 20;
+		constexpr static size_type max_run = 8;
+		constexpr static size_type root_words = 8;
+
+	protected:
+		constexpr static uint64_t magic = 0x31616e6572614c53ULL; // "SLarena1"
+
+		struct header
+		{
+			uint64_t magic;
+			uint64_t block_size;
+			uint64_t used;                  // bytes handed out from the front, the header included
+			uint64_t free[max_run + 1];     // offsets of the first free run per length, 0 for none
+			uint64_t root[root_words];
+		};
+		struct free_block { uint64_t next; };
+
+		constexpr static size_type header_bytes = (sizeof(header) + 4095) / 4096 * 4096;
+
+		static_assert( Align >= sizeof(void*) && block_size >= sizeof(free_block), "block too small for the links" );
+		static_assert( header_bytes % block_size == 0 || block_size % header_bytes == 0, "blocks stay aligned behind the header" );
+
+		char * base_ = nullptr;
+		size_type committed_ = 0;
+		int fd_ = -1;
+
+		header * head() const noexcept { return reinterpret_cast<header*>(base_); }
+
+		void init() noexcept
+		{
+			header * h = head();
+			*h = header{};
+			h->magic = magic;
+			h->block_size = block_size;
+			h->used = std::max(size_type(header_bytes), size_type(block_size));
+		}
+
+		bool reserve() noexcept
+		{
+			if ( base_ ) return true;
+			base_ = reinterpret_cast<char*>(detail::reserve_address_space(reserve_bytes));
+			return base_ != nullptr;
+		}
+
+		// backs [0, bytes) of the arena
+		bool commit(size_type bytes) noexcept
+		{
+			if ( bytes <= committed_ ) return true;
+			size_type const want = std::min(size_type(reserve_bytes), (bytes + commit_bytes - 1) / commit_bytes * commit_bytes);
+			if ( want < bytes ) return false;
+			if ( fd_ >= 0 ) {
+				if ( !detail::resize_file(fd_, want) ) return false;
+				if ( !detail::map_file(base_ + committed_, want - committed_, fd_, committed_) ) return false;
+			}
+			else if ( !detail::commit_address_space(base_ + committed_, want - committed_) ) return false;
+			committed_ = want;
+			return true;
+		}
+
+		void push(pointer p, size_type n) noexcept
+		{
+			free_block * b = reinterpret_cast<free_block*>(p);
+			b->next = head()->free[n];
+			head()->free[n] = uint64_t(reinterpret_cast<char*>(p) - base_);
+		}
+
+	public:
+		mapped_arena_allocator() noexcept = default;
+		mapped_arena_allocator(const mapped_arena_allocator&) noexcept {}
+		template <class U> mapped_arena_allocator(const mapped_arena_allocator<U, Align>&) noexcept {}
+		mapped_arena_allocator(mapped_arena_allocator&& o) noexcept
+			: base_(o.base_), committed_(o.committed_), fd_(o.fd_)
+		{
+			o.base_ = nullptr; o.committed_ = 0; o.fd_ = -1;
+		}
+		mapped_arena_allocator & operator=(const mapped_arena_allocator&) noexcept { return *this; }
+		mapped_arena_allocator & operator=(mapped_arena_allocator&& o) noexcept
+		{
+			if ( this != &o ) {
+				close();
+				std::swap(base_, o.base_); std::swap(committed_, o.committed_); std::swap(fd_, o.fd_);
+			}
+			return *this;
+		}
+		~mapped_arena_allocator() { close(); }
+
+		/*
+		 * Maps the arena kept in the file at path, creating an empty one if the file is
+		 * missing or empty; blocks and root() are as the last user of the file left
+		 * them. False if the file holds something else, the arena is then closed.
+		 */
+		bool open(char const * path) noexcept
+		{
+			close();
+			fd_ = detail::open_file(path);
+			if ( fd_ < 0 || !reserve() ) return close(), false;
+			size_type const size = detail::file_size(fd_);
+			if ( size == 0 ) {
+				if ( !commit(header_bytes) ) return close(), false;
+				init();
+				return true;
+			}
+			if ( size < header_bytes || size > reserve_bytes || !detail::map_file(base_, size, fd_, 0) ) return close(), false;
+			committed_ = size;
+			if ( head()->magic != magic || head()->block_size != block_size || head()->used > size ) return close(), false;
+			return true;
+		}
+		bool is_open() const noexcept { return fd_ >= 0; }
+
+		// unmaps the arena; a file keeps its contents
+		void close() noexcept
+		{
+			if ( base_ ) detail::release_address_space(base_, reserve_bytes);
+			if ( fd_ >= 0 ) detail::close_file(fd_);
+			base_ = nullptr;
+			committed_ = 0;
+			fd_ = -1;
+		}
+
+		// writes the file back to the disk
+		bool sync() noexcept { return fd_ < 0 || detail::sync_memory(base_, head()->used); }
+
+		uint64_t * root() noexcept { return base_ ? head()->root : nullptr; }
+		char const * base() const noexcept { return base_; }
+		size_type capacity_bytes() const noexcept { return committed_; }
+		size_type used_bytes() const noexcept { return base_ ? head()->used : 0; }
+
+		static size_type max_size() noexcept { return reserve_bytes / block_size; }
+		static pointer address(reference x) noexcept { return std::addressof(x); }
+		static const_pointer address(const_reference x) noexcept { return std::addressof(x); }
+
+		pointer allocate(size_type n, typename aligned_allocator<void, Align>::const_pointer = 0) noexcept
+		{
+			if ( n == 0 ) return nullptr;
+			if ( !base_ ) {
+				if ( !reserve() || !commit(header_bytes) ) return nullptr;
+				init();
+			}
+			header * h = head();
+			if ( n <= max_run && h->free[n] ) {
+				free_block * b = reinterpret_cast<free_block*>(base_ + h->free[n]);
+				h->free[n] = b->next;
+				return reinterpret_cast<pointer>(b);
+			}
+			size_type const bytes = n * block_size;
+			if ( reserve_bytes - h->used < bytes || !commit(h->used + bytes) ) return nullptr;
+			char * ptr = base_ + h->used;
+			h->used += bytes;
+			return reinterpret_cast<pointer>(ptr);
+		}
+
+		void deallocate(pointer p, size_type n) noexcept
+		{
+			if ( n <= max_run ) return push(p, n);
+			char * c = reinterpret_cast<char*>(p);
+			for(size_type i = 0; i < n; ++i) push(reinterpret_cast<pointer>(c + i * block_size), 1);
+		}
+
+		// forgets every block at once; root(), the mapping and the file stay
+		void release() noexcept
+		{
+			if ( !base_ ) return;
+			header * h = head();
+			h->used = std::max(size_type(header_bytes), size_type(block_size));
+			std::fill(h->free, h->free + max_run + 1, 0);
+		}
+
+		template <class U, class ...Args> static void construct(U* p, Args&&... args)
+		{
+			::new(reinterpret_cast<void*>(p)) U(std::forward<Args>(args)...);
+		}
+
+		static void destroy(pointer p) { p->~T(); }
+
+		friend bool operator==(const mapped_arena_allocator& a, const mapped_arena_allocator& b) noexcept { return &a == &b; }
+		friend bool operator!=(const mapped_arena_allocator& a, const mapped_arena_allocator& b) noexcept { return &a != &b; }
+};
+
+
+/*
+ * Per-thread flavour of pool_allocator: all instances on a thread share one pool,
+ * so nodes freed by one container are reused by the next. Memory goes back to the
+ * system at thread exit, hence no release() and containers using it must not
+ * migrate between threads.
+ */
+template <typename T, size_t Align>
+class thread_pool_allocator
+{
+	public:
+		typedef T         value_type;
+		typedef T*        pointer;
+		typedef const T*  const_pointer;
+		typedef T&        reference;
+		typedef const T&  const_reference;
+		typedef size_t    size_type;
+		typedef ptrdiff_t difference_type;
+
+		template <class U> struct rebind { typedef thread_pool_allocator<U, Align> other; };
+
+	protected:
+		static pool_allocator<T, Align> & pool() noexcept
+		{
+			static thread_local pool_allocator<T, Align> p;
+			return p;
+		}
+
+	public:
+		thread_pool_allocator() noexcept = default;
+		template <class U> thread_pool_allocator(const thread_pool_allocator<U, Align>&) noexcept {}
+
+		static size_type max_size() noexcept { return (size_type(~0) - size_type(Align)) / sizeof(T); }
+
+		static pointer allocate(size_type n, typename aligned_allocator<void, Align>::const_pointer = 0) noexcept
+		{
+			return pool().allocate(n);
+		}
+
+		static void deallocate(pointer p, size_type n) noexcept { pool().deallocate(p, n); }
+
+		template <class U, class ...Args> static void construct(U* p, Args&&... args)
+		{
+			::new(reinterpret_cast<void*>(p)) U(std::forward<Args>(args)...);
+		}
+
+		static void destroy(pointer p) { p->~T(); }
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+#include "utils.hpp"
+#include "allocator.hpp"
+#include "random.hpp"
+#include "epoch.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Single writer, many readers. One thread owns the list and calls insert(), erase(),
+ * erase_head() and clear(); any number of other threads read through a reader handle
+ * without taking locks.
+ *
+ * Nodes have skip_list's layout with atomic forward pointers. The writer fills a
+ * node in completely before it links the node in with release stores, so readers
+ * loading forwards with acquire see finished nodes only. Values are never written
+ * after a node is published: insert() does not overwrite, an update is an erase()
+ * followed by an insert(). Unlinked nodes are retired to an epoch_domain and freed
+ * by the writer once no reader can still be standing on them.
+ *
+ * Unlike skip_list the head is a keyless sentinel, since moving keys through a head
+ * node readers may be looking at is not possible without locks.
+ */
+template<typename key_type, typename value_type,
+	size_t N = skip_list_levels<key_type, value_type>(4),
+	template<typename, size_t> class Allocator = aligned_allocator,
+	typename LevelGenerator = xorshift64star,
+	typename Compare = side_compare<key_type> >
+struct concurrent_skip_list
+{
+	public:
+		using side_t = uint8_t;
+		using key_compare = Compare;
+		constexpr static size_t max_levels = N;
+		// retirements between the writer's attempts to free nodes
+		constexpr static size_t reclaim_batch = 64;
+
+	protected:
+		struct alignas(void*) elem
+		{
+			constexpr static size_t align = cache_line_size;
+			key_type key;
+			uint8_t height;
+			uint8_t lines;
+			uint8_t dead = 0;   // unused here, keeps skip_list's layout
+			value_type value;
+			std::atomic<elem*> forwards[];
+
+			elem(key_type k, value_type v, size_t h, size_t l) : key(k), height(h), lines(l), value(v) {}
+
+			constexpr static size_t capacity_of(size_t lines) { return (lines * align - sizeof(elem)) / sizeof(void*); }
+			constexpr static size_t lines_for(size_t h)
+			{
+				size_t l = 1;
+				while( capacity_of(l) < h ) l <<= 1;
+				return l;
+			}
+
+			elem * next(size_t i) const { return forwards[i].load(std::memory_order_acquire); }
+		};
+
+		static_assert( N > 0 && N <= UINT8_MAX, "tower height is kept in a byte" );
+		static_assert( sizeof(std::atomic<elem*>) == sizeof(elem*) && ATOMIC_POINTER_LOCK_FREE == 2,
+				"forward pointers must keep skip_list's layout" );
+		static_assert( sizeof(elem) == sizeof(skip_list_node_header<key_type, value_type>),
+				"skip_list_levels() sizes nodes from the header" );
+
+		static bool eq(key_type a, key_type b) { return a==b; }
+		bool lt(key_type a, key_type b) const { return cmp_(a, b); }
+
+		Compare cmp_;
+		std::atomic<size_t> size_{0};
+		elem * head_;
+		LevelGenerator levels_;
+		mutable epoch_domain epochs_;
+		std::vector< std::pair<uint64_t, elem*> > retired_; // by the epoch they were unlinked in
+		size_t retired_since_ = 0;
+
+	public:
+		using allocator_type = Allocator< cache_line, elem::align >;
+
+	protected:
+		allocator_type alloc_;
+
+	public:
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		concurrent_skip_list(side_t sd) : cmp_{sd}, levels_(random_seed()) { init(); }
+		explicit concurrent_skip_list(Compare cmp = Compare()) : cmp_(cmp), levels_(random_seed()) { init(); }
+
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		concurrent_skip_list(side_t sd, uint64_t seed) : cmp_{sd}, levels_(seed) { init(); }
+		concurrent_skip_list(Compare cmp, uint64_t seed) : cmp_(cmp), levels_(seed) { init(); }
+
+		concurrent_skip_list(concurrent_skip_list const &) = delete;
+		concurrent_skip_list & operator=(concurrent_skip_list const &) = delete;
+
+		// no reader may outlive the list
+		~concurrent_skip_list()
+		{
+			assert( !epochs_.busy() );
+			for(elem * p = head_->next(0); p; ) {
+				elem * n = p->next(0);
+				destroy_elem(p);
+				p = n;
+			}
+			for(auto const & r : retired_) destroy_elem(r.second);
+			destroy_elem(head_);
+		}
+
+		bool empty() const { return size() == 0; }
+		size_t size() const { return size_.load(std::memory_order_relaxed); }
+		key_compare key_comp() const { return cmp_; }
+		int side() const { return compare_side(cmp_); }
+		allocator_type const & get_allocator() const { return alloc_; }
+
+		// nodes unlinked but not freed yet
+		size_t retired() const { return retired_.size(); }
+
+		/*
+		 * Writer side. The writer is the only thread modifying the links, so it reads them
+		 * relaxed and needs no pinning: nothing it can reach is freed behind its back.
+		 */
+
+		// false if k is there already or no node could be allocated
+		bool insert(key_type k, value_type v)
+		{
+			std::array<elem*, N> path;
+			elem * p = descend(k, path);
+			elem * q = p->forwards[0].load(std::memory_order_relaxed);
+			if ( q && eq( q->key, k ) ) return false;
+
+			size_t const lvl = level_distribution<N>::rev_log(levels_());
+			elem * e = make_elem(k, v, lvl);
+			if ( !e ) return false;
+			for(size_t i = 0; i < lvl; ++i) {
+				e->forwards[i].store(path[i]->forwards[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			// bottom up: a node reachable on some level is always on level 0 already
+			for(size_t i = 0; i < lvl; ++i) {
+				path[i]->forwards[i].store(e, std::memory_order_release);
+			}
+			size_.store(size() + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		std::pair<value_type, size_t> erase(key_type k)
+		{
+			std::array<elem*, N> path;
+			elem * p = descend(k, path);
+			elem * q = p->forwards[0].load(std::memory_order_relaxed);
+			if ( !q || !eq( q->key, k ) ) return std::make_pair(value_type{}, 0);
+
+			auto r = q->value;
+			unlink(q, path);
+			return std::make_pair(r, 1);
+		}
+
+		void erase_head()
+		{
+			elem * q = head_->forwards[0].load(std::memory_order_relaxed);
+			assert( q );
+			std::array<elem*, N> path;
+			path.fill(head_);
+			unlink(q, path);
+		}
+
+		void clear()
+		{
+			elem * p = head_->forwards[0].load(std::memory_order_relaxed);
+			for(size_t i = N; i > 0;) {
+				--i;
+				head_->forwards[i].store(nullptr, std::memory_order_release);
+			}
+			uint64_t const e = epochs_.retire_epoch();
+			for(; p; p = p->forwards[0].load(std::memory_order_relaxed)) {
+				retired_.push_back(std::make_pair(e, p));
+			}
+			size_.store(0, std::memory_order_relaxed);
+			reclaim();
+		}
+
+		// the writer's own lookups; the value stays valid until the writer erases it
+		value_type const * find(key_type k) const
+		{
+			std::array<elem*, N> path;
+			elem * q = descend(k, path)->forwards[0].load(std::memory_order_relaxed);
+			return ( q && eq( q->key, k ) ) ? &(q->value) : nullptr;
+		}
+		bool contains(key_type k) const { return find(k) != nullptr; }
+
+		std::vector< std::pair<key_type, value_type> > to_vector() const
+		{
+			std::vector< std::pair<key_type, value_type> > r;
+			r.reserve( size() );
+			for(elem const * p = head_->next(0); p; p = p->next(0)) {
+				r.push_back( std::make_pair(p->key, p->value) );
+			}
+			return r;
+		}
+
+		// frees whatever retired nodes no reader can hold any more
+		void reclaim()
+		{
+			retired_since_ = 0;
+			if ( retired_.empty() ) return;
+			uint64_t const safe = epochs_.safe_epoch();
+			auto it = retired_.begin();
+			for(; it != retired_.end() && it->first < safe; ++it) destroy_elem(it->second);
+			retired_.erase(retired_.begin(), it);
+		}
+
+		/*
+		 * Reader side. A reader claims an epoch slot for its lifetime and is used by one
+		 * thread at a time; every call pins the slot for its own duration only.
+		 */
+		class reader
+		{
+			public:
+				explicit reader(concurrent_skip_list const & l) : l_(l), slot_(l.epochs_.enter()) {}
+				~reader() { l_.epochs_.leave(slot_); }
+				reader(reader const &) = delete;
+				reader & operator=(reader const &) = delete;
+
+				bool find(key_type k, value_type & v) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					elem const * q = l_.search(k);
+					if ( !q ) return false;
+					v = q->value;
+					return true;
+				}
+
+				bool contains(key_type k) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					return l_.search(k) != nullptr;
+				}
+
+				// calls f(key, value) for the first n elements, best first; returns how many
+				// there were. Concurrent updates may or may not show, the order always holds.
+				template<typename F> size_t top(size_t n, F && f) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					size_t r = 0;
+					for(elem const * p = l_.head_->next(0); p && r < n; p = p->next(0), ++r) {
+						f(p->key, p->value);
+					}
+					return r;
+				}
+
+				std::vector< std::pair<key_type, value_type> > to_vector() const
+				{
+					std::vector< std::pair<key_type, value_type> > r;
+					top(SIZE_MAX, [&](key_type k, value_type const & v) { r.push_back(std::make_pair(k, v)); });
+					return r;
+				}
+
+				size_t size() const { return l_.size(); }
+
+			private:
+				concurrent_skip_list const & l_;
+				size_t const slot_;
+		};
+
+	protected:
+		void init()
+		{
+			head_ = make_elem(key_type{}, value_type{}, N);
+			assert( head_ && "out of memory for the head node" );
+			for(size_t i = 0; i < N; ++i) head_->forwards[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		// last node before k on every level, the head when there is none
+		elem * descend(key_type k, std::array<elem*, N> & path) const
+		{
+			elem * p = head_;
+			for(size_t lvl = N; lvl > 0;) {
+				--lvl;
+				elem * q;
+				while( (q = p->forwards[lvl].load(std::memory_order_relaxed)) && lt( q->key, k ) ) p = q;
+				path[lvl] = p;
+			}
+			return p;
+		}
+
+		// readers' lookup, under a pin
+		elem const * search(key_type k) const
+		{
+			elem const * p = head_;
+			elem const * q = nullptr;
+			for(size_t lvl = N; lvl > 0;) {
+				--lvl;
+				while( (q = p->next(lvl)) && lt( q->key, k ) ) p = q;
+			}
+			return ( q && eq( q->key, k ) ) ? q : nullptr;
+		}
+
+		// top down, so once off level 0 the node is gone for every new search
+		void unlink(elem * q, std::array<elem*, N> const & path)
+		{
+			for(size_t i = q->height; i > 0;) {
+				--i;
+				assert( path[i]->forwards[i].load(std::memory_order_relaxed) == q );
+				path[i]->forwards[i].store(q->forwards[i].load(std::memory_order_relaxed), std::memory_order_release);
+			}
+			size_.store(size() - 1, std::memory_order_relaxed);
+			retired_.push_back(std::make_pair(epochs_.retire_epoch(), q));
+			if ( ++retired_since_ == reclaim_batch ) reclaim();
+		}
+
+		// null when the allocator is out of memory
+		elem * make_elem(key_type k, value_type v, size_t height)
+		{
+			size_t const lines = elem::lines_for(height);
+			elem * e = reinterpret_cast<elem*>( alloc_.allocate(lines) );
+			if ( !e ) return nullptr;
+			alloc_.construct(e, k, v, height, lines);
+			return e;
+		}
+
+		void destroy_elem(elem * e)
+		{
+			size_t const lines = e->lines;
+			e->~elem();
+			alloc_.deallocate(reinterpret_cast<cache_line*>(e), lines);
+		}
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+#include <atomic>
+#include <stdexcept>
+
+#include "utils.hpp"
+
+/*
+ * Epoch based reclamation. Every thread that dereferences shared nodes claims a
+ * slot once (enter()) and publishes the global epoch in it for the duration of each
+ * operation (pin() / unpin()). A node unlinked and then tagged with retire_epoch()
+ * can no longer be reached by threads pinning afterwards; it is safe to free once
+ * its tag is below safe_epoch(), i.e. every thread pinned at that time has pinned
+ * after the node was unlinked.
+ *
+ * pin() and retire_epoch() / safe_epoch() are separated by full fences: either the
+ * reclaimer sees the pinned slot, or the pinned thread sees the node unlinked.
+ * ThreadSanitizer does not model standalone fences, so a clean TSan run does not
+ * cover this ordering.
+ */
+class epoch_domain
+{
+	public:
+		constexpr static size_t max_threads = 128;
+		constexpr static uint64_t idle = UINT64_MAX;
+
+		epoch_domain() = default;
+		epoch_domain(epoch_domain const &) = delete;
+		epoch_domain & operator=(epoch_domain const &) = delete;
+
+		// claims a free slot; throws std::length_error when all max_threads are taken
+		size_t enter()
+		{
+			for(size_t s = 0; s < max_threads; ++s) {
+				bool expected = false;
+				if ( !slots_[s].taken.load(std::memory_order_relaxed)
+						&& slots_[s].taken.compare_exchange_strong(expected, true, std::memory_order_acquire) )
+					return s;
+			}
+			throw std::length_error("epoch_domain: out of slots");
+		}
+
+		void leave(size_t s)
+		{
+			assert( slots_[s].epoch.load(std::memory_order_relaxed) == idle );
+			slots_[s].taken.store(false, std::memory_order_release);
+		}
+
+		void pin(size_t s)
+		{
+			slots_[s].epoch.store(global_.load(std::memory_order_acquire), std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		void unpin(size_t s) { slots_[s].epoch.store(idle, std::memory_order_release); }
+
+		// tag for a node that has just been unlinked
+		uint64_t retire_epoch() const
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			return global_.load(std::memory_order_acquire);
+		}
+
+		// nodes tagged below the returned epoch are unreachable by every thread; moves
+		// the global epoch on so that threads pinning from now on do not hold anything back
+		uint64_t safe_epoch()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint64_t r = global_.fetch_add(1, std::memory_order_acq_rel) + 1;
+			for(auto const & s : slots_) {
+				uint64_t const e = s.epoch.load(std::memory_order_acquire);
+				if ( e < r ) r = e;
+			}
+			return r;
+		}
+
+		// true while some thread is pinned, for assertions and tests
+		bool busy() const
+		{
+			for(auto const & s : slots_) {
+				if ( s.epoch.load(std::memory_order_acquire) != idle ) return true;
+			}
+			return false;
+		}
+
+		// pins a slot for the lifetime of the guard
+		struct guard
+		{
+			epoch_domain & d;
+			size_t s;
+			guard(epoch_domain & d_, size_t s_) : d(d_), s(s_) { d.pin(s); }
+			~guard() { d.unpin(s); }
+			guard(guard const &) = delete;
+			guard & operator=(guard const &) = delete;
+		};
+
+	private:
+		struct alignas(cache_line_size) slot
+		{
+			std::atomic<uint64_t> epoch{idle};
+			std::atomic<bool> taken{false};
+		};
+
+		alignas(cache_line_size) std::atomic<uint64_t> global_{1};
+		slot slots_[max_threads];
+};
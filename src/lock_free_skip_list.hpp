@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+
+#include <atomic>
+#include <array>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+#include "utils.hpp"
+#include "allocator.hpp"
+#include "random.hpp"
+#include "epoch.hpp"
+#include "skip_list.hpp"
+
+/*
+ * Many writers, many readers, no locks (Fraser; Herlihy & Shavit, ch. 14). Every
+ * thread works through its own handle, which owns an epoch slot, a level generator
+ * and the nodes it has retired.
+ *
+ * The low bit of forwards[i] marks the node holding it as deleted on level i. An
+ * erase() marks its node top down and wins on level 0, which is where both insert()
+ * (the CAS linking level 0) and erase() linearize; the upper levels only speed up
+ * searches. Searches snip marked nodes out as they pass them.
+ *
+ * A node is retired once it cannot be reached any more: after the eraser has run a
+ * search snipping it, and after its inserter has stopped linking upper levels (an
+ * inserter that sees its node marked snips it once more, as it may have linked a
+ * level after the eraser's search). pending counts these two parties down.
+ *
+ * Values are immutable once published. The allocator is called from every thread,
+ * so it has to be thread safe: aligned_allocator is, pool_allocator is not.
+ */
+template<typename key_type, typename value_type,
+	size_t N = skip_list_levels<key_type, value_type>(4),
+	template<typename, size_t> class Allocator = aligned_allocator,
+	typename LevelGenerator = xorshift64star,
+	typename Compare = side_compare<key_type> >
+struct lock_free_skip_list
+{
+	public:
+		using side_t = uint8_t;
+		using key_compare = Compare;
+		constexpr static size_t max_levels = N;
+		constexpr static size_t reclaim_batch = 64;
+
+	protected:
+		struct alignas(void*) elem
+		{
+			constexpr static size_t align = cache_line_size;
+			key_type key;
+			uint8_t height;
+			uint8_t lines;
+			std::atomic<uint8_t> pending{2}; // inserter and eraser still holding the node
+			value_type value;
+			std::atomic<elem*> forwards[];
+
+			elem(key_type k, value_type v, size_t h, size_t l) : key(k), height(h), lines(l), value(v) {}
+
+			constexpr static size_t capacity_of(size_t lines) { return (lines * align - sizeof(elem)) / sizeof(void*); }
+			constexpr static size_t lines_for(size_t h)
+			{
+				size_t l = 1;
+				while( capacity_of(l) < h ) l <<= 1;
+				return l;
+			}
+
+			elem * next(size_t i) const { return forwards[i].load(std::memory_order_acquire); }
+		};
+
+		static_assert( N > 0 && N <= UINT8_MAX, "tower height is kept in a byte" );
+		static_assert( alignof(elem) >= 2 && ATOMIC_POINTER_LOCK_FREE == 2, "the mark needs a free pointer bit" );
+
+		static bool is_marked(elem const * p) { return reinterpret_cast<uintptr_t>(p) & 1; }
+		static elem * marked(elem * p) { return reinterpret_cast<elem*>(reinterpret_cast<uintptr_t>(p) | 1); }
+		static elem * unmarked(elem * p) { return mask_ptr<elem*, 2>(p); }
+
+		static bool eq(key_type a, key_type b) { return a==b; }
+		bool lt(key_type a, key_type b) const { return cmp_(a, b); }
+
+		using path_type = std::array<elem*, N>;
+
+		Compare cmp_;
+		std::atomic<size_t> size_{0};
+		elem * head_;
+		mutable epoch_domain epochs_;
+		std::mutex orphans_lock_;
+		std::vector<elem*> orphans_; // retired by handles that went away before freeing them
+
+	public:
+		using allocator_type = Allocator< cache_line, elem::align >;
+
+	protected:
+		allocator_type alloc_;
+
+	public:
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		lock_free_skip_list(side_t sd) : cmp_{sd} { init(); }
+		explicit lock_free_skip_list(Compare cmp = Compare()) : cmp_(cmp) { init(); }
+
+		lock_free_skip_list(lock_free_skip_list const &) = delete;
+		lock_free_skip_list & operator=(lock_free_skip_list const &) = delete;
+
+		// no handle may outlive the list
+		~lock_free_skip_list()
+		{
+			assert( !epochs_.busy() );
+			for(elem * p = unmarked(head_->next(0)); p; ) {
+				elem * n = unmarked(p->next(0));
+				destroy_elem(p);
+				p = n;
+			}
+			for(elem * p : orphans_) destroy_elem(p);
+			destroy_elem(head_);
+		}
+
+		bool empty() const { return size() == 0; }
+		size_t size() const { return size_.load(std::memory_order_relaxed); }
+		key_compare key_comp() const { return cmp_; }
+		int side() const { return compare_side(cmp_); }
+
+		// only meaningful while no handle is modifying the list
+		std::vector< std::pair<key_type, value_type> > to_vector() const
+		{
+			std::vector< std::pair<key_type, value_type> > r;
+			for(elem const * p = unmarked(head_->next(0)); p; p = unmarked(p->next(0))) {
+				if ( !is_marked(p->next(0)) ) r.push_back( std::make_pair(p->key, p->value) );
+			}
+			return r;
+		}
+
+		class handle
+		{
+			public:
+				explicit handle(lock_free_skip_list & l) : handle(l, random_seed()) {}
+				handle(lock_free_skip_list & l, uint64_t seed) : l_(l), slot_(l.epochs_.enter()), levels_(seed) {}
+				~handle()
+				{
+					reclaim();
+					if ( !retired_.empty() ) {
+						std::lock_guard<std::mutex> g(l_.orphans_lock_);
+						for(auto const & r : retired_) l_.orphans_.push_back(r.second);
+					}
+					l_.epochs_.leave(slot_);
+				}
+				handle(handle const &) = delete;
+				handle & operator=(handle const &) = delete;
+
+				// false if k is there already or no node could be allocated
+				bool insert(key_type k, value_type v)
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					path_type preds, succs;
+					size_t const lvl = level_distribution<N>::rev_log(levels_());
+					elem * e = nullptr;
+					for(;;) {
+						if ( l_.search(k, preds, succs) ) {
+							if ( e ) l_.destroy_elem(e); // never published
+							return false;
+						}
+						if ( !e && !( e = l_.make_elem(k, v, lvl) ) ) return false;
+						for(size_t i = 0; i < lvl; ++i) e->forwards[i].store(succs[i], std::memory_order_relaxed);
+
+						elem * expected = succs[0];
+						if ( preds[0]->forwards[0].compare_exchange_strong(expected, e,
+									std::memory_order_acq_rel, std::memory_order_relaxed) ) break;
+					}
+					l_.size_.fetch_add(1, std::memory_order_relaxed);
+
+					// upper levels are best effort: stop as soon as an eraser has marked them
+					for(size_t i = 1; i < lvl; ++i) {
+						for(;;) {
+							elem * cur = e->forwards[i].load(std::memory_order_acquire);
+							if ( is_marked(cur) ) goto linked;
+							if ( cur != succs[i] && !e->forwards[i].compare_exchange_strong(cur, succs[i],
+										std::memory_order_acq_rel, std::memory_order_acquire) ) goto linked;
+							elem * expected = succs[i];
+							if ( preds[i]->forwards[i].compare_exchange_strong(expected, e,
+										std::memory_order_acq_rel, std::memory_order_relaxed) ) break;
+							if ( !l_.search(k, preds, succs) || succs[0] != e ) goto linked;
+						}
+					}
+				linked:
+					if ( is_marked(e->forwards[0].load(std::memory_order_acquire)) ) l_.search(k, preds, succs);
+					release(e);
+					return true;
+				}
+
+				std::pair<value_type, size_t> erase(key_type k)
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					path_type preds, succs;
+					if ( !l_.search(k, preds, succs) ) return std::make_pair(value_type{}, 0);
+					return erase_node(k, succs[0], preds, succs);
+				}
+
+				// erases the best element, if any: returns its key and value
+				std::pair< std::pair<key_type, value_type>, size_t > erase_head()
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					path_type preds, succs;
+					for(;;) {
+						elem * p = unmarked(l_.head_->next(0));
+						while( p && is_marked(p->next(0)) ) p = unmarked(p->next(0));
+						if ( !p ) return std::make_pair(std::make_pair(key_type{}, value_type{}), 0);
+						auto const kv = std::make_pair(p->key, p->value);
+						if ( erase_node(p->key, p, preds, succs).second ) return std::make_pair(kv, 1);
+					}
+				}
+
+				bool find(key_type k, value_type & v) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					elem const * p = l_.lookup(k);
+					if ( !p ) return false;
+					v = p->value;
+					return true;
+				}
+
+				bool contains(key_type k) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					return l_.lookup(k) != nullptr;
+				}
+
+				// calls f(key, value) for the first n elements not being erased, best first
+				template<typename F> size_t top(size_t n, F && f) const
+				{
+					epoch_domain::guard g(l_.epochs_, slot_);
+					size_t r = 0;
+					for(elem const * p = unmarked(l_.head_->next(0)); p && r < n; p = unmarked(p->next(0))) {
+						if ( is_marked(p->next(0)) ) continue;
+						f(p->key, p->value);
+						++r;
+					}
+					return r;
+				}
+
+				// frees whatever this handle retired that no thread can hold any more
+				void reclaim()
+				{
+					retired_since_ = 0;
+					if ( retired_.empty() ) return;
+					uint64_t const safe = l_.epochs_.safe_epoch();
+					auto it = retired_.begin();
+					for(; it != retired_.end() && it->first < safe; ++it) l_.destroy_elem(it->second);
+					retired_.erase(retired_.begin(), it);
+				}
+
+			private:
+				std::pair<value_type, size_t> erase_node(key_type k, elem * e, path_type & preds, path_type & succs)
+				{
+					for(size_t i = e->height; i > 1;) {
+						--i;
+						elem * succ = e->forwards[i].load(std::memory_order_acquire);
+						while( !is_marked(succ) && !e->forwards[i].compare_exchange_weak(succ, marked(succ),
+									std::memory_order_acq_rel, std::memory_order_acquire) );
+					}
+					elem * succ = e->forwards[0].load(std::memory_order_acquire);
+					for(;;) {
+						if ( is_marked(succ) ) return std::make_pair(value_type{}, 0); // lost to another eraser
+						if ( e->forwards[0].compare_exchange_strong(succ, marked(succ),
+									std::memory_order_acq_rel, std::memory_order_acquire) ) break;
+					}
+					l_.size_.fetch_sub(1, std::memory_order_relaxed);
+					auto r = e->value;
+					l_.search(k, preds, succs);
+					release(e);
+					return std::make_pair(r, 1);
+				}
+
+				void release(elem * e)
+				{
+					if ( e->pending.fetch_sub(1, std::memory_order_acq_rel) != 1 ) return;
+					retired_.push_back(std::make_pair(l_.epochs_.retire_epoch(), e));
+					if ( ++retired_since_ == reclaim_batch ) reclaim();
+				}
+
+				lock_free_skip_list & l_;
+				size_t const slot_;
+				LevelGenerator levels_;
+				std::vector< std::pair<uint64_t, elem*> > retired_;
+				size_t retired_since_ = 0;
+		};
+
+	protected:
+		void init()
+		{
+			head_ = make_elem(key_type{}, value_type{}, N);
+			assert( head_ && "out of memory for the head node" );
+			for(size_t i = 0; i < N; ++i) head_->forwards[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		/*
+		 * Last node before k and the first one not before it on every level, snipping
+		 * marked nodes on the way; starts over when a snip loses a race. True when an
+		 * unmarked node with key k is on level 0.
+		 */
+		bool search(key_type k, path_type & preds, path_type & succs)
+		{
+		retry:
+			elem * p = head_;
+			for(size_t lvl = N; lvl > 0;) {
+				--lvl;
+				elem * q = unmarked(p->next(lvl));
+				while( q ) {
+					elem * succ = q->next(lvl);
+					while( is_marked(succ) ) {
+						elem * expected = q;
+						if ( !p->forwards[lvl].compare_exchange_strong(expected, unmarked(succ),
+									std::memory_order_acq_rel, std::memory_order_relaxed) ) goto retry;
+						q = unmarked(succ);
+						if ( !q ) break;
+						succ = q->next(lvl);
+					}
+					if ( !q || !lt( q->key, k ) ) break;
+					p = q;
+					q = unmarked(succ);
+				}
+				preds[lvl] = p;
+				succs[lvl] = q;
+			}
+			return succs[0] && eq( succs[0]->key, k );
+		}
+
+		// wait-free lookup: steps over marked nodes without snipping them
+		elem const * lookup(key_type k) const
+		{
+			elem const * p = head_;
+			elem const * q = nullptr;
+			for(size_t lvl = N; lvl > 0;) {
+				--lvl;
+				q = unmarked(p->next(lvl));
+				while( q ) {
+					elem * succ = q->next(lvl);
+					if ( is_marked(succ) ) { q = unmarked(succ); continue; }
+					if ( !lt( q->key, k ) ) break;
+					p = q;
+					q = succ;
+				}
+			}
+			return ( q && eq( q->key, k ) && !is_marked(q->next(0)) ) ? q : nullptr;
+		}
+
+		// null when the allocator is out of memory
+		elem * make_elem(key_type k, value_type v, size_t height)
+		{
+			size_t const lines = elem::lines_for(height);
+			elem * e = reinterpret_cast<elem*>( alloc_.allocate(lines) );
+			if ( !e ) return nullptr;
+			alloc_.construct(e, k, v, height, lines);
+			return e;
+		}
+
+		void destroy_elem(elem * e)
+		{
+			size_t const lines = e->lines;
+			e->~elem();
+			alloc_.deallocate(reinterpret_cast<cache_line*>(e), lines);
+		}
+};
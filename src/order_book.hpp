@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+
+#include <vector>
+#include <utility>
+#include <string>
+#include <type_traits>
+
+#include "utils.hpp"
+#include "allocator.hpp"
+#include "skip_list.hpp"
+
+namespace detail {
+
+	/*
+	 * Open addressing map from integral ids to pointers: linear probing over a power
+	 * of two table kept at most half full, Fibonacci hashing, and backward shift on
+	 * erase, so there are no tombstones and probe runs stay short under churn. Null
+	 * marks a free slot. reserve() up front makes inserts allocation free.
+	 */
+	template<typename Key, typename T>
+	class id_index
+	{
+		struct slot
+		{
+			Key key;
+			T * p;
+		};
+
+		std::vector<slot> slots_;
+		size_t size_ = 0;
+		unsigned shift_ = 64;
+
+		size_t mask() const { return slots_.size() - 1; }
+		size_t home(Key k) const { return size_t( ( uint64_t(k) * 0x9E3779B97F4A7C15ULL ) >> shift_ ); }
+
+		void rehash(size_t capacity)
+		{
+			std::vector<slot> old(capacity, slot{Key{}, nullptr});
+			old.swap(slots_);
+			shift_ = 64 - __builtin_ctzll(capacity);
+			for(slot const & s : old) {
+				if ( !s.p ) continue;
+				size_t i = home(s.key);
+				while( slots_[i].p ) i = ( i + 1 ) & mask();
+				slots_[i] = s;
+			}
+		}
+
+	public:
+		static_assert( std::is_integral<Key>::value, "ids are hashed as integers" );
+
+		size_t size() const { return size_; }
+		size_t capacity() const { return slots_.size() / 2; }
+
+		void reserve(size_t n)
+		{
+			size_t c = 16;
+			while( c < 2 * n ) c <<= 1;
+			if ( c > slots_.size() ) rehash(c);
+		}
+		void clear()
+		{
+			std::fill(slots_.begin(), slots_.end(), slot{Key{}, nullptr});
+			size_ = 0;
+		}
+
+		T * find(Key k) const
+		{
+			if ( slots_.empty() ) return nullptr;
+			for(size_t i = home(k);; i = ( i + 1 ) & mask()) {
+				if ( !slots_[i].p || slots_[i].key == k ) return slots_[i].p;
+			}
+		}
+
+		// false if k is there already
+		bool insert(Key k, T * p)
+		{
+			assert( p );
+			if ( 2 * ( size_ + 1 ) > slots_.size() ) rehash(slots_.empty() ? 16 : 2 * slots_.size());
+			size_t i = home(k);
+			for(; slots_[i].p; i = ( i + 1 ) & mask()) {
+				if ( slots_[i].key == k ) return false;
+			}
+			slots_[i] = slot{k, p};
+			++size_;
+			return true;
+		}
+
+		// the pointer k mapped to, null if none
+		T * erase(Key k)
+		{
+			if ( slots_.empty() ) return nullptr;
+			size_t i = home(k);
+			for(; slots_[i].key != k || !slots_[i].p; i = ( i + 1 ) & mask()) {
+				if ( !slots_[i].p ) return nullptr;
+			}
+			T * const r = slots_[i].p;
+			// pull back every entry of the run that may sit at i: those whose home is
+			// not cyclically within (i, j]
+			for(size_t j = ( i + 1 ) & mask(); slots_[j].p; j = ( j + 1 ) & mask()) {
+				if ( ( ( j - home(slots_[j].key) ) & mask() ) >= ( ( j - i ) & mask() ) ) {
+					slots_[i] = slots_[j];
+					i = j;
+				}
+			}
+			slots_[i].p = nullptr;
+			--size_;
+			return r;
+		}
+};
+
+}
+
+/*
+ * One side of an order level (L3) book. Price levels live in a skip_list, each level
+ * owning an intrusive FIFO of its resting orders in time priority, and id_index maps
+ * order ids to orders: add() appends to the back of its level, cancel() and reduce()
+ * find the order by id and unlink it in O(1), pop_front() takes the oldest order at
+ * the best price. A level is created by its first order and goes with its last.
+ * Orders and levels come out of the Allocator's blocks, so with pool_allocator and
+ * reserve() a book at its working size does no heap allocation.
+ */
+template<typename Price = int32_t, typename Qty = int64_t, typename OrderId = uint64_t,
+	template <typename, size_t> class Allocator = pool_allocator>
+class order_book
+{
+	public:
+		using side_t = uint8_t;
+		struct level;
+
+		struct order
+		{
+			OrderId id;
+			Qty qty;
+			order * prev;    // towards the front of the queue
+			order * next;
+			level * lvl;
+		};
+
+		struct level
+		{
+			Price price;
+			Qty qty;         // resting at the level, summed over its orders
+			size_t count;    // orders
+			order * first;   // oldest, next to fill
+			order * last;
+		};
+
+		// levels hold pointers: skip_list moves values between nodes on erase_head()
+		using levels_type = skip_list<Price, level*, skip_list_levels<Price, level*>(4), Allocator>;
+
+		static_assert( std::is_trivially_destructible<Qty>::value && std::is_trivially_destructible<OrderId>::value,
+				"orders are dropped without destructor calls" );
+
+	protected:
+		levels_type levels_;
+		detail::id_index<OrderId, order> index_;
+		Allocator<order, alignof(void*)> orders_;
+		Allocator<level, alignof(void*)> level_pool_;
+
+		void unlink(order * o)
+		{
+			level * l = o->lvl;
+			( o->prev ? o->prev->next : l->first ) = o->next;
+			( o->next ? o->next->prev : l->last ) = o->prev;
+			l->qty -= o->qty;
+			l->count--;
+			orders_.deallocate(o, 1);
+			if ( l->count == 0 ) {
+				// the best level goes with a cheap erase_head(), others with a search
+				if ( levels_.front().value == l ) levels_.erase_head();
+				else levels_.erase(l->price);
+				level_pool_.deallocate(l, 1);
+			}
+		}
+
+	public:
+		explicit order_book(side_t sd) : levels_(sd) {}
+		order_book(side_t sd, uint64_t seed) : levels_(sd, seed) {}
+		~order_book() { clear(); }
+
+		order_book(order_book const &) = delete;
+		order_book & operator=(order_book const &) = delete;
+
+		bool empty() const { return index_.size() == 0; }
+		size_t size() const { return index_.size(); }
+		size_t level_count() const { return levels_.size(); }
+		int side() const { return levels_.side(); }
+		levels_type const & levels() const { return levels_; }
+
+		// room for n resting orders without growing the id index
+		void reserve(size_t n) { index_.reserve(n); }
+
+		void clear()
+		{
+			for(auto & e : levels_) {
+				for(order * o = e.value->first; o;) {
+					order * n = o->next;
+					orders_.deallocate(o, 1);
+					o = n;
+				}
+				level_pool_.deallocate(e.value, 1);
+			}
+			levels_.clear();
+			index_.clear();
+		}
+
+		// false if an order with this id rests already
+		bool add(OrderId id, Price px, Qty qty)
+		{
+			assert( qty > 0 );
+			order * o = orders_.allocate(1);
+			if ( !index_.insert(id, o) ) {
+				orders_.deallocate(o, 1);
+				return false;
+			}
+			auto r = levels_.try_emplace(px, nullptr);
+			level * l = r.first->value;
+			if ( r.second ) {
+				l = r.first->value = level_pool_.allocate(1);
+				*l = level{px, 0, 0, nullptr, nullptr};
+			}
+			*o = order{id, qty, l->last, nullptr, l};
+			( l->last ? l->last->next : l->first ) = o;
+			l->last = o;
+			l->qty += qty;
+			l->count++;
+			return true;
+		}
+
+		bool cancel(OrderId id)
+		{
+			order * o = index_.erase(id);
+			if ( !o ) return false;
+			unlink(o);
+			return true;
+		}
+
+		// takes up to qty off the order, an execution or a partial cancel; the order goes
+		// when nothing is left. Returns the quantity taken, 0 for an unknown id.
+		Qty reduce(OrderId id, Qty qty)
+		{
+			order * o = index_.find(id);
+			if ( !o ) return Qty{};
+			if ( qty < o->qty ) {
+				o->qty -= qty;
+				o->lvl->qty -= qty;
+				return qty;
+			}
+			Qty const r = o->qty;
+			index_.erase(id);
+			unlink(o);
+			return r;
+		}
+
+		order const * find(OrderId id) const { return index_.find(id); }
+		level const * find_level(Price px) const
+		{
+			level * const * l = levels_.find(px);
+			return l ? *l : nullptr;
+		}
+
+		// best price level and the order there with time priority, null on an empty book
+		level const * best() const { return empty() ? nullptr : levels_.front().value; }
+		order const * front() const { return empty() ? nullptr : levels_.front().value->first; }
+
+		// fills the front order completely
+		void pop_front()
+		{
+			assert( !empty() );
+			order * o = levels_.front().value->first;
+			index_.erase(o->id);
+			unlink(o);
+		}
+
+		// every level's queue against its totals, the links both ways, and the index;
+		// describes the first problem in *why
+		bool check(std::string * why = nullptr) const
+		{
+			auto const fail = [&](std::string const & m) {
+				if ( why ) *why = m;
+				return false;
+			};
+			if ( !levels_.check(why) ) return false;
+			size_t orders = 0;
+			for(auto const & e : levels_) {
+				level const * l = e.value;
+				std::string const at = " at level " + std::to_string(e.key);
+				if ( !l || l->price != e.key ) return fail("level price" + at);
+				if ( l->count == 0 ) return fail("empty level" + at);
+				Qty qty{};
+				size_t n = 0;
+				for(order const * o = l->first, * prev = nullptr; o; prev = o, o = o->next, ++n) {
+					if ( o->prev != prev || o->lvl != l ) return fail("broken queue" + at);
+					if ( !( o->qty > Qty{} ) ) return fail("order without quantity" + at);
+					if ( index_.find(o->id) != o ) return fail("order missing from the index" + at);
+					if ( !o->next && l->last != o ) return fail("bad queue back" + at);
+					qty += o->qty;
+				}
+				if ( n != l->count || qty != l->qty ) return fail("level totals" + at);
+				orders += n;
+			}
+			if ( orders != index_.size() ) return fail("index holds orders no level does");
+			return true;
+		}
+};
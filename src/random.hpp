@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <random>
+
+#include "utils.hpp"
+
+/*
+ * Level generators for skip_list: anything seedable from a uint64_t whose
+ * operator() returns 64 random bits fits (std::mt19937_64 does too).
+ */
+
+inline uint64_t splitmix64_next(uint64_t & s)
+{
+	uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+struct splitmix64
+{
+	using result_type = uint64_t;
+	uint64_t s;
+
+	explicit splitmix64(uint64_t seed = 0) : s(seed) {}
+	result_type operator()() { return splitmix64_next(s); }
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+};
+
+// xorshift64* (Vigna): three shifts and a multiply, state must never be zero
+struct xorshift64star
+{
+	using result_type = uint64_t;
+	uint64_t s;
+
+	explicit xorshift64star(uint64_t seed = 0) : s(splitmix64_next(seed) | 1) {}
+	result_type operator()()
+	{
+		s ^= s >> 12;
+		s ^= s << 25;
+		s ^= s >> 27;
+		return s * 0x2545F4914F6CDD1DULL;
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+};
+
+// one syscall per list, not per insert
+inline uint64_t random_seed()
+{
+	std::random_device rd;
+	return (uint64_t(rd()) << 32) ^ rd();
+}
+
+/*
+ * Integer versions of skip_list's tower height distributions, each mapping 64
+ * random bits onto [1, N] exactly like the former std::uniform_int_distribution
+ * + std::log2/std::sqrt formulas did.
+ */
+template<size_t N>
+struct level_distribution
+{
+	static_assert( 0 < N && N < 64, "levels must fit a 64 bit draw" );
+
+	// U{1,N}
+	static size_t uniform(uint64_t x) { return 1 + bounded(x, N); }
+
+	// log2(U{2,2^N})
+	static size_t log(uint64_t x) { return floor_log2(2 + bounded(x, (uint64_t(1) << N) - 1)); }
+
+	// N-log2(U{2,2^N})+1: geometric with p=1/2, half of the nodes get a single level
+	static size_t rev_log(uint64_t x) { return N + 1 - ceil_log2(2 + bounded(x, (uint64_t(1) << N) - 1)); }
+
+	// sqrt(U{1,N*N})
+	static size_t sqrt(uint64_t x) { return isqrt(1 + bounded(x, N * N)); }
+
+	// N-sqrt(U{1,N*N})+1
+	static size_t rev_sqrt(uint64_t x) { return N - isqrt(bounded(x, N * N)); }
+
+	// geometric with p = 1/2 capped at cap <= N: one level per trailing zero bit
+	static size_t geometric(uint64_t x, size_t cap) { return std::min(cap, size_t(1 + __builtin_ctzll(x | (uint64_t(1) << 63)))); }
+};
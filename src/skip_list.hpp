@@ -14,65 +14,233 @@
 #include <algorithm>
 #include <iterator>
 #include <unordered_set>
+#include <set>
+#include <type_traits>
+#include <functional>
+#include <atomic>
 
 #include "utils.hpp"
 #include "allocator.hpp"
+#include "random.hpp"
+#include "stats.hpp"
 
+// fixed part of a skip_list node, the tower of forward pointers follows it
+template<typename key_type, typename value_type>
+struct alignas(void*) skip_list_node_header
+{
+	key_type key;
+	uint8_t height;
+	uint8_t lines;
+	uint8_t dead;
+	value_type value;
+};
+
+// leads the binary snapshots of skip_list::save(), native byte order
+struct skip_list_snapshot
+{
+	char magic[6];          // "SLsnap"
+	uint8_t version;
+	int8_t side;            // skip_list::side()
+	uint8_t key_size;
+	uint8_t value_size;
+	uint8_t towers;         // a height byte follows every element
+	uint8_t reserved[5];
+	uint64_t size;          // elements that follow
+};
+static_assert( sizeof(skip_list_snapshot) == 24, "packed header" );
+
+// feature switches, or-ed together into skip_list's Options parameter
+enum skip_list_option : unsigned
+{
+	sl_indexable = 1u << 0,   // span counters next to the forward pointers: rank(), at(), erase_at()
+	sl_prefetch = 1u << 1,    // searches prefetch the node below while comparing the next one
+	sl_cached_keys = 1u << 2, // the successor's key next to each forward pointer: searches only
+	                          // dereference the nodes they advance to
+	sl_compact_links = 1u << 3, // 32-bit node offsets instead of pointers, needs an arena allocator
+	sl_top_cache = 1u << 4,   // the first nodes and their keys in one cache line inside the list,
+	                          // for front-of-book reads: top_k()
+	sl_tombstones = 1u << 5,  // erase() only marks the node, compact() unlinks it later
+	sl_stats = 1u << 6,       // search, tower height and footprint counters: stats()
+	sl_stats_latency = 1u << 7, // sl_stats plus per call latency histograms
+	// tower heights, at most one of these; geometric with p = 1/2 (rev_log) otherwise
+	sl_uniform_levels = 1u << 8,  // U{1,N}
+	sl_log_levels = 1u << 9,      // log2(U{2,2^N}), mostly tall towers
+	sl_sqrt_levels = 1u << 10,    // sqrt(U{1,N*N})
+	sl_rev_sqrt_levels = 1u << 11, // N-sqrt(U{1,N*N})+1
+	sl_adaptive_levels = 1u << 12, // geometric, the height cap follows size()
+};
+
+// bytes per tower level: the forward pointer plus whatever the options keep next to it
+template<typename key_type>
+constexpr size_t skip_list_slot(unsigned options)
+{
+	return ((options & sl_compact_links) ? sizeof(int32_t) : sizeof(void*))
+		+ ((options & sl_indexable) ? sizeof(uint32_t) : 0)
+		+ ((options & sl_cached_keys) ? sizeof(key_type) : 0);
+}
+
+// tower levels fitting into a node of the given number of cache lines
+template<typename key_type, typename value_type>
+constexpr size_t skip_list_levels(size_t lines, unsigned options = 0)
+{
+	return (lines * cache_line_size - sizeof(skip_list_node_header<key_type, value_type>)) / skip_list_slot<key_type>(options);
+}
+
+// runtime book side: sd=0 ascending (asks), sd=1 descending (bids)
+template<typename key_type>
+struct side_compare
+{
+	uint8_t sd;
+	bool operator()(key_type const & a, key_type const & b) const { return sd ? (b < a) : (a < b); }
+};
+
+// 0 for ascending, 1 for descending, -1 for any other ordering
+template<typename key_type> inline int compare_side(side_compare<key_type> const & c) { return c.sd; }
+template<typename key_type> inline int compare_side(std::less<key_type> const &) { return 0; }
+template<typename key_type> inline int compare_side(std::greater<key_type> const &) { return 1; }
+template<typename Compare> inline int compare_side(Compare const &) { return -1; }
+
+/*
+ * Compare orders the keys and must agree with key_type's operator==. The default
+ * side_compare picks the direction at run time; std::less / std::greater (or any
+ * stateless functor) fix it at compile time and leave a single comparison in the
+ * search loops.
+ */
 template<typename key_type, typename value_type,
-	size_t N = (64 - sizeof(key_type) - sizeof(value_type)) / sizeof(void*) >
+	size_t N = skip_list_levels<key_type, value_type>(4),
+	template<typename, size_t> class Allocator = aligned_allocator,
+	typename LevelGenerator = xorshift64star,
+	typename Compare = side_compare<key_type>,
+	unsigned Options = 0 >
 struct skip_list
 {
 	public:
 		using side_t = uint8_t;
-		constexpr static bool use_uniform_dist = false;
-		constexpr static bool use_log_dist = false;
-		constexpr static bool use_sqrt_dist = false;
-		constexpr static bool use_rev_sqrt_dist = false;
-		constexpr static bool use_rev_log_dist = true;
+		constexpr static bool use_uniform_dist = Options & sl_uniform_levels;
+		constexpr static bool use_log_dist = Options & sl_log_levels;
+		constexpr static bool use_sqrt_dist = Options & sl_sqrt_levels;
+		constexpr static bool use_rev_sqrt_dist = Options & sl_rev_sqrt_levels;
+		constexpr static bool use_adaptive_dist = Options & sl_adaptive_levels;
+		constexpr static bool use_rev_log_dist = !( use_uniform_dist || use_log_dist || use_sqrt_dist
+				|| use_rev_sqrt_dist || use_adaptive_dist );
 
 		constexpr static bool allow_duplicates = false;
+		constexpr static bool indexable = Options & sl_indexable;
+		constexpr static bool prefetch_search = Options & sl_prefetch;
+		constexpr static bool cached_keys = Options & sl_cached_keys;
+		constexpr static bool compact_links = Options & sl_compact_links;
+		constexpr static bool top_cache = Options & sl_top_cache;
+		constexpr static bool tombstones = Options & sl_tombstones;
+		constexpr static bool collect_stats = Options & ( sl_stats | sl_stats_latency );
+		constexpr static bool time_calls = Options & sl_stats_latency;
+		constexpr static size_t max_levels = N;
 	protected:
 		static bool eq(key_type a, key_type b) { return a==b; }
-		bool lt(key_type a, key_type b) const { return sd_?(b<a):(a<b); }
-		bool gt(key_type a, key_type b) const { return sd_?(a<b):(b<a); }
+		bool lt(key_type a, key_type b) const { return cmp_(a, b); }
+		bool gt(key_type a, key_type b) const { return cmp_(b, a); }
 
 		bool ge(key_type a, key_type b) const { return gt(a,b) || eq(a,b); }
 
-		struct elem
+		/*
+		 * Nodes are sized at allocation time: the tower only holds as many forward
+		 * pointers as the size class (1, 2, 4, ... cache lines) needed for its height,
+		 * so the common level-1 node stays within a single line. The head node is the
+		 * only one with room for all N levels and lives as long as the list is not
+		 * empty: insert_head() and erase_head() move keys and values through it.
+		 */
+		struct alignas(void*) elem
 		{
-			constexpr static size_t align = 64;
+			/*
+			 * sl_compact_links stores a link as the signed distance to the target in
+			 * cache lines, 0 for null (a node never links to itself). Nodes hold no
+			 * addresses then: the arena they live in can be moved or mapped elsewhere
+			 * as a whole, and a 32-bit link spans 128 GiB either way.
+			 */
+			using link_type = typename std::conditional<compact_links, int32_t, elem*>::type;
+			constexpr static size_t align = cache_line_size;
 			key_type key;
+			uint8_t height;     // levels linked in: forwards[0, height)
+			uint8_t lines;      // size class, in cache lines
+			uint8_t dead;       // sl_tombstones: erased, still linked in until compact()
 			value_type value;
-			std::array<elem*, N> forwards { nullptr };
+			link_type forwards[]; // read through next(), written through link()
+
+			// the value is constructed in place from args
+			template<typename... Args>
+			elem(key_type k, size_t h, size_t l, Args &&... args)
+				: key(k), height(h), lines(l), dead(0), value(std::forward<Args>(args)...) {}
+
+			/*
+			 * Behind the forward pointers, in this order: with sl_cached_keys a copy of
+			 * forwards[i]->key per level (stale where forwards[i] is null), so deciding not
+			 * to advance costs no miss on the next node; with sl_indexable a span per level,
+			 * the number of level-0 steps to forwards[i], or to the end of the list when
+			 * that is null.
+			 */
+			constexpr static size_t capacity_of(size_t lines) { return (lines * align - sizeof(elem)) / skip_list_slot<key_type>(Options); }
+			constexpr static size_t lines_for(size_t h)
+			{
+				size_t l = 1;
+				while( capacity_of(l) < h ) l <<= 1;
+				return l;
+			}
+			size_t capacity() const { return capacity_of(lines); }
+			key_type * next_keys() { return reinterpret_cast<key_type*>(forwards + capacity()); }
+			key_type const * next_keys() const { return reinterpret_cast<key_type const*>(forwards + capacity()); }
+			uint32_t * spans() { return reinterpret_cast<uint32_t*>(next_keys() + (cached_keys ? capacity() : 0)); }
+			uint32_t const * spans() const { return reinterpret_cast<uint32_t const*>(next_keys() + (cached_keys ? capacity() : 0)); }
+
+			elem * next(size_t i) const { return decode(forwards[i]); }
+			// key of next(i), which must not be null
+			key_type const & next_key(size_t i) const { return cached_keys ? next_keys()[i] : next(i)->key; }
 
-			elem(key_type k, value_type v) : key(k), value(v), forwards({}) {}
+			// every write to the tower goes through these two, keeping the cached keys in step
+			void link(size_t i, elem * p)
+			{
+				encode(forwards[i], p);
+				if ( cached_keys && p ) next_keys()[i] = p->key;
+			}
+			void link_as(size_t i, elem const * o)
+			{
+				encode(forwards[i], o->next(i));
+				if ( cached_keys ) next_keys()[i] = o->next_keys()[i];
+			}
 
-			elem(key_type k, value_type v, std::array<elem*, N> const & a)
-				: key(k), value(v), forwards(a)
-			{}
+			elem * decode(elem * l) const { return l; }
+			elem * decode(int32_t l) const
+			{
+				char * self = reinterpret_cast<char*>(const_cast<elem*>(this));
+				return l ? reinterpret_cast<elem*>(self + ptrdiff_t(l) * ptrdiff_t(align)) : nullptr;
+			}
+			void encode(elem *& l, elem * p) { l = p; }
+			void encode(int32_t & l, elem * p)
+			{
+				ptrdiff_t const d = p ? (reinterpret_cast<char*>(p) - reinterpret_cast<char*>(this)) / ptrdiff_t(align) : 0;
+				assert( d >= INT32_MIN && d <= INT32_MAX && "nodes must come from one arena" );
+				l = int32_t(d);
+			}
 
-			static void set_forwards(std::array<elem*, N> & forwards, size_t a, size_t b, elem * p)
+			void set_forwards(size_t a, size_t b, elem * p)
 			{
-				for(size_t i = a; i < b; ++i) { forwards[i] = p; }
+				for(size_t i = a; i < b; ++i) { link(i, p); }
 			}
-			void set_forwards(size_t a, size_t b, elem * p) { set_forwards(forwards, a, b, p); }
 
 			static std::string distance_between(elem const * p, elem const * o)
 			{
 				if ( !p ) return ".";
 				if ( !o ) return "-";
 				int r = 0;
-				for(; p != o; p = p->forwards[0], ++r);
+				for(; p != o; p = p->next(0), ++r);
 				return std::to_string(r);
 			}
 
 			template<typename ostream>
 				static ostream & dump_distances(ostream & o,
-						elem const * p, std::array<elem *,N> const & f)
+						elem const * p, elem * const * f, size_t n)
 				{
 					char const * sep = "[";
-					for(auto & e : f) {
-						o << sep << distance_between(p, e) << " (" << e << ")";
+					for(size_t i = 0; i < n; ++i) {
+						o << sep << distance_between(p, f[i]) << " (" << f[i] << ")";
 						sep = ", ";
 					}
 					o << "]";
@@ -82,42 +250,326 @@ struct skip_list
 			template<typename ostream>
 				ostream & dump(ostream & o) const
 				{
+					std::array<elem*, N> f;
+					for(size_t i = 0; i < height; ++i) f[i] = next(i);
 					return dump_distances( o << "[" << (void*)this << ": "
-							<< key << " -> " << value << " ", this, forwards ) << "]";
+							<< key << " -> " << value << " ", this, f.data(), height ) << "]";
 				}
 		};
 
-		static_assert( sizeof(elem) == 64, "elem is expected to fit into a cache line" );
+		static_assert( N > 0 && N <= UINT8_MAX, "tower height is kept in a byte" );
+		static_assert( sizeof(elem) == sizeof(skip_list_node_header<key_type, value_type>),
+				"skip_list_levels() sizes nodes from the header" );
+		static_assert( elem::capacity_of(1) > 0, "a level-1 node must fit into a cache line" );
+		static_assert( !cached_keys || std::is_trivially_copyable<key_type>::value,
+				"sl_cached_keys copies keys into the towers" );
+		static_assert( !cached_keys || !indexable || alignof(key_type) >= alignof(uint32_t),
+				"spans follow the cached keys" );
+		static_assert( !cached_keys || !compact_links || alignof(key_type) <= alignof(int32_t),
+				"cached keys follow the 32-bit links" );
 
-		side_t sd_;
-		size_t size_ = 0;
+		constexpr static size_t head_lines = elem::lines_for(N);
+
+		Compare cmp_;
+		size_t size_ = 0;   // live elements, tombstones not included
 		elem * head_ = nullptr;
+		LevelGenerator levels_;
+
+		/*
+		 * sl_tombstones: erase() sets the node's dead flag and leaves it linked in, so a
+		 * cancel costs the search only; searches and iterators step over dead nodes and
+		 * insert() of a dead key revives its node. compact() unlinks them later, the
+		 * keys in graveyard_, one per erase() since, telling it where to look. Its room
+		 * is set aside up front and erase() records no more keys once it is full, so
+		 * erase() never allocates.
+		 */
+		constexpr static size_t graveyard_capacity = 1024;
+		size_t dead_ = 0;
+		std::vector<key_type> graveyard_ = empty_graveyard();
+		// tombstones without graveyard entries (attach() keeps none) are found by a walk
+		// along level 0, which a budgeted compact() resumes at this key
+		key_type sweep_from_{};
+		bool sweep_resume_ = false;
 
-		using allocator_type = aligned_allocator< elem, elem::align >;
+		// search path of the last insert()/erase() or *_near() call: the last node before
+		// its key on every level; anything else that relinks nodes drops it
+		std::array<elem*, N> finger_;
+		std::array<size_t, N> finger_rank_; // positions of the finger_ nodes, indexable lists only
+		bool finger_valid_ = false;
+
+		// levels the head links to a node on, at least 1: searches start on the top one
+		uint8_t used_levels_ = 1;
+
+		// sl_stats counters, see stats(); empty otherwise and kept in the padding here
+		using stats_recorder = detail::stats_recorder<N, collect_stats, time_calls>;
+		using stats_timer = typename stats_recorder::timer;
+		mutable stats_recorder stats_;
+
+	public:
+		// nodes kept by sl_top_cache: as many node pointers and keys as share a cache line
+		constexpr static size_t top_levels = top_cache
+			? std::max<size_t>(2, std::min<size_t>(8, cache_line_size / (sizeof(void*) + sizeof(key_type)))) : 0;
+
+	protected:
+		/*
+		 * sl_top_cache: the first min(size(), top_levels) nodes in list order with their
+		 * keys. Pointers rather than copies of the values, which can change in place;
+		 * top_k() loads the nodes independently of each other instead of one link at a
+		 * time, and a read of the best keys touches only this line.
+		 */
+		struct alignas(cache_line_size) top_nodes
+		{
+			elem * nodes[top_levels ? top_levels : 1];
+			key_type keys[top_levels ? top_levels : 1];
+		};
+		struct no_top_nodes {};
+		typename std::conditional<top_cache, top_nodes, no_top_nodes>::type top_;
+
+		static_assert( !top_cache || std::is_trivially_copyable<key_type>::value,
+				"sl_top_cache copies keys into the list" );
+		static_assert( !tombstones || ( !indexable && !top_cache ),
+				"positions and the cached front would count dead nodes" );
+		static_assert( use_uniform_dist + use_log_dist + use_sqrt_dist + use_rev_sqrt_dist + use_adaptive_dist <= 1,
+				"one level distribution at most" );
+
+	public:
+		using allocator_type = Allocator< cache_line, elem::align >;
+
+		static_assert( !compact_links || detail::is_arena<allocator_type>::value,
+				"sl_compact_links needs all nodes in one arena, see arena_allocator" );
+
+		constexpr static bool persistent = detail::is_persistent<allocator_type>::value;
+		static_assert( !persistent || compact_links, "nodes in a file link to each other by offset" );
+		static_assert( !persistent || ( std::is_trivially_copyable<key_type>::value
+					&& std::is_trivially_copyable<value_type>::value ), "nodes in a file hold plain data" );
+
+	protected:
+		allocator_type alloc_;
 
 	public:
 
-		skip_list(side_t sd) : sd_(sd) {}
-		~skip_list() { clear(); }
+		using key_compare = Compare;
+
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		skip_list(side_t sd) : cmp_{sd}, levels_(random_seed()) {}
+		explicit skip_list(Compare cmp = Compare()) : cmp_(cmp), levels_(random_seed()) {}
+
+		// same seed, same operations => same tower layout, for reproducible replays
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		skip_list(side_t sd, uint64_t seed) : cmp_{sd}, levels_(seed) {}
+		skip_list(Compare cmp, uint64_t seed) : cmp_(cmp), levels_(seed) {}
+
+		// (key, value) pairs already in list order, see assign_sorted()
+		template<typename It, typename = typename std::enable_if<!std::is_integral<It>::value>::type>
+		skip_list(It first, It last, Compare cmp = Compare()) : cmp_(cmp), levels_(random_seed())
+		{
+			assign_sorted(first, last);
+		}
+		// a persistent list's nodes stay in its file, the allocator unmaps them
+		~skip_list() { if ( !attached() ) clear(); }
+
+		// copies are deep, see clone(); moves take the nodes along with the allocator
+		// they came from
+		skip_list(skip_list const & o) : cmp_(o.cmp_), levels_(o.levels_) { copy_nodes(o); }
+		skip_list(skip_list && o) noexcept : cmp_(o.cmp_), levels_(o.levels_),
+			graveyard_(std::move(o.graveyard_)), alloc_(std::move(o.alloc_))
+		{
+			head_ = o.head_;
+			size_ = o.size_;
+			dead_ = o.dead_;
+			top_ = o.top_;
+			used_levels_ = o.used_levels_;
+			stats_.take_footprint(o.stats_);
+			o.abandon();
+			publish();
+		}
+		skip_list & operator=(skip_list const & o)
+		{
+			if ( this != &o ) {
+				skip_list t(o);
+				swap(t);
+			}
+			return *this;
+		}
+		skip_list & operator=(skip_list && o) noexcept
+		{
+			skip_list t(std::move(o));
+			swap(t);
+			return *this;
+		}
+
+		void swap(skip_list & o) noexcept
+		{
+			using std::swap;
+			swap(cmp_, o.cmp_);
+			swap(size_, o.size_);
+			swap(head_, o.head_);
+			swap(levels_, o.levels_);
+			swap(dead_, o.dead_);
+			swap(graveyard_, o.graveyard_);
+			swap(top_, o.top_);
+			swap(alloc_, o.alloc_);
+			swap(used_levels_, o.used_levels_);
+			stats_.swap_footprint(o.stats_);
+			finger_valid_ = o.finger_valid_ = false;
+			publish();
+			o.publish();
+		}
+
+		// every node copied with its tower height, so the copy searches exactly like
+		// the original, and the level generator with them
+		skip_list clone() const { return skip_list(*this); }
 
 		bool empty() const { return head_ == nullptr; }
 		size_t size() const { return size_; }
 		void clear()
 		{
-			elem * p = head_;
-			while( p ) {
-				elem * n = p->forwards[0];
-				allocator_type::destroy(p);
-				allocator_type::deallocate(p,1);
-				p = n;
+			// pooling allocators drop all nodes at once, then only destructors need a walk
+			constexpr bool bulk = detail::has_release<allocator_type>::value;
+			mark_dirty();
+			if ( !bulk || !std::is_trivially_destructible<elem>::value ) {
+				elem * p = head_;
+				while( p ) {
+					elem * n = p->next(0);
+					if ( bulk ) p->~elem();
+					else destroy_elem(p);
+					p = n;
+				}
+			}
+			detail::release(alloc_);
+			stats_.released();
+			head_ = nullptr;
+			used_levels_ = 1;
+			size_ = 0;
+			dead_ = 0;
+			graveyard_.clear();
+			finger_valid_ = false;
+			publish();
+		}
+
+		/*
+		 * Persistent lists (a mapped_arena_allocator): attach() maps the list kept in
+		 * the file at path in O(1), whatever its size, or starts an empty one in a new
+		 * file; every change lands in the file as it is made, and destroying or
+		 * detaching the list leaves it there. False if the file holds anything but a
+		 * list of this type and side. checkpoint() writes it back to the disk. A process
+		 * killed between calls leaves a list that reopens as of its last call, and a
+		 * machine that goes down leaves one as of the last checkpoint(). A process
+		 * killed in the middle of a call leaves the file marked dirty; attach() then
+		 * rebuilds the list from level 0 in O(n), see recover(), with or without what
+		 * the call was changing. A block the call had taken or was giving back may stay
+		 * lost to the arena.
+		 */
+		bool attach(char const * path)
+		{
+			static_assert( persistent, "attach() needs a persistent allocator, see mapped_arena_allocator" );
+			detach();
+			if ( !alloc_.open(path) ) return false;
+			uint64_t * r = alloc_.root();
+			if ( r[0] == 0 ) {
+				r[0] = layout();
+				r[3] = uint64_t(int64_t(side()));
+				publish();
+				return true;
+			}
+			if ( r[0] != layout() || int64_t(r[3]) != side() ) {
+				alloc_.close();
+				return false;
 			}
+			head_ = r[1] ? reinterpret_cast<elem*>(const_cast<char*>(alloc_.base()) + r[1]) : nullptr;
+			size_ = r[2];
+			dead_ = r[4];
+			// the last writer died in the middle of a call
+			if ( r[5] ) recover();
+			count_levels();
+			top_refill();
+			return true;
+		}
+
+		// unmaps the list and leaves an empty one, the file keeps the nodes
+		void detach()
+		{
+			static_assert( persistent, "detach() needs a persistent allocator" );
+			alloc_.close();
+			stats_.released();
+			head_ = nullptr;
+			used_levels_ = 1;
 			size_ = 0;
+			dead_ = 0;
+			graveyard_.clear();
+			finger_valid_ = false;
+		}
+
+		bool attached() const { return attached(std::integral_constant<bool, persistent>{}); }
+		bool checkpoint()
+		{
+			static_assert( persistent, "checkpoint() needs a persistent allocator" );
+			return alloc_.sync();
+		}
+
+		/*
+		 * Consistency checker, meant for lists read back from a file: walks level 0 and
+		 * validates the key order, each node's height, every level against the nodes
+		 * taller than it, the spans and cached keys, and size(). Nodes of persistent
+		 * lists must also lie within the arena. Describes the first problem in *why.
+		 */
+		bool check(std::string * why = nullptr) const
+		{
+			auto const fail = [&](std::string const & m) {
+				if ( why ) *why = m;
+				return false;
+			};
+			size_t const nodes = size_ + dead_;
+			if ( !head_ ) return nodes == 0 || fail("no head with size " + std::to_string(size_));
+			if ( !owns(head_) ) return fail("head outside the arena");
+			if ( head_->height != N ) return fail("head height " + std::to_string(head_->height));
+
+			std::array<elem const*, N> last; // last node so far taller than the level
+			std::array<size_t, N> at;        // and its position
+			last.fill(head_);
+			at.fill(0);
+			size_t pos = 0;
+			size_t dead = is_dead(head_);
+			for(elem const * p = head_;;) {
+				elem const * q = p->next(0);
+				if ( !q ) break;
+				std::string const where = " at position " + std::to_string(++pos);
+				if ( pos >= nodes ) return fail("more nodes than size " + std::to_string(size_));
+				dead += is_dead(q);
+				if ( !owns(q) ) return fail("node outside the arena" + where);
+				if ( !lt( p->key, q->key ) ) return fail("keys out of order" + where);
+				if ( q->height == 0 || q->height > q->capacity() ) return fail("bad height" + where);
+				for(size_t i = 0; i < q->height; ++i) {
+					if ( i > 0 && last[i]->next(i) != q ) return fail("level " + std::to_string(i) + " skips the node" + where);
+					if ( cached_keys && !eq( last[i]->next_keys()[i], q->key ) ) return fail("stale cached key" + where);
+					if ( indexable && last[i]->spans()[i] != pos - at[i] ) return fail("bad span" + where);
+					last[i] = q;
+					at[i] = pos;
+				}
+				p = q;
+			}
+			if ( pos + 1 != nodes ) return fail(std::to_string(pos + 1) + " nodes with size " + std::to_string(size_));
+			if ( dead != dead_ ) return fail(std::to_string(dead) + " dead nodes, " + std::to_string(dead_) + " counted");
+			if ( !top_valid() ) return fail("stale top cache");
+			if ( used_levels_ < 1 || used_levels_ > N || ( used_levels_ > 1 && !head_->next(used_levels_ - 1) )
+					|| ( used_levels_ < N && head_->next(used_levels_) ) ) return fail("levels in use " + std::to_string(used_levels_));
+			for(size_t i = 0; i < N; ++i) {
+				if ( last[i]->next(i) ) return fail("level " + std::to_string(i) + " not terminated");
+				if ( indexable && last[i]->spans()[i] != nodes - at[i] ) return fail("bad span at the end");
+			}
+			return true;
 		}
 
+		allocator_type const & get_allocator() const { return alloc_; }
+		key_compare key_comp() const { return cmp_; }
+		int side() const { return compare_side(cmp_); }
+
 		size_t count() const
 		{
 			size_t r = 0;
-			for(elem const * p = head_; p; p = p->forwards[0], ++r);
+			for(elem const * p = head_; p; p = p->next(0)) r += !is_dead(p);
 			return r;
 		}
 
@@ -125,28 +577,24 @@ struct skip_list
 		{
 			std::vector< std::pair<key_type, value_type> > r;
 			r.reserve( size_ );
-			for(elem const * p = head_; p; p = p->forwards[0]) {
-				r.push_back( std::make_pair(p->key, p->value) );
+			for(elem const * p = head_; p; p = p->next(0)) {
+				if ( !is_dead(p) ) r.push_back( std::make_pair(p->key, p->value) );
 			}
 			return r;
 		}
 
 		value_type * find(key_type k) const
 		{
+			stats_timer const t(stats_, skip_list_stats<N>::find_op);
+			stats_.search(skip_list_stats<N>::find_op);
 			if ( elem * p = head_ )
 			{
-				if( eq( p->key, k ) ) return &(p->value);
-
-				for(size_t lvl = N; lvl > 0;) {
-					--lvl;
-					while( p->forwards[lvl] && lt( p->forwards[lvl]->key, k) ) {
-						p = p->forwards[lvl];
-					}
-					assert( p->forwards[lvl] == nullptr || ge( p->forwards[lvl]->key, k) );
-				}
+				if( eq( p->key, k ) ) return live_value(p);
+				if ( !lt( p->key, k ) ) return nullptr;
 
-				if ( p->forwards[0] ) {
-					return ( eq( p->forwards[0]->key, k ) ?  &(p->forwards[0]->value) : nullptr );
+				p = last_before(p, k);
+				if ( p->next(0) ) {
+					return ( eq( p->next_key(0), k ) ? live_value(p->next(0)) : nullptr );
 				}
 			}
 
@@ -154,14 +602,66 @@ struct skip_list
 		}
 		bool contains(key_type k) const { return find(k) != nullptr; }
 
+		/*
+		 * find() for n keys at once: lookups advance in groups of G, one hop each per
+		 * round, and every hop prefetches the node the lookup compares next. The group's
+		 * cache misses overlap instead of queueing up behind each other, which pays off
+		 * once the list no longer fits into the cache.
+		 */
+		template<size_t G = 8>
+		void find_many(key_type const * keys, size_t n, value_type ** found) const
+		{
+			constexpr size_t done = SIZE_MAX;
+			for(size_t b = 0; b < n; b += G) {
+				size_t const m = std::min(G, n - b);
+				elem * p[G];
+				size_t lvl[G];
+				size_t active = 0;
+				for(size_t i = 0; i < m; ++i) {
+					key_type const k = keys[b + i];
+					stats_.search(skip_list_stats<N>::find_op);
+					if ( !head_ || !lt( head_->key, k ) ) {
+						found[b + i] = ( head_ && eq( head_->key, k ) ) ? live_value(head_) : nullptr;
+						lvl[i] = done;
+						continue;
+					}
+					p[i] = head_;
+					lvl[i] = used_levels_ - 1;
+					__builtin_prefetch(head_->next(lvl[i]));
+					++active;
+				}
+				while( active ) {
+					for(size_t i = 0; i < m; ++i) {
+						if ( lvl[i] == done ) continue;
+						key_type const k = keys[b + i];
+						elem * q = p[i]->next(lvl[i]);
+						if ( q && lt( p[i]->next_key(lvl[i]), k ) ) {
+							stats_.hops(lvl[i], 1);
+							p[i] = q;
+							__builtin_prefetch(q->next(lvl[i]));
+						}
+						else if ( lvl[i] == 0 ) {
+							found[b + i] = ( q && eq( p[i]->next_key(0), k ) ) ? live_value(q) : nullptr;
+							lvl[i] = done;
+							--active;
+						}
+						else {
+							--lvl[i];
+							__builtin_prefetch(p[i]->next(lvl[i]));
+						}
+					}
+				}
+			}
+		}
+
 		template<typename ostream>
 			ostream & dump(ostream & o, char const * sep = ", ", int limit = INT_MAX,
 					std::set<elem const*> marked = {}) const
 			{
-				o << "[sd=" << (int)sd_ << ", size=" << size_ << ", head=" << (void*)head_ << ": ";
+				o << "[sd=" << side() << ", size=" << size_ << ", head=" << (void*)head_ << ": ";
 				int cnt = 0;
 				char const * ssep = sep;
-				for(elem const * p = head_; p; p = p->forwards[0], ssep=sep)
+				for(elem const * p = head_; p; p = p->next(0), ssep=sep)
 				{
 					if ( cnt++ >= limit ) {
 						o << sep << "...";
@@ -174,144 +674,731 @@ struct skip_list
 				return o;
 			}
 
-		bool insert(key_type k, value_type v)
+		template<typename V = value_type>
+		bool insert(key_type k, V && v) { return insert_impl<false>(k, std::forward<V>(v)).second; }
+
+		/*
+		 * Replaces the contents with (key, value) pairs already in list order, in one
+		 * pass and without searching. Towers are perfectly balanced instead of drawn,
+		 * see build_sorted(), so they do not depend on the seed. Repeated keys keep the
+		 * first value, as insert() would.
+		 */
+		template<typename It>
+		void assign_sorted(It first, It last)
+		{
+			bool const ordered = build_sorted([&](key_type & k, value_type & v, size_t & h) {
+				if ( first == last ) return false;
+				k = first->first;
+				v = first->second;
+				h = 0;
+				++first;
+				return true;
+			});
+			assert( ordered && "assign_sorted() needs keys in list order" );
+			(void)ordered;
+		}
+
+		/*
+		 * Binary snapshot: a skip_list_snapshot header, then per element its key's and
+		 * value's bytes, packed, and with towers its height in a byte. save() streams it
+		 * through write(char const *, size_t) a few KiB at a time, stopping when that
+		 * returns false. load() reads it back through read(char *, size_t), which fills
+		 * the buffer or returns false, and relinks the nodes in one pass, with the saved
+		 * heights if there are any. Snapshots of another side or key or value size, and
+		 * streams cut short or out of order, are refused and leave the list empty.
+		 */
+		template<typename Write>
+		bool save(Write && write, bool towers = false) const
+		{
+			static_assert( std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<value_type>::value,
+					"snapshots copy keys and values bytewise" );
+			skip_list_snapshot h{};
+			std::memcpy(h.magic, "SLsnap", sizeof(h.magic));
+			h.version = 1;
+			h.side = int8_t(side());
+			h.key_size = sizeof(key_type);
+			h.value_size = sizeof(value_type);
+			h.towers = towers;
+			h.size = size_;
+			if ( !write(reinterpret_cast<char const*>(&h), sizeof(h)) ) return false;
+
+			size_t const record = sizeof(key_type) + sizeof(value_type) + towers;
+			char buf[4096];
+			size_t used = 0;
+			for(elem const * p = head_; p; p = p->next(0)) {
+				if ( is_dead(p) ) continue;
+				if ( used + record > sizeof(buf) ) {
+					if ( !write(static_cast<char const*>(buf), used) ) return false;
+					used = 0;
+				}
+				std::memcpy(buf + used, &p->key, sizeof(key_type));
+				std::memcpy(buf + used + sizeof(key_type), &p->value, sizeof(value_type));
+				if ( towers ) buf[used + record - 1] = char(p->height);
+				used += record;
+			}
+			return used == 0 || write(static_cast<char const*>(buf), used);
+		}
+
+		template<typename Read>
+		bool load(Read && read)
+		{
+			static_assert( std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<value_type>::value,
+					"snapshots copy keys and values bytewise" );
+			clear();
+			skip_list_snapshot h;
+			if ( !read(reinterpret_cast<char*>(&h), sizeof(h)) || std::memcmp(h.magic, "SLsnap", sizeof(h.magic))
+					|| h.version != 1 || h.side != side()
+					|| h.key_size != sizeof(key_type) || h.value_size != sizeof(value_type) ) return false;
+
+			size_t const record = sizeof(key_type) + sizeof(value_type) + bool(h.towers);
+			char buf[4096];
+			size_t have = 0, off = 0;
+			uint64_t left = h.size;
+			bool cut = false;
+			bool const ordered = build_sorted([&](key_type & k, value_type & v, size_t & height) {
+				if ( left == 0 ) return false;
+				if ( off == have ) {
+					size_t const n = size_t(std::min<uint64_t>(left, sizeof(buf) / record));
+					if ( !read(static_cast<char*>(buf), n * record) ) return !(cut = true);
+					have = n * record;
+					off = 0;
+				}
+				std::memcpy(&k, buf + off, sizeof(key_type));
+				std::memcpy(&v, buf + off + sizeof(key_type), sizeof(value_type));
+				height = h.towers ? uint8_t(buf[off + record - 1]) : 0;
+				off += record;
+				--left;
+				return true;
+			});
+			if ( !ordered || cut || size_ != h.size ) {
+				clear();
+				return false;
+			}
+			return true;
+		}
+
+		// k orders after every key in the list: the finger stays at the back between
+		// calls, so appending a run of keys costs O(1) per key instead of O(log n)
+		bool append_back(key_type k, value_type v)
+		{
+			assert( ( !finger_valid_ || !finger_[0]->next(0) || lt( finger_[0]->next(0)->key, k ) )
+					&& "append_back() needs a key after the last one" );
+			return insert_impl<true>(k, std::move(v)).second;
+		}
+
+		/*
+		 * Finger variants: the search starts from finger_, the path left by the previous
+		 * insert()/erase() or *_near() call, and climbs only as far as needed, so keys d
+		 * positions away from the previous one cost O(log d) instead of O(log n).
+		 */
+		bool insert_near(key_type k, value_type v) { return insert_impl<true>(k, std::move(v)).second; }
+		std::pair<value_type, size_t> erase_near(key_type k) { return erase_impl<true>(k, always); }
+		value_type * find_near(key_type k)
 		{
-			//dump(std::cout << "-- insert (" << k << "->" << v << "), into:\n", "\n") << std::endl;
-			std::array<elem*, N> forwards {};
+			stats_timer const t(stats_, skip_list_stats<N>::find_op);
+			stats_.search(skip_list_stats<N>::find_op);
 			if ( elem * p = head_ ) {
-				if ( lt( p->key, k ) ) {
-					for(size_t lvl = N; lvl > 0;) {
-						--lvl;
-						while( p->forwards[lvl] && lt( p->forwards[lvl]->key, k) ) {
-							p = p->forwards[lvl];
-						}
-						forwards[lvl] = p;
-						assert( lt(p->key, k) ); // p->key < k, k is strictly greater than p->key
+				if ( !lt( p->key, k ) ) return eq( p->key, k ) ? live_value(p) : nullptr;
+				p = finger_descend(k)->next(0);
+				if ( p && eq( p->key, k ) ) return live_value(p);
+			}
+			return nullptr;
+		}
+
+		/*
+		 * Batches visit their keys in list order, sorting them first unless they already
+		 * are, so every search is a finger search from the previous key's path. Results
+		 * land at the caller's indexes. With prefetch the nodes the next search starts
+		 * from are requested while the current key is applied.
+		 */
+		template<bool prefetch = true>
+		size_t insert_batch(std::pair<key_type, value_type> const * kv, size_t n, bool * inserted = nullptr)
+		{
+			size_t r = 0;
+			for_each_sorted<prefetch>(n, [&](size_t i) { return kv[i].first; }, [&](size_t i) {
+				bool const b = insert_impl<true>(kv[i].first, kv[i].second).second;
+				if ( inserted ) inserted[i] = b;
+				r += b;
+			});
+			return r;
+		}
+
+		template<bool prefetch = true>
+		size_t erase_batch(key_type const * keys, size_t n, std::pair<value_type, size_t> * erased = nullptr)
+		{
+			size_t r = 0;
+			for_each_sorted<prefetch>(n, [&](size_t i) { return keys[i]; }, [&](size_t i) {
+				auto const e = erase_impl<true>(keys[i], always);
+				if ( erased ) erased[i] = e;
+				r += e.second;
+			});
+			return r;
+		}
+
+		template<bool prefetch = true>
+		size_t find_batch(key_type const * keys, size_t n, value_type ** found)
+		{
+			size_t r = 0;
+			for_each_sorted<prefetch>(n, [&](size_t i) { return keys[i]; }, [&](size_t i) {
+				found[i] = find_near(keys[i]);
+				r += found[i] != nullptr;
+			});
+			return r;
+		}
+
+		// best element, the head node unless that is a tombstone
+		elem & front() { assert( size_ > 0 ); return *begin(); }
+		elem const & front() const { assert( size_ > 0 ); return *begin(); }
+
+		// erase_head() handing back what it took
+		std::pair<key_type, value_type> pop_front()
+		{
+			assert( size_ > 0 );
+			drop_dead_head();
+			std::pair<key_type, value_type> r{ std::move(head_->key), std::move(head_->value) };
+			unlink_head();
+			return r;
+		}
+
+		// the first min(k, size()) elements in list order into out, returns their number
+		size_t top_k(size_t k, std::pair<key_type, value_type> * out) const
+		{
+			return top_k(k, out, std::integral_constant<bool, top_cache>{});
+		}
+
+		/*
+		 * The second node's key and value move into the head node, which keeps its
+		 * full tower, and the second node is unlinked instead. Pointers to the second
+		 * node's value do not survive erase_head(). Tombstones in front of the first
+		 * element go with it.
+		 */
+		void erase_head()
+		{
+			assert( size_ > 0 );
+			drop_dead_head();
+			unlink_head();
+		}
+
+		/*
+		 * sl_tombstones: unlinks up to budget dead nodes, returns how many. Each costs a
+		 * search for its key, the way an erase() without tombstones would; when the
+		 * budget covers all of them and they make up a sixteenth of the nodes or more,
+		 * one walk along level 0 unlinks them together instead. Tombstones the graveyard
+		 * does not know of are left to a walk over what is left of the budget in nodes.
+		 */
+		size_t compact(size_t budget = SIZE_MAX)
+		{
+			static_assert( tombstones, "compact() needs sl_tombstones" );
+			if ( budget >= dead_ && dead_ * 16 >= size_ + dead_ ) return sweep();
+			size_t r = 0;
+			std::array<elem*, N> path;
+			while( r < budget && !graveyard_.empty() ) {
+				key_type const k = graveyard_.back();
+				graveyard_.pop_back();
+				if ( eq( head_->key, k ) ) {
+					// revived ones stay, as do keys erased and compacted away before
+					if ( is_dead(head_) ) {
+						unlink_head();
+						++r;
 					}
+					continue;
+				}
+				if ( !lt( head_->key, k ) ) continue;
+				elem * p = descend_head(k, path.data());
+				elem * q = p->next(0);
+				if ( q && eq( p->next_key(0), k ) && is_dead(q) ) {
+					erase_after(p, q, path);
+					++r;
+				}
+			}
+			finger_valid_ = false;
+			// then the ones it holds no keys for
+			if ( graveyard_.empty() && dead_ > 0 && r < budget )
+				r += budget - r >= size_ + dead_ ? sweep() : sweep_some(budget - r);
+			return r;
+		}
+		size_t tombstone_count() const { return dead_; }
+
+		/*
+		 * sl_stats: calls and forward steps per level of every search, the tower
+		 * heights drawn, and the nodes and bytes held; sl_stats_latency adds a log2
+		 * histogram of each call's duration. Safe to call from another thread while
+		 * the list's own thread carries on, see skip_list_stats. Without the option
+		 * nothing is counted and the hooks compile away.
+		 */
+		skip_list_stats<N> stats() const
+		{
+			static_assert( collect_stats, "stats() needs sl_stats" );
+			return stats_.snapshot();
+		}
+
+		/*
+		 * Cuts and splices in O(log n): split_at() hands the elements from k on to a new
+		 * list, join() appends a list whose keys all order after this one's and leaves
+		 * it empty, false (and both untouched) if they overlap. Only the towers at the
+		 * cut are relinked when the allocator is stateless; pooling allocators own
+		 * their nodes, which are moved into the other list's pool instead, one
+		 * allocation each. Without sl_indexable split_at() also counts the shorter side
+		 * to size both lists.
+		 */
+		skip_list split_at(key_type k)
+		{
+			static_assert( !persistent, "the split off part would need a file of its own" );
+			skip_list r(cmp_, levels_());
+			if ( !head_ ) return r;
+			if ( !lt( head_->key, k ) ) {
+				swap(r);
+				return r;
+			}
+			std::array<elem*, N> path;
+			std::array<size_t, N> rank{};
+			descend_head(k, path.data(), rank.data());
+			elem * s = path[0]->next(0);
+			if ( !s ) return r;
+
+			finger_valid_ = false;
+			auto const mid = std::partition(graveyard_.begin(), graveyard_.end(),
+					[&](key_type const & g) { return lt( g, k ); });
+			r.graveyard_.assign(mid, graveyard_.end());
+			graveyard_.erase(mid, graveyard_.end());
+			if ( !handover ) {
+				std::array<elem*, N> tails;
+				std::array<size_t, N> at;
+				r.template start_with<true>(s, tails, at);
+				r.template append_nodes<true>(s->next(0), 0, tails, at);
+				drop_after(path, rank.data());
+				return r;
+			}
+
+			// s's key and value move into r's head node, which takes over the links
+			// leaving the cut on every level
+			size_t dead = 0;
+			size_t const before = indexable ? rank[0] + 1 : nodes_before(s, &dead);
+			size_t const nodes = size_ + dead_;
+			elem * h = r.head_ = r.make_elem(s->key, N, N, std::move(s->value));
+			h->dead = s->dead;
+			for(size_t i = 0; i < N; ++i) {
+				elem const * o = i < s->height ? s : path[i];
+				h->link_as(i, o);
+				if ( indexable ) h->spans()[i] = i < s->height ? s->spans()[i] : rank[i] + path[i]->spans()[i] - before;
+				path[i]->link(i, nullptr);
+				if ( indexable ) path[i]->spans()[i] = before - rank[i];
+			}
+			destroy_elem(s);
+			if ( collect_stats ) {
+				size_t n = 0, b = 0;
+				for(elem const * p = h->next(0); p; p = p->next(0), ++n) b += p->lines * elem::align;
+				stats_.moved_to(r.stats_, n, b);
+			}
+			r.dead_ = dead_ - dead;
+			r.size_ = nodes - before - r.dead_;
+			size_ = before - dead;
+			dead_ = dead;
+			count_levels();
+			r.count_levels();
+			relevel();
+			r.relevel();
+			top_refill();
+			r.top_refill();
+			publish();
+			return r;
+		}
 
-					if ( !allow_duplicates && p->forwards[0] && eq( p->forwards[0]->key, k ) )
-						return false;
+		bool join(skip_list & o)
+		{
+			static_assert( !persistent, "nodes cannot move between files" );
+			assert( this != &o && side() == o.side() );
+			if ( !o.head_ ) return true;
+			if ( !head_ ) {
+				swap(o);
+				return true;
+			}
+			if ( !lt( head_->key, o.head_->key ) ) return false;
+			std::array<elem*, N> tails;   // the last node on every level
+			std::array<size_t, N> at{};   // and its position
+			descend_head(o.head_->key, tails.data(), at.data());
+			if ( tails[0]->next(0) ) return false;
+
+			finger_valid_ = false;
+			// only what fits, the walk finds the rest
+			size_t const room = graveyard_.capacity() - graveyard_.size();
+			graveyard_.insert(graveyard_.end(), o.graveyard_.begin(),
+					o.graveyard_.begin() + std::min(room, o.graveyard_.size()));
+			if ( !handover ) {
+				append_nodes<true>(o.head_, random_level(), tails, at);
+				o.clear();
+				return true;
+			}
 
-					insert_after(p, k, v, random_level(), forwards);
+			// o's head node keeps its full tower in o only: its key and value move into
+			// a node of a drawn height, which links in between the two
+			elem * h = o.head_;
+			size_t const nodes = size_ + dead_;
+			size_t const lvl = random_level();
+			elem * e = make_elem(h->key, lvl, lvl, std::move(h->value));
+			e->dead = h->dead;
+			for(size_t i = 0; i < N; ++i) {
+				if ( i < lvl ) {
+					e->link_as(i, h);
+					if ( indexable ) e->spans()[i] = h->spans()[i];
+					tails[i]->link(i, e);
+					if ( indexable ) tails[i]->spans()[i] = nodes - at[i];
 				}
 				else {
-					if ( !allow_duplicates && eq(p->key, k) ) return false;
-
-					assert( p == head_ );
-					assert( lt(k, p->key) || eq(p->key, k) ); // k < p->key
+					tails[i]->link_as(i, h);
+					if ( indexable ) tails[i]->spans()[i] = nodes - at[i] + h->spans()[i];
+				}
+			}
+			size_ += o.size_;
+			dead_ += o.dead_;
+			o.destroy_elem(h);
+			stats_.take_footprint(o.stats_);
+			o.abandon();
+			count_levels();
+			top_refill();
+			publish();
+			return true;
+		}
 
-					// insert before head: take current head's forward as new refs, p->forwards
-					if ( p->forwards[0] ) {
-						assert( p->forwards[N-1] != nullptr && "head needs to have all levels");
-						insert_head( k, v, random_level(), p->forwards );
+		/*
+		 * Drop the tail: everything ordered after k, or all but the first n elements.
+		 * One search finds the last node kept on every level, the links there are cut
+		 * and the nodes behind freed in a single walk. Both return the number of
+		 * elements dropped.
+		 */
+		size_t truncate_after(key_type k)
+		{
+			if ( !head_ ) return 0;
+			std::array<elem*, N> path;
+			std::array<size_t, N> rank{};
+			if ( !lt( head_->key, k ) ) {
+				if ( !eq( head_->key, k ) ) return drop_all();
+				path.fill(head_);
+			}
+			else {
+				descend_head(k, path.data(), rank.data());
+				elem * q = path[0]->next(0);
+				if ( q && eq( path[0]->next_key(0), k ) ) {
+					size_t const r = rank[0] + 1;
+					for(size_t i = 0; i < q->height; ++i) {
+						path[i] = q;
+						rank[i] = r;
 					}
-					else {
-						assert( size_ == 1 );
-						elem::set_forwards( forwards, 0, N, p );
-						insert_head( k, v, random_level(), forwards );
-						assert( size_ == 2 );
+				}
+			}
+			return drop_after(path, rank.data());
+		}
+
+		size_t keep_top(size_t n)
+		{
+			if ( n >= size_ ) return 0;
+			if ( n == 0 ) return drop_all();
+			std::array<elem*, N> path;
+			std::array<size_t, N> rank{};
+			if ( indexable ) {
+				// the predecessors of position n, as erase_at() finds them
+				elem * p = head_;
+				size_t r = 0;
+				std::fill(path.begin() + used_levels_, path.end(), head_);
+				for(size_t lvl = used_levels_; lvl > 0;) {
+					--lvl;
+					while( p->next(lvl) && r + p->spans()[lvl] < n ) {
+						r += p->spans()[lvl];
+						p = p->next(lvl);
 					}
-					assert( head_->forwards[N-1] != nullptr && "head needs to have all levels");
-					assert( head_ != p && "new elem inserted as a head" );
+					path[lvl] = p;
+					rank[lvl] = r;
 				}
 			}
 			else {
-				assert( head_ == nullptr );
-				assert( std::all_of(forwards.begin(), forwards.end(),
-							[](auto * p){ return p == nullptr; }));
+				// n is small next to size() where this is used: walk to the last node kept
+				elem * p = head_;
+				for(size_t live = !is_dead(p); live < n; live += !is_dead(p)) p = p->next(0);
+				if ( p == head_ ) path.fill(head_);
+				else {
+					descend_head(p->key, path.data());
+					std::fill(path.begin(), path.begin() + p->height, p);
+				}
+			}
+			return drop_after(path, rank.data());
+		}
 
-				insert_head( k, v, 0, forwards );
-				assert( size_ == 1 );
+	protected:
+		// nodes from one list may be freed through another's allocator
+		constexpr static bool handover = std::is_empty<allocator_type>::value;
+
+		// forgets the nodes without freeing them, another list owns them now
+		void abandon()
+		{
+			head_ = nullptr;
+			used_levels_ = 1;
+			size_ = 0;
+			dead_ = 0;
+			graveyard_.clear();
+			finger_valid_ = false;
+			publish();
+		}
+
+		size_t drop_all()
+		{
+			size_t const r = size_;
+			clear();
+			return r;
+		}
+
+		// unlinks and frees every node after path[0], path[i] being the last node kept
+		// on level i and rank[i] its position; returns the number of elements dropped
+		size_t drop_after(std::array<elem*, N> const & path, size_t const * rank)
+		{
+			mark_dirty();
+			elem * p = path[0]->next(0);
+			size_t const kept = rank[0] + 1;
+			for(size_t i = 0; i < N; ++i) {
+				path[i]->link(i, nullptr);
+				if ( indexable ) path[i]->spans()[i] = kept - rank[i];
 			}
-			return true;
+			size_t r = 0;
+			while( p ) {
+				elem * n = p->next(0);
+				if ( is_dead(p) ) dead_--;
+				else ++r;
+				destroy_elem(p);
+				p = n;
+			}
+			size_ -= r;
+			key_type const last = path[0]->key;
+			graveyard_.erase(std::remove_if(graveyard_.begin(), graveyard_.end(),
+						[&](key_type const & g) { return lt( last, g ); }), graveyard_.end());
+			finger_valid_ = false;
+			shrink_levels();
+			relevel();
+			top_refill();
+			publish();
+			return r;
 		}
 
-		void erase_head()
+		// nodes before s, and the dead ones among them in *dead: walks from the head
+		// and from s at once and stops at the end of the shorter side
+		size_t nodes_before(elem const * s, size_t * dead) const
 		{
-			assert( head_ && size_ > 0 );
-			elem * old = head_;
-			head_ = head_->forwards[0];
-			if ( head_ ) {
-				size_t i = 1;
-				for( ; i < N && head_->forwards[i]; ++i ) ; // skip filled cells
-				for( ; i < N; ++i ) {
-					assert( head_->forwards[i] == nullptr );
-					// copy from old head unless it would cause a loop
-					head_->forwards[i] = ( old->forwards[i] != head_ ) ?
-						old->forwards[i] :
-						head_->forwards[i-1];
+			size_t n = 0, dn = 0, dm = 0;
+			for(elem const * a = head_, * b = s;; a = a->next(0), b = b->next(0), ++n) {
+				if ( a == s ) {
+					*dead = dn;
+					return n;
+				}
+				if ( !b ) {
+					*dead = dead_ - dm;
+					return size_ + dead_ - n;
 				}
+				dn += is_dead(a);
+				dm += is_dead(b);
 			}
+		}
 
-			assert( size_ > 0 );
-			size_--;
-			allocator_type::destroy(old);
-			allocator_type::deallocate(old, 1);
+		void copy_nodes(skip_list const & o)
+		{
+			static_assert( !persistent, "a copy would need a file of its own" );
+			if ( !o.head_ ) return;
+			std::array<elem*, N> tails;
+			std::array<size_t, N> at;
+			start_with<false>(o.head_, tails, at);
+			append_nodes<false>(o.head_->next(0), 0, tails, at);
+			graveyard_ = o.graveyard_;
 		}
 
-		void erase_after( elem * prev, elem * del, std::array<elem*, N> & fwrds)
+		// the head node of an empty list, from p's key, value and tombstone; tails and
+		// at start there
+		template<bool move>
+		void start_with(elem * p, std::array<elem*, N> & tails, std::array<size_t, N> & at)
 		{
-			assert( prev && size_ > 0 );
-			assert( del && del == prev->forwards[0]);
-			assert( fwrds[0] == prev );
+			assert( !head_ );
+			head_ = make_elem(p->key, N, N, take(p->value, std::integral_constant<bool, move>{}));
+			head_->dead = p->dead;
+			++( is_dead(head_) ? dead_ : size_ );
+			tails.fill(head_);
+			at.fill(0);
+		}
 
-			fwrds[0]->forwards[0] = del->forwards[0];
-			for(size_t i = 1; i < N; ++i) {
-				// fixup level pointers
-				if ( del == fwrds[i]->forwards[i] ) {
-					// copy from deleted, unless it would cause a loop, then take previous forwards
-					fwrds[i]->forwards[i] =
-						( del->forwards[i] && del->forwards[i] != fwrds[i] ) ?
-						del->forwards[i] :
-						fwrds[i]->forwards[i-1];
+		/*
+		 * split_at(), join() and copies: new nodes for p and the ones after it, with the
+		 * same heights and tombstones (the first one with height h unless that is 0),
+		 * linked in behind tails, the last node on every level so far at positions at.
+		 * Values are moved out of the old nodes or copied.
+		 */
+		template<bool move>
+		void append_nodes(elem * p, size_t h, std::array<elem*, N> & tails, std::array<size_t, N> & at)
+		{
+			size_t pos = size_ + dead_ - 1;
+			for(; p; p = p->next(0), h = 0) {
+				size_t const lvl = h ? h : p->height;
+				elem * e = make_elem(p->key, lvl, lvl, take(p->value, std::integral_constant<bool, move>{}));
+				e->dead = p->dead;
+				++( is_dead(e) ? dead_ : size_ );
+				++pos;
+				for(size_t i = 0; i < lvl; ++i) {
+					tails[i]->link(i, e);
+					if ( indexable ) tails[i]->spans()[i] = pos - at[i];
+					tails[i] = e;
+					at[i] = pos;
 				}
 			}
+			for(size_t i = 0; i < N; ++i) {
+				tails[i]->link(i, nullptr);
+				if ( indexable ) tails[i]->spans()[i] = pos + 1 - at[i];
+			}
+			count_levels();
+			top_refill();
+			publish();
+		}
+		static value_type const & take(value_type & v, std::false_type) { return v; }
+		static value_type && take(value_type & v, std::true_type) { return std::move(v); }
 
-			assert( size_ > 0 );
-			size_--;
-			allocator_type::destroy(del);
-			allocator_type::deallocate(del, 1);
-		};
+		void unlink_head()
+		{
+			assert( head_ && size_ + dead_ > 0 );
+			mark_dirty();
+			finger_valid_ = false;
+			bool const was_dead = is_dead(head_);
+			elem * h = head_->next(0);
+			if ( h ) {
+				head_->key = std::move(h->key);
+				head_->value = std::move(h->value);
+				head_->dead = h->dead;
+				for( size_t i = 0; i < h->height; ++i ) {
+					assert( head_->next(i) == h );
+					head_->link_as(i, h);
+					if ( indexable ) head_->spans()[i] += h->spans()[i] - 1;
+				}
+				if ( indexable ) {
+					for( size_t i = h->height; i < N; ++i ) head_->spans()[i]--;
+				}
+				top_erased(h);
+				top_front();
+				destroy_elem(h);
+				shrink_levels();
+			}
+			else {
+				// out of the root words before its block is freed
+				elem * const e = head_;
+				head_ = nullptr;
+				size_ = dead_ = 0;
+				publish();
+				destroy_elem(e);
+				return;
+			}
+
+			if ( was_dead ) dead_--;
+			else size_--;
+			relevel();
+			publish();
+		}
 
-		std::pair<value_type, size_t> erase(key_type k)
+		void drop_dead_head()
 		{
-			if ( elem * p = head_ ) {
-				std::array<elem*, N> forwards {};
-				if ( lt( p->key, k ) ) {
-					for(size_t lvl = N; lvl > 0;) {
-						--lvl;
-						while( p->forwards[lvl] && lt( p->forwards[lvl]->key, k) ) {
-							p = p->forwards[lvl];
-						}
-						forwards[lvl] = p;
-						assert( lt(p->key, k) ); // p->key < k, k is strictly greater than p->key
-					}
+			while( tombstones && is_dead(head_) ) unlink_head();
+		}
 
-					elem * q = p->forwards[0];
-					if ( q && eq( q->key, k ) ) {
-						auto r = q->value;
-						erase_after(p, q, forwards);
-						return std::make_pair(r, 1);
-					}
+		// visits up to budget nodes along level 0, from where the last call stopped, and
+		// unlinks the dead ones; the walk starts over from the head after the last node
+		size_t sweep_some(size_t budget)
+		{
+			size_t r = 0;
+			for(; budget > 0 && head_ && is_dead(head_); --budget, ++r) unlink_head();
+			if ( !head_ || dead_ == 0 ) {
+				sweep_resume_ = false;
+				return r;
+			}
+			std::array<elem*, N> last; // the last node before the walk on every level
+			mark_dirty();
+			if ( sweep_resume_ && lt( head_->key, sweep_from_ ) ) descend_head(sweep_from_, last.data());
+			else last.fill(head_);
+			for(; budget > 0 && dead_ > 0; --budget) {
+				elem * q = last[0]->next(0);
+				if ( !q ) break;
+				if ( !is_dead(q) ) {
+					std::fill(last.begin(), last.begin() + q->height, q);
+					continue;
 				}
-				else {
-					if ( eq(p->key, k) ) {
-						auto r = p->value;
-						assert( p == head_ );
-						erase_head();
-						return std::make_pair(r, 1);
+				for(size_t i = 0; i < q->height; ++i) last[i]->link_as(i, q);
+				destroy_elem(q);
+				dead_--;
+				++r;
+			}
+			elem const * q = last[0]->next(0);
+			sweep_resume_ = q != nullptr;
+			if ( q ) sweep_from_ = q->key;
+			finger_valid_ = false;
+			shrink_levels();
+			relevel();
+			publish();
+			return r;
+		}
+
+		// all dead nodes in one pass along level 0
+		size_t sweep()
+		{
+			size_t r = 0;
+			for(; head_ && is_dead(head_); ++r) unlink_head();
+			if ( head_ && dead_ > 0 ) {
+				mark_dirty();
+				std::array<elem*, N> last; // last live node so far taller than the level
+				last.fill(head_);
+				while( elem * q = last[0]->next(0) ) {
+					if ( !is_dead(q) ) {
+						std::fill(last.begin(), last.begin() + q->height, q);
+						continue;
 					}
+					for(size_t i = 0; i < q->height; ++i) last[i]->link_as(i, q);
+					destroy_elem(q);
+					dead_--;
+					++r;
 				}
 			}
-			return std::make_pair(value_type{}, 0);
+			assert( dead_ == 0 );
+			graveyard_.clear();
+			finger_valid_ = false;
+			if ( head_ ) shrink_levels();
+			relevel();
+			publish();
+			return r;
+		}
+
+		void erase_after( elem * prev, elem * del, std::array<elem*, N> & fwrds)
+		{
+			assert( prev && size_ + dead_ > 0 );
+			assert( del && del == prev->next(0));
+			assert( fwrds[0] == prev );
+
+			mark_dirty();
+			for(size_t i = 0; i < del->height; ++i) {
+				assert( fwrds[i]->next(i) == del );
+				fwrds[i]->link_as(i, del);
+				if ( indexable ) fwrds[i]->spans()[i] += del->spans()[i] - 1;
+			}
+			if ( indexable ) {
+				for(size_t i = del->height; i < N; ++i) fwrds[i]->spans()[i]--;
+			}
+
+			top_erased(del);
+			if ( is_dead(del) ) dead_--;
+			else size_--;
+			destroy_elem(del);
+			shrink_levels();
+			relevel();
+			publish();
 		}
 
+	public:
+		std::pair<value_type, size_t> erase(key_type k) { return erase_impl<false>(k, always); }
+
 		struct iter_impl : public std::iterator< std::forward_iterator_tag, elem >
 		{
 			elem * p;
 
-			iter_impl(elem * x) : p(x) {}
-			void next() { p = p->forwards[0]; }
+			iter_impl(elem * x) : p(x) { skip_dead(); }
+			void next() { p = p->next(0); skip_dead(); }
+			void skip_dead() { while( tombstones && p && p->dead ) p = p->next(0); }
 			bool operator==(iter_impl o) const { return p == o.p; }
 			bool operator!=(iter_impl o) const { return p != o.p; }
 			elem & operator*() { return *p; }
@@ -332,79 +1419,836 @@ struct skip_list
 		const_iterator begin() const { return const_iterator{head_}; }
 		const_iterator end() const { return const_iterator{nullptr}; }
 
+		// first element not ordered before k, and first one ordered after it
+		iterator lower_bound(key_type k) const
+		{
+			elem * p = head_;
+			return iterator{ !p || !lt( p->key, k ) ? p : last_before(p, k)->next(0) };
+		}
+		iterator upper_bound(key_type k) const
+		{
+			iterator it = lower_bound(k);
+			if ( it.p && eq( it.p->key, k ) ) ++it;
+			return it;
+		}
+		std::pair<iterator, iterator> equal_range(key_type k) const
+		{
+			iterator const lo = lower_bound(k);
+			return std::make_pair(lo, lo.p && eq( lo.p->key, k ) ? iterator{ lo.p->next(0) } : lo);
+		}
+
+		// f(key, value &) for the elements from lo up to, not including, hi in list order,
+		// so lo comes first (the higher price for bids); returns their number
+		template<typename F>
+		size_t for_each_in_range(key_type lo, key_type hi, F && f) const
+		{
+			size_t r = 0;
+			for(iterator it = lower_bound(lo); it.p && lt( it->key, hi ); ++it, ++r) f(it->key, it->value);
+			return r;
+		}
+
+		// starts from the hint when it precedes k, from the head otherwise
+		iterator find_from(iterator hint, key_type k) const
+		{
+			elem * p = hint.p;
+			if ( !p || !lt( p->key, k ) ) {
+				if ( p && eq( p->key, k ) ) return hint;
+				p = head_;
+				if ( !p || !lt( p->key, k ) ) return iterator{ p && eq( p->key, k ) && !is_dead(p) ? p : nullptr };
+			}
+			std::array<elem*, N> path;
+			size_t top;
+			p = climb(p, k, path.data(), top)->next(0);
+			return iterator{ p && eq( p->key, k ) && !is_dead(p) ? p : nullptr };
+		}
+
+		// returns the element with key k, inserted or already present; indexable lists
+		// need every predecessor's position and take the finger path instead
+		iterator insert(iterator hint, key_type k, value_type v)
+		{
+			elem * p = hint.p;
+			if ( indexable ) {
+				return iterator{ insert_impl<true>(k, std::move(v)).first };
+			}
+			if ( !p || !lt( p->key, k ) ) {
+				return iterator{ insert_impl<false>(k, std::move(v)).first };
+			}
+
+			stats_timer const t(stats_, skip_list_stats<N>::insert_op);
+			stats_.search(skip_list_stats<N>::insert_op);
+			std::array<elem*, N> path;
+			size_t top;
+			p = climb(p, k, path.data(), top);
+			if ( !allow_duplicates && p->next(0) && eq( p->next_key(0), k ) ) {
+				revive(p->next(0), std::move(v));
+				return iterator{ p->next(0) };
+			}
+
+			size_t const lvl = random_level();
+			if ( lvl > top + 1 ) {
+				// taller than the climb went: the upper predecessors precede the hint
+				elem * q = head_;
+				for(size_t l = N - 1; l > top; --l) {
+					size_t n = 0;
+					for(; q->next(l) && lt( q->next_key(l), k ); ++n) q = q->next(l);
+					stats_.hops(l, n);
+					path[l] = q;
+				}
+			}
+			finger_valid_ = false;
+			return iterator{ insert_after(k, lvl, path, nullptr, std::move(v)) };
+		}
+
+		/*
+		 * One search each, the node found or linked in where it ends: try_emplace()
+		 * constructs the value from args only if k is new, insert_or_assign() overwrites
+		 * the value of a present k. modify() applies f(value &) in place and tells
+		 * whether k was there; erase_if() erases k when pred(value &), which may change
+		 * the value first (a fill taking a level's quantity to zero), and returns how
+		 * many elements went.
+		 */
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(key_type k, Args &&... args)
+		{
+			auto const r = insert_impl<false>(k, std::forward<Args>(args)...);
+			return std::make_pair(iterator{r.first}, r.second);
+		}
+		template<typename V>
+		std::pair<iterator, bool> insert_or_assign(key_type k, V && v)
+		{
+			// v is only moved from when the node is new
+			auto const r = insert_impl<false>(k, std::forward<V>(v));
+			if ( !r.second ) r.first->value = std::forward<V>(v);
+			return std::make_pair(iterator{r.first}, r.second);
+		}
+		template<typename F>
+		bool modify(key_type k, F && f)
+		{
+			value_type * v = find(k);
+			if ( v ) f(*v);
+			return v != nullptr;
+		}
+		template<typename Pred>
+		size_t erase_if(key_type k, Pred && pred) { return erase_impl<false>(k, std::forward<Pred>(pred)).second; }
+
+		// number of elements ordered before k, whether k is present or not
+		size_t rank(key_type k) const
+		{
+			static_assert( indexable, "rank() needs sl_indexable" );
+			elem const * p = head_;
+			if ( !p || !lt( p->key, k ) ) return 0;
+
+			size_t r = 0;
+			for(size_t lvl = used_levels_; lvl > 0;) {
+				--lvl;
+				while( p->next(lvl) && lt( p->next_key(lvl), k) ) {
+					r += p->spans()[lvl];
+					p = p->next(lvl);
+				}
+			}
+			return r + 1;
+		}
+
+		// i-th element in order, end() past the last one
+		iterator at(size_t i) const
+		{
+			static_assert( indexable, "at() needs sl_indexable" );
+			if ( i >= size_ ) return end();
+
+			elem * p = head_;
+			size_t r = 0;
+			for(size_t lvl = used_levels_; lvl > 0;) {
+				--lvl;
+				while( p->next(lvl) && r + p->spans()[lvl] <= i ) {
+					r += p->spans()[lvl];
+					p = p->next(lvl);
+				}
+			}
+			assert( r == i );
+			return iterator{p};
+		}
+
+		std::pair<value_type, size_t> erase_at(size_t i)
+		{
+			static_assert( indexable, "erase_at() needs sl_indexable" );
+			if ( i >= size_ ) return std::make_pair(value_type{}, 0);
+			if ( i == 0 ) {
+				auto r = head_->value;
+				erase_head();
+				return std::make_pair(std::move(r), 1);
+			}
+
+			// the predecessors of position i on each level form the finger for its key
+			elem * p = head_;
+			size_t r = 0;
+			for(size_t lvl = N; lvl > used_levels_;) {
+				--lvl;
+				finger_[lvl] = head_;
+				finger_rank_[lvl] = 0;
+			}
+			for(size_t lvl = used_levels_; lvl > 0;) {
+				--lvl;
+				while( p->next(lvl) && r + p->spans()[lvl] < i ) {
+					r += p->spans()[lvl];
+					p = p->next(lvl);
+				}
+				finger_[lvl] = p;
+				finger_rank_[lvl] = r;
+			}
+			finger_valid_ = true;
+
+			elem * q = p->next(0);
+			auto v = q->value;
+			erase_after(p, q, finger_);
+			return std::make_pair(v, 1);
+		}
+
 	protected:
 
+		/*
+		 * assign_sorted() and load(): links the nodes next(k, v, h) yields in one pass,
+		 * with h levels, or 1 + ctz(position) for h = 0: perfectly balanced towers, the
+		 * layout the p=1/2 geometric distribution only approximates. Keys not after the
+		 * previous one are dropped; false if any of them was out of order rather than
+		 * repeated.
+		 */
+		template<typename Next>
+		bool build_sorted(Next next)
+		{
+			clear();
+			key_type k{};
+			value_type v{};
+			size_t h = 0;
+			if ( !next(k, v, h) ) return true;
+
+			insert_head(k, 0, std::move(v));
+			std::array<elem*, N> tails;   // last node on every level so far
+			std::array<size_t, N> at;     // and its position
+			tails.fill(head_);
+			at.fill(0);
+
+			bool ordered = true;
+			size_t pos = 0;
+			mark_dirty();
+			while( next(k, v, h) ) {
+				if ( !lt( tails[0]->key, k ) ) {
+					ordered = ordered && eq( tails[0]->key, k );
+					continue;
+				}
+				++pos;
+				h = h ? std::min(h, N) : std::min<size_t>(N, 1 + __builtin_ctzll(pos));
+				elem * e = make_elem(k, h, h, std::move(v));
+				// linked in before the next node is, recover() must not follow its links
+				if ( persistent ) e->set_forwards(0, h, nullptr);
+				for(size_t i = 0; i < h; ++i) {
+					tails[i]->link(i, e);
+					if ( indexable ) tails[i]->spans()[i] = pos - at[i];
+					tails[i] = e;
+					at[i] = pos;
+				}
+			}
+			size_ = pos + 1;
+			for(size_t i = 0; i < N; ++i) {
+				tails[i]->link(i, nullptr);
+				if ( indexable ) tails[i]->spans()[i] = size_ - at[i];
+			}
+			count_levels();
+			top_refill();
+			publish();
+			return ordered;
+		}
+
+		// persistent lists keep what attach() needs in the arena's root words: layout,
+		// head offset, size, side, dead nodes, and a flag mark_dirty() raises before a
+		// call relinks nodes and publish() lowers once the other words are in step
+		static uint64_t layout()
+		{
+			return uint64_t(1) << 63 | uint64_t(sizeof(key_type)) | uint64_t(sizeof(value_type)) << 8
+				| uint64_t(N) << 16 | uint64_t(Options) << 24;
+		}
+		void publish() { publish(std::integral_constant<bool, persistent>{}); }
+		void publish(std::false_type) {}
+		void publish(std::true_type)
+		{
+			if ( uint64_t * r = alloc_.root() ) {
+				r[1] = head_ ? uint64_t(reinterpret_cast<char const*>(head_) - alloc_.base()) : 0;
+				r[2] = size_;
+				r[4] = dead_;
+				// a kill is no reason to reorder stores, the compiler must not either
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+				r[5] = 0;
+			}
+		}
+		void mark_dirty() { mark_dirty(std::integral_constant<bool, persistent>{}); }
+		void mark_dirty(std::false_type) {}
+		void mark_dirty(std::true_type)
+		{
+			if ( uint64_t * r = alloc_.root() ) {
+				r[5] = 1;
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+			}
+		}
+
+		/*
+		 * attach() of a file left dirty. Level 0 changes by single stores, so it still
+		 * holds every node, with or without the one the call was linking in or out; the
+		 * levels above, spans, cached keys, size and dead count are rebuilt from it.
+		 * A link to a node that cannot be one ends the list, a key not after the one
+		 * before (a move through the head cut short) drops that node. The element the
+		 * call was changing may come back as it was before or half changed.
+		 */
+		void recover()
+		{
+			if ( head_ && ( !sound(head_) || head_->height != N ) ) head_ = nullptr;
+			size_t pos = 0, dead = 0;
+			if ( head_ ) {
+				std::array<elem*, N> last; // last node so far taller than the level
+				std::array<size_t, N> at;  // and its position
+				last.fill(head_);
+				at.fill(0);
+				dead = is_dead(head_);
+				// stray links going round in a circle run out of steps
+				for(size_t steps = alloc_.used_bytes() / elem::align; steps > 0; --steps) {
+					elem * q = last[0]->next(0);
+					if ( !q || !sound(q) ) break;
+					if ( !lt( last[0]->key, q->key ) ) {
+						last[0]->link_as(0, q);
+						continue;
+					}
+					++pos;
+					dead += is_dead(q);
+					for(size_t i = 0; i < q->height; ++i) {
+						last[i]->link(i, q);
+						if ( indexable ) last[i]->spans()[i] = pos - at[i];
+						last[i] = q;
+						at[i] = pos;
+					}
+				}
+				for(size_t i = 0; i < N; ++i) {
+					last[i]->link(i, nullptr);
+					if ( indexable ) last[i]->spans()[i] = pos + 1 - at[i];
+				}
+			}
+			dead_ = dead;
+			size_ = head_ ? pos + 1 - dead : 0;
+			publish();
+		}
+		// sl_top_cache upkeep: e now follows prev and is counted in size_; del is unlinked
+		// but still counted; the head node took another key; or a rebuild from scratch
+		void top_inserted(elem * prev, elem * e) { top_inserted(prev, e, std::integral_constant<bool, top_cache>{}); }
+		void top_erased(elem * del) { top_erased(del, std::integral_constant<bool, top_cache>{}); }
+		void top_front() { top_front(std::integral_constant<bool, top_cache>{}); }
+		void top_refill() { top_refill(std::integral_constant<bool, top_cache>{}); }
+		bool top_valid() const { return top_valid(std::integral_constant<bool, top_cache>{}); }
+		void top_inserted(elem *, elem *, std::false_type) {}
+		void top_erased(elem *, std::false_type) {}
+		void top_front(std::false_type) {}
+		void top_refill(std::false_type) {}
+		bool top_valid(std::false_type) const { return true; }
+		void top_inserted(elem * prev, elem * e, std::true_type)
+		{
+			size_t const n = std::min(size_ - 1, size_t(top_levels));
+			for(size_t j = 0; j < n && j + 1 < top_levels; ++j) {
+				if ( top_.nodes[j] != prev ) continue;
+				for(size_t i = std::min(n, top_levels - 1); i > j + 1; --i) {
+					top_.nodes[i] = top_.nodes[i - 1];
+					top_.keys[i] = top_.keys[i - 1];
+				}
+				top_.nodes[j + 1] = e;
+				top_.keys[j + 1] = e->key;
+				return;
+			}
+		}
+		void top_erased(elem * del, std::true_type)
+		{
+			size_t const n = std::min(size_, size_t(top_levels));
+			for(size_t j = 1; j < n; ++j) {
+				if ( top_.nodes[j] != del ) continue;
+				for(size_t i = j; i + 1 < n; ++i) {
+					top_.nodes[i] = top_.nodes[i + 1];
+					top_.keys[i] = top_.keys[i + 1];
+				}
+				if ( size_ > top_levels ) {
+					// the node behind the cached ones moves up, del is already unlinked
+					elem * l = top_.nodes[top_levels - 2]->next(0);
+					top_.nodes[top_levels - 1] = l;
+					top_.keys[top_levels - 1] = l->key;
+				}
+				return;
+			}
+		}
+		void top_front(std::true_type)
+		{
+			top_.nodes[0] = head_;
+			top_.keys[0] = head_->key;
+		}
+		void top_refill(std::true_type)
+		{
+			size_t j = 0;
+			for(elem * p = head_; p && j < top_levels; p = p->next(0), ++j) {
+				top_.nodes[j] = p;
+				top_.keys[j] = p->key;
+			}
+		}
+		bool top_valid(std::true_type) const
+		{
+			size_t j = 0;
+			for(elem const * p = head_; p && j < top_levels; p = p->next(0), ++j) {
+				if ( top_.nodes[j] != p || !eq( top_.keys[j], p->key ) ) return false;
+			}
+			return true;
+		}
+
+		size_t top_k(size_t k, std::pair<key_type, value_type> * out, std::false_type) const
+		{
+			size_t r = 0;
+			for(iterator it{head_}; it.p && r < k; ++it) out[r++] = std::make_pair(it->key, it->value);
+			return r;
+		}
+		size_t top_k(size_t k, std::pair<key_type, value_type> * out, std::true_type) const
+		{
+			size_t const n = std::min(k, std::min(size_, size_t(top_levels)));
+			for(size_t i = 0; i < n; ++i) out[i] = std::make_pair(top_.keys[i], top_.nodes[i]->value);
+			if ( n < k && n == top_levels ) {
+				size_t r = n;
+				for(elem const * p = top_.nodes[n - 1]->next(0); p && r < k; p = p->next(0)) out[r++] = std::make_pair(p->key, p->value);
+				return r;
+			}
+			return n;
+		}
+
+		bool attached(std::false_type) const { return false; }
+		bool attached(std::true_type) const { return alloc_.is_open(); }
+
+		bool owns(elem const * p) const { return owns(p, std::integral_constant<bool, persistent>{}); }
+		bool owns(elem const *, std::false_type) const { return true; }
+		bool owns(elem const * p, std::true_type) const
+		{
+			char const * c = reinterpret_cast<char const*>(p);
+			return c >= alloc_.base() && c < alloc_.base() + alloc_.used_bytes()
+				&& ( c - alloc_.base() ) % elem::align == 0;
+		}
+		// p lies in the arena with a size class and height a node can have, see recover()
+		bool sound(elem const * p) const
+		{
+			if ( !owns(p) || p->lines == 0 || p->lines > head_lines || ( p->lines & ( p->lines - 1 ) ) ) return false;
+			char const * c = reinterpret_cast<char const*>(p);
+			return size_t(alloc_.base() + alloc_.used_bytes() - c) >= p->lines * elem::align
+				&& p->height > 0 && p->height <= p->capacity();
+		}
+
+		// from p, which precedes k: the last node before k
+		elem * last_before(elem * p, key_type k) const
+		{
+			for(size_t lvl = used_levels_; lvl > 0;) {
+				--lvl;
+				size_t n = 0;
+				for(elem * q; (q = next_on(p, lvl)) && lt( p->next_key(lvl), k ); ++n) p = q;
+				stats_.hops(lvl, n);
+				assert( p->next(lvl) == nullptr || ge( p->next(lvl)->key, k) );
+			}
+			return p;
+		}
+
+		// next node on level lvl; sl_prefetch also requests the next one a level down,
+		// where the search goes on if this one is past the key, so both misses overlap
+		static elem * next_on(elem const * p, size_t lvl)
+		{
+			if ( prefetch_search && lvl ) __builtin_prefetch(p->next(lvl - 1));
+			return p->next(lvl);
+		}
+
+		// walks forward from p (which precedes k, at position r) on level lvl and each one
+		// below, recording the last node before k per level; returns the one on level 0
+		elem * descend(elem * p, size_t lvl, key_type k, elem ** path,
+				size_t * rank = nullptr, size_t r = 0) const
+		{
+			for(;; --lvl) {
+				size_t n = 0;
+				for(elem * q; (q = next_on(p, lvl)) && lt( p->next_key(lvl), k ); p = q, ++n) {
+					if ( indexable ) r += p->spans()[lvl];
+				}
+				stats_.hops(lvl, n);
+				assert( lt(p->key, k) ); // p->key < k, k is strictly greater than p->key
+				path[lvl] = p;
+				if ( indexable && rank ) rank[lvl] = r;
+				if ( lvl == 0 ) return p;
+			}
+		}
+
+		// descend() from the head on the highest level in use; above it the head is the
+		// last node before k on every level, at position 0
+		elem * descend_head(key_type k, elem ** path, size_t * rank = nullptr) const
+		{
+			for(size_t i = used_levels_; i < N; ++i) {
+				path[i] = head_;
+				if ( indexable && rank ) rank[i] = 0;
+			}
+			return descend(head_, used_levels_ - 1, k, path, rank);
+		}
+
+		// after an unlink: the top levels may have been left with the head only
+		void shrink_levels()
+		{
+			while( used_levels_ > 1 && !head_->next(used_levels_ - 1) ) --used_levels_;
+		}
+		void count_levels()
+		{
+			used_levels_ = uint8_t(N);
+			if ( head_ ) shrink_levels();
+			else used_levels_ = 1;
+		}
+
+		// from a node preceding k: climbs its tower, hopping to taller nodes, while the next
+		// node is still before k, then descends; path is filled up to level top
+		elem * climb(elem * p, key_type k, elem ** path, size_t & top) const
+		{
+			size_t lvl = 0;
+			for(;;) {
+				size_t const h = p->height - 1;
+				while( lvl < h && p->next(lvl+1) && lt( p->next_key(lvl+1), k ) ) ++lvl;
+				elem * q = p->next(lvl);
+				if ( lvl < h || !q || !lt( p->next_key(lvl), k ) ) break;
+				stats_.hops(lvl, 1);
+				p = q;
+			}
+			top = lvl;
+			return descend(p, lvl, k, path);
+		}
+
+		// Pugh's search finger: climb finger_ until it brackets k, descend from there
+		elem * finger_descend(key_type k)
+		{
+			assert( head_ && lt( head_->key, k ) );
+			size_t lvl = 0;
+			if ( !finger_valid_ ) {
+				finger_valid_ = true;
+				return descend_head(k, finger_.data(), finger_rank_.data());
+			}
+			if ( lt( finger_[0]->key, k ) ) {
+				while( lvl + 1 < N && finger_[lvl+1]->next(lvl+1)
+						&& lt( finger_[lvl+1]->next_key(lvl+1), k ) ) ++lvl;
+			}
+			else {
+				while( lvl < N && !lt( finger_[lvl]->key, k ) ) ++lvl;
+				if ( lvl == N ) return descend_head(k, finger_.data(), finger_rank_.data());
+			}
+			return descend(finger_[lvl], lvl, k, finger_.data(), finger_rank_.data(), finger_rank_[lvl]);
+		}
+
+		template<bool prefetch, typename KeyOf, typename F>
+		void for_each_sorted(size_t n, KeyOf key_of, F f)
+		{
+			bool sorted = true;
+			for(size_t i = 1; i < n && sorted; ++i) sorted = !lt( key_of(i), key_of(i-1) );
+
+			// packet sized batches sort on the stack; stable, so repeated keys are applied
+			// in the caller's order
+			constexpr size_t small = 64;
+			size_t local[small];
+			std::vector<size_t> heap;
+			size_t * order = local;
+			if ( !sorted ) {
+				if ( n > small ) {
+					heap.resize(n);
+					order = heap.data();
+				}
+				for(size_t i = 0; i < n; ++i) order[i] = i;
+				auto const by_key = [&](size_t a, size_t b) { return lt( key_of(a), key_of(b) ); };
+				if ( n > small ) std::stable_sort(order, order + n, by_key);
+				else {
+					for(size_t i = 1; i < n; ++i) {
+						size_t const x = order[i];
+						size_t j = i;
+						for(; j > 0 && by_key(x, order[j-1]); --j) order[j] = order[j-1];
+						order[j] = x;
+					}
+				}
+			}
+			for(size_t j = 0; j < n; ++j) {
+				f( sorted ? j : order[j] );
+				if ( prefetch && finger_valid_ ) {
+					// the first nodes finger_descend() compares against
+					for(size_t i = 0; i < 2 && i < N; ++i) {
+						if ( elem * q = finger_[i]->next(i) ) __builtin_prefetch(q);
+					}
+				}
+			}
+		}
+
+		// the node with key k and whether it is new; args only make its value if it is
+		template<bool near, typename... Args>
+		std::pair<elem*, bool> insert_impl(key_type k, Args &&... args)
+		{
+			//dump(std::cout << "-- insert (" << k << "), into:\n", "\n") << std::endl;
+			stats_timer const t(stats_, skip_list_stats<N>::insert_op);
+			stats_.search(skip_list_stats<N>::insert_op);
+			if ( elem * p = head_ ) {
+				if ( lt( p->key, k ) ) {
+					p = near ? finger_descend(k) : descend_head(k, finger_.data(), finger_rank_.data());
+					finger_valid_ = true;
+
+					if ( !allow_duplicates && p->next(0) && eq( p->next_key(0), k ) )
+						return std::make_pair(p->next(0), revive(p->next(0), std::forward<Args>(args)...));
+
+					return std::make_pair(insert_after(k, random_level(), finger_, finger_rank_.data(),
+								std::forward<Args>(args)...), true);
+				}
+				else {
+					if ( !allow_duplicates && eq(p->key, k) ) return std::make_pair(p, revive(p, std::forward<Args>(args)...));
+
+					assert( p == head_ );
+					assert( lt(k, p->key) || eq(p->key, k) ); // k < p->key
+
+					// insert before head: the current head's key and value move down into a new node
+					insert_head( k, random_level(), std::forward<Args>(args)... );
+					assert( head_->height == N && "head needs to have all levels");
+					assert( head_ == p && eq(head_->key, k) && "new elem inserted as a head" );
+				}
+			}
+			else {
+				assert( head_ == nullptr );
+
+				insert_head( k, 0, std::forward<Args>(args)... );
+				assert( size_ == 1 );
+			}
+			return std::make_pair(head_, true);
+		}
+
+		// erases k if pred(value &) agrees, handing back the value
+		template<bool near, typename Pred>
+		std::pair<value_type, size_t> erase_impl(key_type k, Pred && pred)
+		{
+			stats_timer const t(stats_, skip_list_stats<N>::erase_op);
+			stats_.search(skip_list_stats<N>::erase_op);
+			if ( elem * p = head_ ) {
+				if ( lt( p->key, k ) ) {
+					p = near ? finger_descend(k) : descend_head(k, finger_.data(), finger_rank_.data());
+					finger_valid_ = true;
+
+					elem * q = p->next(0);
+					if ( q && eq( p->next_key(0), k ) && !is_dead(q) && pred(q->value) ) {
+						auto r = std::move(q->value);
+						if ( tombstones ) bury(q);
+						else erase_after(p, q, finger_);
+						return std::make_pair(std::move(r), 1);
+					}
+				}
+				else {
+					if ( eq(p->key, k) && !is_dead(p) && pred(p->value) ) {
+						auto r = std::move(p->value);
+						assert( p == head_ );
+						if ( tombstones ) bury(p);
+						else unlink_head();
+						return std::make_pair(std::move(r), 1);
+					}
+				}
+			}
+			return std::make_pair(value_type{}, 0);
+		}
+
+		static bool always(value_type const &) { return true; }
+		bool is_dead(elem const * p) const { return tombstones && p->dead; }
+		value_type * live_value(elem * p) const { return is_dead(p) ? nullptr : &(p->value); }
+		static std::vector<key_type> empty_graveyard()
+		{
+			std::vector<key_type> g;
+			if ( tombstones ) g.reserve(graveyard_capacity);
+			return g;
+		}
+		void bury(elem * p)
+		{
+			mark_dirty();
+			p->dead = 1;
+			size_--;
+			dead_++;
+			if ( graveyard_.size() < graveyard_.capacity() ) graveyard_.push_back(p->key);
+			publish();
+		}
+		// insert() of a key whose node is a tombstone: true if it was
+		template<typename... Args>
+		bool revive(elem * p, Args &&... args)
+		{
+			if ( !is_dead(p) ) return false;
+			mark_dirty();
+			p->dead = 0;
+			p->value = value_type(std::forward<Args>(args)...);
+			size_++;
+			dead_--;
+			publish();
+			return true;
+		}
+
+		/*
+		 * sl_adaptive_levels: towers are geometric with p = 1/2 but no taller than
+		 * adaptive_cap(n) for the n nodes the list holds at the draw, about log2 n, so
+		 * the cap rises as the list grows. relevel() lowers it again once the list has
+		 * shrunk to a quarter of the size its tallest towers were drawn for, cutting
+		 * them down in a walk along the first level above the new cap.
+		 */
+		static size_t adaptive_cap(size_t n) { return std::min(size_t(N), size_t(2 + floor_log2(n + 1))); }
+
+		void relevel()
+		{
+			if ( !use_adaptive_dist || !head_ ) return;
+			size_t const cap = adaptive_cap(size_ + dead_);
+			if ( used_levels_ <= cap + 1 ) return;
+			mark_dirty();
+			for(elem * p = head_->next(cap); p;) {
+				elem * n = p->next(cap);
+				p->height = uint8_t(cap);
+				p = n;
+			}
+			for(size_t i = cap; i < used_levels_; ++i) {
+				head_->link(i, nullptr);
+				if ( indexable ) head_->spans()[i] = size_ + dead_;
+			}
+			used_levels_ = uint8_t(cap);
+			shrink_levels();
+			finger_valid_ = false;
+		}
+
 		size_t random_level()
 		{
-			static std::random_device rd;
+			using dist = level_distribution<N>;
+			uint64_t const x = levels_();
 			size_t r = N;
 			if ( use_uniform_dist )
 			{
-				std::uniform_int_distribution<int> dist_{1,N};
-				r = dist_(rd);
+				r = dist::uniform(x);
 			}
 			else if ( use_log_dist )
 			{
-				std::uniform_int_distribution<int> dist_{2,1<<N};
-				r = std::log2(dist_(rd));
+				r = dist::log(x);
 			}
 			else if ( use_rev_log_dist )
 			{
-				std::uniform_int_distribution<int> dist_{2,1<<N};
-				r = N-std::log2(dist_(rd))+1;
+				r = dist::rev_log(x);
 			}
 			else if ( use_sqrt_dist )
 			{
-				std::uniform_int_distribution<int> dist_{1,N*N};
-				r = std::sqrt(dist_(rd));
+				r = dist::sqrt(x);
 			}
 			else if ( use_rev_sqrt_dist )
 			{
-				std::uniform_int_distribution<int> dist_{1,N*N};
-				r = N-std::sqrt(dist_(rd))+1;
+				r = dist::rev_sqrt(x);
+			}
+			else if ( use_adaptive_dist )
+			{
+				r = dist::geometric(x, adaptive_cap(size_ + dead_));
 			}
 			assert( r != 0 );
 			assert( 1 <= r && r <= N );
+			stats_.height(r);
 			return r;
 		}
 
-		void insert_after(elem* p, key_type k, value_type v,
-				size_t lvl, std::array<elem*, N> const fwrds)
+		template<typename... Args>
+		elem * make_elem(key_type k, size_t height, size_t levels, Args &&... args)
 		{
-			elem * e = allocator_type::allocate(1);
-			allocator_type::construct(e, k, v);
+			size_t const lines = elem::lines_for(levels);
+			elem * e = reinterpret_cast<elem*>( alloc_.allocate(lines) );
+			alloc_.construct(e, k, height, lines, std::forward<Args>(args)...);
+			stats_.allocated(lines * elem::align);
+			return e;
+		}
 
-			//elem::dump_distances(std::cout << "-- insert_after (p=" << p << ", lvl=" << lvl << ", "
-			//	<< k << "->" << v << ", fwrds=", nullptr, fwrds) << ")" << std::endl;
+		void destroy_elem(elem * e)
+		{
+			size_t const lines = e->lines;
+			stats_.freed(lines * elem::align);
+			e->~elem();
+			alloc_.deallocate(reinterpret_cast<cache_line*>(e), lines);
+		}
 
-			size_t n = fwrds[N-1] == head_ ? N : lvl;
-			for(size_t i = 0; i < n; ++i)
+		// rank holds the positions of the fwrds nodes, indexable lists only; the value is
+		// constructed from args
+		template<typename... Args>
+		elem * insert_after(key_type k, size_t lvl, std::array<elem*, N> const & fwrds,
+				size_t const * rank, Args &&... args)
+		{
+			elem * e = make_elem(k, lvl, lvl, std::forward<Args>(args)...);
+			mark_dirty();
+
+			//elem::dump_distances(std::cout << "-- insert_after (lvl=" << lvl << ", "
+			//	<< k << ", fwrds=", nullptr, fwrds.data(), N) << ")" << std::endl;
+
+			for(size_t i = 0; i < lvl; ++i)
 			{
-				//TODO: embed ranvom level
 				elem * f = fwrds[i];
-				elem * aux = f->forwards[i];
-				f->forwards[i] = e;
-				e->forwards[i] = aux;
+				e->link_as(i, f);
+				f->link(i, e);
+				if ( indexable ) {
+					// e lands right behind fwrds[0], at position rank[0] + 1
+					size_t const d = rank[0] - rank[i];
+					e->spans()[i] = f->spans()[i] - d;
+					f->spans()[i] = d + 1;
+				}
+			}
+			if ( indexable ) {
+				for(size_t i = lvl; i < N; ++i) fwrds[i]->spans()[i]++;
 			}
 			size_++;
+			if ( lvl > used_levels_ ) used_levels_ = uint8_t(lvl);
+			top_inserted(fwrds[0], e);
+			publish();
+			return e;
 		}
 
-		void insert_head( key_type k, value_type v, size_t lvl, std::array<elem*, N> const & fwrds)
+		// the current head's key and value move into a new node of height lvl right
+		// behind the head node, which then takes k and a value made from args
+		template<typename... Args>
+		void insert_head( key_type k, size_t lvl, Args &&... args )
 		{
-			elem * e = allocator_type::allocate(1);
-			allocator_type::construct(e, k, v, fwrds);
+			elem * p = head_;
+			mark_dirty();
+			finger_valid_ = false;
 
 			//elem::dump_distances(std::cout << "-- insert_head (lvl=" << lvl << ", "
-			//		<< k << "->" << v << ", fwrds=", nullptr, fwrds) << ")" << std::endl;
+			//		<< k << ", fwrds=", nullptr, p ? p->forwards : nullptr, p ? N : 0) << ")" << std::endl;
 
-			elem * p = head_;
-			head_ = e;
-			head_->set_forwards(0, lvl, p);
-			if ( p ) p->set_forwards(lvl, N, nullptr);
-			size_++;
+			if ( p ) {
+				assert( p->height == N );
+				elem * e = make_elem(std::move(p->key), lvl, lvl, std::move(p->value));
+				e->dead = p->dead;
+				p->dead = 0;
+				for(size_t i = 0; i < lvl; ++i) e->link_as(i, p);
+				p->set_forwards(0, lvl, e);
+				if ( indexable ) {
+					std::copy( p->spans(), p->spans() + lvl, e->spans() );
+					std::fill( p->spans(), p->spans() + lvl, 1 );
+					for(size_t i = lvl; i < N; ++i) p->spans()[i]++;
+				}
+				p->key = k;
+				p->value = value_type(std::forward<Args>(args)...);
+				size_++;
+				if ( lvl > used_levels_ ) used_levels_ = uint8_t(lvl);
+				top_inserted(p, e);
+			}
+			else {
+				head_ = make_elem(k, N, N, std::forward<Args>(args)...);
+				head_->set_forwards(0, N, nullptr);
+				if ( indexable ) std::fill( head_->spans(), head_->spans() + N, 1 );
+				size_++;
+			}
+			top_front();
+			publish();
 		}
 
 };
 
+template<typename key_type, typename value_type,
+	template<typename, size_t> class Allocator = aligned_allocator>
+using ascending_skip_list = skip_list<key_type, value_type, skip_list_levels<key_type, value_type>(4),
+	Allocator, xorshift64star, std::less<key_type> >;
 
+template<typename key_type, typename value_type,
+	template<typename, size_t> class Allocator = aligned_allocator>
+using descending_skip_list = skip_list<key_type, value_type, skip_list_levels<key_type, value_type>(4),
+	Allocator, xorshift64star, std::greater<key_type> >;
 
+template<typename key_type, typename value_type,
+	typename Compare = side_compare<key_type>,
+	template<typename, size_t> class Allocator = aligned_allocator>
+using indexable_skip_list = skip_list<key_type, value_type, skip_list_levels<key_type, value_type>(4, sl_indexable),
+	Allocator, xorshift64star, Compare, sl_indexable>;
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * What a skip_list with sl_stats has done so far, copied out by stats(). Counters
+ * are read one by one while the writer goes on, so each is exact but they may be a
+ * few operations apart from each other.
+ */
+template<size_t N>
+struct skip_list_stats
+{
+	enum op { find_op, insert_op, erase_op, ops };
+	constexpr static size_t latency_buckets = 32;
+
+	uint64_t calls[ops];          // searches by kind, batches counting every key
+	uint64_t hops[N];             // forward steps taken on each level, over all searches
+	uint64_t heights[N + 1];      // towers drawn by the level generator, by height
+	uint64_t nodes;               // held now, the head node included
+	uint64_t bytes;               // and the cache lines they take
+	uint64_t allocations;
+	uint64_t frees;               // nodes freed or handed to another list
+	// sl_stats_latency: ticks per call (TSC cycles where there is one), bucket b
+	// counting those taking [2^(b-1), 2^b)
+	uint64_t latency[ops][latency_buckets];
+};
+
+namespace detail {
+
+	inline uint64_t ticks()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	/*
+	 * skip_list's sl_stats policy. Only the list's own thread writes, so a counter
+	 * goes up by a relaxed load and store rather than a locked add, and a reader on
+	 * another thread still sees every update whole. Without sl_stats every call is
+	 * an empty inline function and the list holds an empty member.
+	 */
+	template<size_t N, bool Enabled, bool Latency>
+	class stats_recorder
+	{
+		public:
+			using snapshot_type = skip_list_stats<N>;
+			using op = typename snapshot_type::op;
+
+			struct timer
+			{
+				timer(stats_recorder &, op) {}
+				~timer() {}
+			};
+
+			void search(op) {}
+			void hops(size_t, size_t) {}
+			void height(size_t) {}
+			void allocated(size_t) {}
+			void freed(size_t) {}
+			void released() {}
+			void moved_to(stats_recorder &, size_t, size_t) {}
+			void take_footprint(stats_recorder &) {}
+			void swap_footprint(stats_recorder &) {}
+	};
+
+	template<size_t N, bool Latency>
+	class stats_recorder<N, true, Latency>
+	{
+		public:
+			using snapshot_type = skip_list_stats<N>;
+			using op = typename snapshot_type::op;
+			constexpr static size_t ops = snapshot_type::ops;
+			constexpr static size_t buckets = snapshot_type::latency_buckets;
+
+		protected:
+			using counter = std::atomic<uint64_t>;
+
+			counter calls_[ops];
+			counter hops_[N];
+			counter heights_[N + 1];
+			counter nodes_;
+			counter bytes_;
+			counter allocations_;
+			counter frees_;
+			counter latency_[Latency ? ops : 1][Latency ? buckets : 1];
+
+			static void add(counter & c, uint64_t n) { c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+			static void sub(counter & c, uint64_t n) { c.store(c.load(std::memory_order_relaxed) - n, std::memory_order_relaxed); }
+			static uint64_t get(counter const & c) { return c.load(std::memory_order_relaxed); }
+
+			template<size_t M> static void zero(counter (&c)[M]) { for(counter & x : c) x.store(0, std::memory_order_relaxed); }
+
+		public:
+			stats_recorder()
+			{
+				zero(calls_);
+				zero(hops_);
+				zero(heights_);
+				for(auto & l : latency_) zero(l);
+				nodes_.store(0);
+				bytes_.store(0);
+				allocations_.store(0);
+				frees_.store(0);
+			}
+			stats_recorder(stats_recorder const &) = delete;
+			stats_recorder & operator=(stats_recorder const &) = delete;
+
+			void search(op k) { add(calls_[k], 1); }
+			void hops(size_t lvl, size_t n) { if ( n ) add(hops_[lvl], n); }
+			void height(size_t h) { add(heights_[h], 1); }
+			void allocated(size_t b)
+			{
+				add(nodes_, 1);
+				add(bytes_, b);
+				add(allocations_, 1);
+			}
+			void freed(size_t b)
+			{
+				sub(nodes_, 1);
+				sub(bytes_, b);
+				add(frees_, 1);
+			}
+			// every node gone at once
+			void released()
+			{
+				add(frees_, get(nodes_));
+				nodes_.store(0, std::memory_order_relaxed);
+				bytes_.store(0, std::memory_order_relaxed);
+			}
+			// n nodes of b bytes in all went over to o without being freed
+			void moved_to(stats_recorder & o, size_t n, size_t b)
+			{
+				sub(nodes_, n);
+				sub(bytes_, b);
+				add(o.nodes_, n);
+				add(o.bytes_, b);
+			}
+			void take_footprint(stats_recorder & o) { o.moved_to(*this, get(o.nodes_), get(o.bytes_)); }
+			void swap_footprint(stats_recorder & o)
+			{
+				uint64_t const n = get(nodes_), b = get(bytes_);
+				nodes_.store(get(o.nodes_), std::memory_order_relaxed);
+				bytes_.store(get(o.bytes_), std::memory_order_relaxed);
+				o.nodes_.store(n, std::memory_order_relaxed);
+				o.bytes_.store(b, std::memory_order_relaxed);
+			}
+
+			// times its scope into k's latency histogram
+			struct timer
+			{
+				stats_recorder & r;
+				op const k;
+				uint64_t const t0;
+
+				timer(stats_recorder & x, op o) : r(x), k(o), t0(Latency ? ticks() : 0) {}
+				timer(timer const &) = delete;
+				~timer()
+				{
+					if ( !Latency ) return;
+					uint64_t const d = ticks() - t0;
+					add(r.latency_[Latency ? k : 0][d ? std::min<size_t>(buckets - 1, 64 - __builtin_clzll(d)) : 0], 1);
+				}
+			};
+
+			snapshot_type snapshot() const
+			{
+				snapshot_type s;
+				for(size_t i = 0; i < ops; ++i) s.calls[i] = get(calls_[i]);
+				for(size_t i = 0; i < N; ++i) s.hops[i] = get(hops_[i]);
+				for(size_t i = 0; i <= N; ++i) s.heights[i] = get(heights_[i]);
+				s.nodes = get(nodes_);
+				s.bytes = get(bytes_);
+				s.allocations = get(allocations_);
+				s.frees = get(frees_);
+				for(size_t i = 0; i < ops; ++i) {
+					for(size_t j = 0; j < buckets; ++j) s.latency[i][j] = Latency ? get(latency_[Latency ? i : 0][Latency ? j : 0]) : 0;
+				}
+				return s;
+			}
+	};
+
+}
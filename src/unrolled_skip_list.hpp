@@ -0,0 +1,443 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include <vector>
+#include <utility>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+#include <functional>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "utils.hpp"
+#include "allocator.hpp"
+#include "random.hpp"
+#include "skip_list.hpp"
+
+namespace detail {
+
+	// key types simd_count_before() handles with the instruction sets compiled for
+	template<typename K> struct simd_key : std::false_type {};
+
+	inline uint64_t first_lanes(size_t n) { return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1; }
+
+#if defined(__SSE2__)
+	template<> struct simd_key<int32_t> : std::true_type {};
+
+	// how many of the first n of B sorted keys go before k: keys > k when desc, keys < k
+	// otherwise. keys is cache line aligned; lanes from n on are masked off.
+	template<size_t B> inline size_t simd_count_before(int32_t const * keys, size_t n, int32_t k, bool desc)
+	{
+		uint64_t m = 0;
+#if defined(__AVX2__)
+		static_assert( B % 8 == 0, "whole vectors" );
+		__m256i const kv = _mm256_set1_epi32(k);
+		for(size_t j = 0; j < B; j += 8) {
+			__m256i const v = _mm256_load_si256(reinterpret_cast<__m256i const *>(keys + j));
+			__m256i const c = desc ? _mm256_cmpgt_epi32(v, kv) : _mm256_cmpgt_epi32(kv, v);
+			m |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(c)))) << j;
+		}
+#else
+		static_assert( B % 4 == 0, "whole vectors" );
+		__m128i const kv = _mm_set1_epi32(k);
+		for(size_t j = 0; j < B; j += 4) {
+			__m128i const v = _mm_load_si128(reinterpret_cast<__m128i const *>(keys + j));
+			__m128i const c = desc ? _mm_cmpgt_epi32(v, kv) : _mm_cmpgt_epi32(kv, v);
+			m |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(c)))) << j;
+		}
+#endif
+		return __builtin_popcountll(m & first_lanes(n));
+	}
+#endif
+
+#if defined(__SSE4_2__) || defined(__AVX2__)
+	template<> struct simd_key<int64_t> : std::true_type {};
+
+	template<size_t B> inline size_t simd_count_before(int64_t const * keys, size_t n, int64_t k, bool desc)
+	{
+		uint64_t m = 0;
+#if defined(__AVX2__)
+		static_assert( B % 4 == 0, "whole vectors" );
+		__m256i const kv = _mm256_set1_epi64x(k);
+		for(size_t j = 0; j < B; j += 4) {
+			__m256i const v = _mm256_load_si256(reinterpret_cast<__m256i const *>(keys + j));
+			__m256i const c = desc ? _mm256_cmpgt_epi64(v, kv) : _mm256_cmpgt_epi64(kv, v);
+			m |= uint64_t(uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(c)))) << j;
+		}
+#else
+		static_assert( B % 2 == 0, "whole vectors" );
+		__m128i const kv = _mm_set1_epi64x(k);
+		for(size_t j = 0; j < B; j += 2) {
+			__m128i const v = _mm_load_si128(reinterpret_cast<__m128i const *>(keys + j));
+			__m128i const c = desc ? _mm_cmpgt_epi64(v, kv) : _mm_cmpgt_epi64(kv, v);
+			m |= uint64_t(uint32_t(_mm_movemask_pd(_mm_castsi128_pd(c)))) << j;
+		}
+#endif
+		return __builtin_popcountll(m & first_lanes(n));
+	}
+#endif
+}
+
+/*
+ * Unrolled skip list: every node holds a sorted block of up to B keys, with their
+ * values in a separate array, and one tower for the whole block, so a cache line of
+ * keys is searched per hop instead of one key. The default B fills a line with keys.
+ * For int32_t / int64_t keys under side_compare, std::less or std::greater the block
+ * is searched with SSE2 / SSE4.2, or AVX2 when compiled for it; anything else falls
+ * back to a linear scan.
+ *
+ * A full block splits in halves on insert. A block falling under B/4 keys on erase
+ * merges with its successor when they fit into 3/4 of a block, or takes keys over
+ * from it otherwise; an emptied block is unlinked. The towers are searched by each
+ * block's first key. Keys and values are moved with memmove, so both have to be
+ * trivially copyable.
+ */
+template<typename key_type, typename value_type,
+	size_t B = cache_line_size / sizeof(key_type),
+	size_t N = 24,
+	template<typename, size_t> class Allocator = aligned_allocator,
+	typename LevelGenerator = xorshift64star,
+	typename Compare = side_compare<key_type> >
+struct unrolled_skip_list
+{
+	public:
+		using side_t = uint8_t;
+		using key_compare = Compare;
+		constexpr static size_t block_keys = B;
+		constexpr static size_t max_levels = N;
+
+	protected:
+		static bool eq(key_type a, key_type b) { return a==b; }
+		bool lt(key_type a, key_type b) const { return cmp_(a, b); }
+
+		// keys come first, at the start of the (cache line aligned) allocation
+		struct alignas(void*) block
+		{
+			constexpr static size_t align = cache_line_size;
+			key_type keys[B];
+			value_type values[B];
+			uint8_t count;
+			uint8_t height;
+			uint8_t lines;
+			block * forwards[];
+
+			constexpr static size_t capacity_of(size_t lines)
+			{
+				return lines * align > sizeof(block) ? (lines * align - sizeof(block)) / sizeof(void*) : 0;
+			}
+			constexpr static size_t lines_for(size_t h)
+			{
+				size_t l = 1;
+				while( capacity_of(l) < h ) l <<= 1;
+				return l;
+			}
+		};
+
+		static_assert( N > 0 && N <= UINT8_MAX && B >= 4 && B <= 64, "heights and counts are kept in bytes" );
+		static_assert( std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<value_type>::value,
+				"block entries are moved with memmove" );
+
+		using path_type = std::array<block*, N>;
+
+		Compare cmp_;
+		size_t size_ = 0;
+		block * head_;     // keyless, all N levels
+		LevelGenerator levels_;
+
+	public:
+		using allocator_type = Allocator< cache_line, block::align >;
+
+	protected:
+		allocator_type alloc_;
+
+	public:
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		unrolled_skip_list(side_t sd) : cmp_{sd}, levels_(random_seed()) { init(); }
+		explicit unrolled_skip_list(Compare cmp = Compare()) : cmp_(cmp), levels_(random_seed()) { init(); }
+
+		template<typename C = Compare, typename = typename std::enable_if<
+			std::is_same<C, side_compare<key_type> >::value>::type>
+		unrolled_skip_list(side_t sd, uint64_t seed) : cmp_{sd}, levels_(seed) { init(); }
+		unrolled_skip_list(Compare cmp, uint64_t seed) : cmp_(cmp), levels_(seed) { init(); }
+
+		unrolled_skip_list(unrolled_skip_list const &) = delete;
+		unrolled_skip_list & operator=(unrolled_skip_list const &) = delete;
+
+		~unrolled_skip_list()
+		{
+			clear();
+			destroy_block(head_);
+		}
+
+		bool empty() const { return size_ == 0; }
+		size_t size() const { return size_; }
+		key_compare key_comp() const { return cmp_; }
+		int side() const { return compare_side(cmp_); }
+		allocator_type const & get_allocator() const { return alloc_; }
+
+		void clear()
+		{
+			for(block * p = head_->forwards[0]; p; ) {
+				block * n = p->forwards[0];
+				destroy_block(p);
+				p = n;
+			}
+			std::fill(head_->forwards, head_->forwards + N, nullptr);
+			size_ = 0;
+		}
+
+		// blocks in use, and the cache lines they take
+		size_t blocks() const
+		{
+			size_t r = 0;
+			for(block const * p = head_->forwards[0]; p; p = p->forwards[0], ++r);
+			return r;
+		}
+		size_t lines() const
+		{
+			size_t r = 0;
+			for(block const * p = head_->forwards[0]; p; p = p->forwards[0]) r += p->lines;
+			return r;
+		}
+
+		std::vector< std::pair<key_type, value_type> > to_vector() const
+		{
+			std::vector< std::pair<key_type, value_type> > r;
+			r.reserve( size_ );
+			for(block const * p = head_->forwards[0]; p; p = p->forwards[0]) {
+				for(size_t i = 0; i < p->count; ++i) r.push_back( std::make_pair(p->keys[i], p->values[i]) );
+			}
+			return r;
+		}
+
+		value_type * find(key_type k) const
+		{
+			block * p = descend<false>(k, nullptr);
+			if ( p == head_ ) return nullptr;
+			size_t const i = position(p, k);
+			return ( i < p->count && eq( p->keys[i], k ) ) ? &(p->values[i]) : nullptr;
+		}
+		bool contains(key_type k) const { return find(k) != nullptr; }
+
+		bool insert(key_type k, value_type v)
+		{
+			path_type path;
+			block * p = descend<false>(k, path.data());
+			if ( p == head_ ) {
+				// k goes first: into the first block, which then sits at the end of the path
+				p = head_->forwards[0];
+				if ( !p ) {
+					p = make_block(random_level());
+					for(size_t i = 0; i < p->height; ++i) {
+						p->forwards[i] = nullptr;
+						head_->forwards[i] = p;
+					}
+				}
+				for(size_t i = 0; i < p->height; ++i) path[i] = p;
+			}
+
+			size_t i = position(p, k);
+			if ( i < p->count && eq( p->keys[i], k ) ) return false;
+			if ( p->count == B ) {
+				block * q = split(p, path);
+				if ( i > p->count ) {
+					i -= p->count;
+					p = q;
+				}
+			}
+			std::memmove(p->keys + i + 1, p->keys + i, (p->count - i) * sizeof(key_type));
+			std::memmove(p->values + i + 1, p->values + i, (p->count - i) * sizeof(value_type));
+			p->keys[i] = k;
+			p->values[i] = v;
+			p->count++;
+			size_++;
+			return true;
+		}
+
+		std::pair<value_type, size_t> erase(key_type k)
+		{
+			path_type path;
+			block * p = descend<true>(k, path.data());
+			block * c = p->forwards[0];
+			// k either opens the next block, whose predecessors path now holds, or sits
+			// inside p past its first key
+			if ( c && eq( c->keys[0], k ) ) p = c;
+			else if ( p == head_ ) return std::make_pair(value_type{}, 0);
+
+			size_t const i = position(p, k);
+			if ( i >= p->count || !eq( p->keys[i], k ) ) return std::make_pair(value_type{}, 0);
+
+			auto r = p->values[i];
+			remove(p, i, path);
+			return std::make_pair(r, 1);
+		}
+
+		void erase_head()
+		{
+			block * p = head_->forwards[0];
+			assert( p && size_ > 0 );
+			path_type path;
+			path.fill(head_);
+			remove(p, 0, path);
+		}
+
+		/*
+		 * Iterators walk the blocks key by key; it->key and it->value read the entry
+		 * through a small proxy, as the keys and values live in separate arrays.
+		 */
+		struct entry
+		{
+			key_type const & key;
+			value_type & value;
+			entry * operator->() { return this; }
+		};
+
+		struct iterator
+		{
+			block * b;
+			size_t i;
+
+			bool operator==(iterator o) const { return b == o.b && i == o.i; }
+			bool operator!=(iterator o) const { return !(*this == o); }
+			entry operator*() const { return entry{b->keys[i], b->values[i]}; }
+			entry operator->() const { return **this; }
+			iterator & operator++()
+			{
+				if ( ++i == b->count ) {
+					b = b->forwards[0];
+					i = 0;
+				}
+				return *this;
+			}
+			iterator operator++(int) { iterator tmp{*this}; ++*this; return tmp; }
+		};
+
+		iterator begin() const { return iterator{head_->forwards[0], 0}; }
+		iterator end() const { return iterator{nullptr, 0}; }
+
+	protected:
+		void init()
+		{
+			head_ = make_block(N);
+			head_->count = 0;
+			std::fill(head_->forwards, head_->forwards + N, nullptr);
+		}
+
+		size_t random_level() { return level_distribution<N>::rev_log(levels_()); }
+
+		/*
+		 * Last block whose first key goes before k (strict) or not after k; path, when
+		 * given, gets the last such block on every level. The head when there is none.
+		 */
+		template<bool strict>
+		block * descend(key_type k, block ** path) const
+		{
+			block * p = head_;
+			for(size_t lvl = N; lvl > 0;) {
+				--lvl;
+				for(block * q; (q = p->forwards[lvl]) && ( strict ? lt( q->keys[0], k ) : !lt( k, q->keys[0] ) ); ) p = q;
+				if ( path ) path[lvl] = p;
+			}
+			return p;
+		}
+
+		// index of the first key in p not going before k
+		size_t position(block const * p, key_type k) const { return position(p, k, detail::simd_key<key_type>{}); }
+
+		size_t position(block const * p, key_type k, std::false_type) const
+		{
+			size_t i = 0;
+			while( i < p->count && lt( p->keys[i], k ) ) ++i;
+			return i;
+		}
+
+		size_t position(block const * p, key_type k, std::true_type) const
+		{
+			int const sd = compare_side(cmp_);
+			if ( sd < 0 ) return position(p, k, std::false_type{});
+			return detail::simd_count_before<B>(p->keys, p->count, k, sd == 1);
+		}
+
+		// moves the upper half of the full block p into a new block behind it; path[i]
+		// is the last block on level i not after p
+		block * split(block * p, path_type const & path)
+		{
+			block * q = make_block(random_level());
+			size_t const h = B / 2;
+			q->count = B - h;
+			std::memcpy(q->keys, p->keys + h, q->count * sizeof(key_type));
+			std::memcpy(q->values, p->values + h, q->count * sizeof(value_type));
+			p->count = h;
+			for(size_t i = 0; i < q->height; ++i) {
+				block * pred = i < p->height ? p : path[i];
+				q->forwards[i] = pred->forwards[i];
+				pred->forwards[i] = q;
+			}
+			return q;
+		}
+
+		// drops entry i of p; path[i] is the last block on level i before p, or p itself
+		// on the levels p is on when i is not its first key
+		void remove(block * p, size_t i, path_type const & path)
+		{
+			std::memmove(p->keys + i, p->keys + i + 1, (p->count - i - 1) * sizeof(key_type));
+			std::memmove(p->values + i, p->values + i + 1, (p->count - i - 1) * sizeof(value_type));
+			p->count--;
+			size_--;
+
+			if ( p->count == 0 ) {
+				for(size_t l = 0; l < p->height; ++l) {
+					assert( path[l]->forwards[l] == p );
+					path[l]->forwards[l] = p->forwards[l];
+				}
+				destroy_block(p);
+				return;
+			}
+			block * s = p->forwards[0];
+			if ( p->count >= B / 4 || !s ) return;
+
+			if ( p->count + s->count <= B - B / 4 ) {
+				std::memcpy(p->keys + p->count, s->keys, s->count * sizeof(key_type));
+				std::memcpy(p->values + p->count, s->values, s->count * sizeof(value_type));
+				p->count += s->count;
+				for(size_t l = 0; l < s->height; ++l) {
+					block * pred = l < p->height ? p : path[l];
+					assert( pred->forwards[l] == s );
+					pred->forwards[l] = s->forwards[l];
+				}
+				destroy_block(s);
+			}
+			else {
+				// even the two out; s keeps its place with a later first key
+				size_t const n = (s->count - p->count) / 2;
+				std::memcpy(p->keys + p->count, s->keys, n * sizeof(key_type));
+				std::memcpy(p->values + p->count, s->values, n * sizeof(value_type));
+				std::memmove(s->keys, s->keys + n, (s->count - n) * sizeof(key_type));
+				std::memmove(s->values, s->values + n, (s->count - n) * sizeof(value_type));
+				p->count += n;
+				s->count -= n;
+			}
+		}
+
+		block * make_block(size_t height)
+		{
+			size_t const lines = block::lines_for(height);
+			block * b = reinterpret_cast<block*>( alloc_.allocate(lines) );
+			b->count = 0;
+			b->height = height;
+			b->lines = lines;
+			return b;
+		}
+
+		void destroy_block(block * b)
+		{
+			alloc_.deallocate(reinterpret_cast<cache_line*>(b), b->lines);
+		}
+};
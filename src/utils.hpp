@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 template<typename R, uintptr_t align, typename T> constexpr inline R mask_ptr(T * p)
 {
 	static_assert( align && !(align & (align-1)), "power of 2" );
@@ -12,3 +15,37 @@ template<typename T> constexpr inline bool is_power_of_two(T n)
 	return (n > 0) & ( 0 == ( n & (n-1) ));
 }
 
+// n > 0
+inline unsigned floor_log2(uint64_t n) { return 63 - __builtin_clzll(n); }
+// n > 1
+inline unsigned ceil_log2(uint64_t n) { return 64 - __builtin_clzll(n - 1); }
+
+inline uint64_t isqrt(uint64_t n)
+{
+	uint64_t r = 0;
+	uint64_t b = uint64_t(1) << 62;
+	while( b > n ) b >>= 2;
+	for( ; b; b >>= 2 ) {
+		if ( n >= r + b ) {
+			n -= r + b;
+			r = (r >> 1) + b;
+		}
+		else {
+			r >>= 1;
+		}
+	}
+	return r;
+}
+
+// maps a full-range random x onto [0, n) without division (Lemire's multiply-shift)
+inline uint64_t bounded(uint64_t x, uint64_t n)
+{
+	return static_cast<uint64_t>( (static_cast<unsigned __int128>(x) * n) >> 64 );
+}
+
+constexpr size_t cache_line_size = 64;
+
+struct alignas(cache_line_size) cache_line
+{
+	unsigned char bytes[cache_line_size];
+};
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "concurrent_skip_list.hpp"
+
+using concurrent_type = concurrent_skip_list<int32_t, int64_t>;
+
+struct concurrent_skip_list_test : public ::testing::TestWithParam<int8_t> {};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, concurrent_skip_list_test, ::testing::Values(0,1));
+
+TEST_P(concurrent_skip_list_test, matches_set_single_threaded)
+{
+	concurrent_type x(GetParam(), 7);
+	concurrent_type::reader rd(x);
+	std::set<int> ref;
+	std::mt19937 rnd(3);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 1000;
+		switch( rnd() % 4 )
+		{
+			case 0:
+			case 1:
+				EXPECT_EQ( ref.insert(k).second, x.insert(k, k * 3) );
+				break;
+			case 2:
+				EXPECT_EQ( ref.erase(k), x.erase(k).second );
+				break;
+			case 3:
+				if ( !ref.empty() ) {
+					ref.erase( GetParam() ? *ref.rbegin() : *ref.begin() );
+					x.erase_head();
+				}
+				break;
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+	}
+
+	auto const v = rd.to_vector();
+	ASSERT_EQ( ref.size(), v.size() );
+	EXPECT_TRUE( std::equal(v.begin(), v.end(), ref.begin(), [](std::pair<int32_t, int64_t> const & a, int b) {
+		return a.first == b;
+	}) || std::equal(v.begin(), v.end(), ref.rbegin(), [](std::pair<int32_t, int64_t> const & a, int b) {
+		return a.first == b;
+	}) );
+	for(int k = 0; k < 1000; ++k) {
+		int64_t val = -1;
+		EXPECT_EQ( ref.count(k) == 1, rd.find(k, val) );
+		if ( ref.count(k) ) {
+			EXPECT_EQ( k * 3, val );
+		}
+	}
+
+	x.clear();
+	EXPECT_TRUE( x.empty() );
+	EXPECT_EQ( 0u, rd.top(10, [](int32_t, int64_t) {}) );
+}
+
+TEST(concurrent_skip_list_test, pinned_reader_holds_back_reclamation)
+{
+	concurrent_type x(uint8_t(0), 1);
+	concurrent_type::reader rd(x);
+	for(int i = 0; i < 10; ++i) x.insert(i, i);
+
+	// the callback runs pinned: nodes unlinked meanwhile must survive it
+	rd.top(1, [&](int32_t k, int64_t v) {
+		x.erase(k);
+		x.erase_head();
+		x.reclaim();
+		EXPECT_EQ( 2u, x.retired() );
+		EXPECT_EQ( k, v );
+	});
+	x.reclaim();
+	EXPECT_EQ( 0u, x.retired() );
+	EXPECT_EQ( 8u, x.size() );
+}
+
+// aligned_allocator that gives out a set number of allocations, then null
+template<typename T, size_t Align>
+struct rationed_allocator : aligned_allocator<T, Align>
+{
+	static int left;
+	static T * allocate(size_t n)
+	{
+		if ( left <= 0 ) return nullptr;
+		--left;
+		return aligned_allocator<T, Align>::allocate(n);
+	}
+};
+template<typename T, size_t Align> int rationed_allocator<T, Align>::left = 0;
+
+TEST(concurrent_skip_list_test, insert_fails_out_of_memory)
+{
+	using rationed_type = concurrent_skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), rationed_allocator>;
+	rationed_type::allocator_type::left = 11;
+	rationed_type x(uint8_t(0), 1);
+	rationed_type::reader rd(x);
+	for(int i = 0; i < 10; ++i) EXPECT_TRUE( x.insert(i, i) );
+	EXPECT_FALSE( x.insert(10, 10) );
+	EXPECT_EQ( 10u, x.size() );
+	EXPECT_FALSE( rd.contains(10) );
+	EXPECT_TRUE( rd.contains(9) );
+}
+
+TEST(concurrent_skip_list_test, slots_run_out)
+{
+	epoch_domain d;
+	std::vector<size_t> slots;
+	for(size_t i = 0; i < epoch_domain::max_threads; ++i) slots.push_back(d.enter());
+	EXPECT_THROW( d.enter(), std::length_error );
+	d.leave(slots[5]);
+	EXPECT_EQ( slots[5], d.enter() );
+}
+
+/*
+ * One writer churns the book while readers check what they can see: every value
+ * matches its key, levels come out strictly ordered, and the keys the writer never
+ * touches are always there. Run under -fsanitize=thread (SANITIZE_THREAD=ON).
+ */
+TEST_P(concurrent_skip_list_test, one_writer_many_readers)
+{
+	concurrent_type x(GetParam(), 11);
+	int const side = GetParam();
+	constexpr int keys = 4096;
+	constexpr int readers = 4;
+
+	// even keys stay put, odd ones come and go
+	for(int k = 0; k < keys; k += 2) x.insert(k, k * 3);
+
+	std::atomic<bool> done{false};
+	std::atomic<size_t> bad{0};
+	std::vector<std::thread> threads;
+	for(int t = 0; t < readers; ++t) {
+		threads.emplace_back([&, t]{
+			concurrent_type::reader rd(x);
+			std::mt19937 rnd(t);
+			while( !done.load(std::memory_order_acquire) ) {
+				int const k = rnd() % keys;
+				int64_t v = -1;
+				bool const found = rd.find(k, v);
+				if ( (k % 2 == 0 && !found) || (found && v != k * 3) ) bad++;
+
+				int32_t prev = side ? INT32_MAX : INT32_MIN;
+				rd.top(16, [&](int32_t key, int64_t val) {
+					if ( val != key * 3 || (side ? key >= prev : key <= prev) ) bad++;
+					prev = key;
+				});
+			}
+		});
+	}
+
+	std::mt19937 rnd(99);
+	for(int i = 0; i < 200000; ++i) {
+		int const k = 2 * (rnd() % (keys / 2)) + 1;
+		if ( rnd() % 2 ) x.insert(k, k * 3);
+		else x.erase(k);
+	}
+	done.store(true, std::memory_order_release);
+	for(auto & t : threads) t.join();
+
+	EXPECT_EQ( 0u, bad.load() );
+	x.reclaim();
+	EXPECT_EQ( 0u, x.retired() );
+	for(int k = 0; k < keys; k += 2) EXPECT_TRUE( x.contains(k) ) << k;
+}
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <string>
+
+#include "skip_list.hpp"
+
+using indexed_type = indexable_skip_list<int32_t, int32_t>;
+
+struct indexable_skip_list_test : public ::testing::TestWithParam<int8_t> {};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, indexable_skip_list_test, ::testing::Values(0,1));
+
+struct span_probe : indexed_type
+{
+	using indexed_type::indexed_type;
+	using indexed_type::elem;
+
+	// span i of a node must count the level 0 steps to its next node on level i,
+	// or to the end of the list
+	::testing::AssertionResult spans_ok() const
+	{
+		if ( !head_ ) return ::testing::AssertionSuccess();
+
+		std::vector<elem const *> order;
+		for(elem const * p = head_; p; p = p->next(0)) order.push_back(p);
+		if ( order.size() != size_ ) return ::testing::AssertionFailure() << "size mismatch";
+
+		for(size_t pos = 0; pos < order.size(); ++pos)
+		{
+			elem const * p = order[pos];
+			for(size_t i = 0; i < p->height; ++i)
+			{
+				size_t to = order.size();
+				if ( p->next(i) ) {
+					to = pos + 1;
+					while( order[to] != p->next(i) ) ++to;
+				}
+				if ( p->spans()[i] != to - pos )
+					return ::testing::AssertionFailure() << "node " << pos << " level " << i
+						<< " span " << p->spans()[i] << " expected " << to - pos;
+			}
+		}
+		return ::testing::AssertionSuccess();
+	}
+};
+
+TEST_P(indexable_skip_list_test, rank_and_at_follow_order)
+{
+	indexed_type x(GetParam(), 3);
+
+	EXPECT_EQ( 0u, x.rank(10) );
+	EXPECT_TRUE( x.at(0) == x.end() );
+
+	for(int i = 0; i < 100; ++i) x.insert(i * 2, i);
+
+	auto const v = x.to_vector();
+	for(size_t i = 0; i < v.size(); ++i)
+	{
+		ASSERT_TRUE( x.at(i) != x.end() );
+		EXPECT_EQ( v[i].first, x.at(i)->key );
+		EXPECT_EQ( i, x.rank(v[i].first) );
+	}
+	EXPECT_TRUE( x.at(v.size()) == x.end() );
+
+	// keys between two entries rank like their successor
+	EXPECT_EQ( x.rank(v[10].first), x.rank(GetParam() ? v[10].first + 1 : v[10].first - 1) );
+}
+
+TEST_P(indexable_skip_list_test, erase_at)
+{
+	indexed_type x(GetParam(), 4);
+	for(int i = 0; i < 10; ++i) x.insert(i, i * 10);
+
+	auto v = x.to_vector();
+	EXPECT_EQ( std::make_pair(v[3].second, size_t(1)), x.erase_at(3) );
+	EXPECT_EQ( std::make_pair(v[0].second, size_t(1)), x.erase_at(0) );
+	EXPECT_EQ( size_t(0), x.erase_at(8).second );
+	EXPECT_EQ( 8u, x.size() );
+
+	v.erase(v.begin() + 3);
+	v.erase(v.begin());
+	EXPECT_EQ( v, x.to_vector() );
+}
+
+TEST_P(indexable_skip_list_test, spans_under_random_ops)
+{
+	span_probe x(GetParam(), 17);
+	std::set<int> ref;
+	std::mt19937 rnd(11);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 2000;
+		switch( rnd() % 7 )
+		{
+			case 0: x.insert(k, k); ref.insert(k); break;
+			case 1: x.insert_near(k, k); ref.insert(k); break;
+			case 2: x.insert(x.find_from(x.begin(), k), k, k); ref.insert(k); break;
+			case 3: x.erase(k); ref.erase(k); break;
+			case 4: x.erase_near(k); ref.erase(k); break;
+			case 5:
+				if ( !ref.empty() ) {
+					size_t const n = rnd() % ref.size();
+					int const key = x.at(n)->key;
+					EXPECT_EQ( size_t(1), x.erase_at(n).second );
+					ref.erase(key);
+				}
+				break;
+			case 6:
+				if ( !ref.empty() ) {
+					ref.erase(x.begin()->key);
+					x.erase_head();
+				}
+				break;
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+		if ( i % 500 == 0 ) {
+			ASSERT_TRUE( x.spans_ok() ) << "op " << i;
+		}
+	}
+	ASSERT_TRUE( x.spans_ok() );
+
+	auto const v = x.to_vector();
+	for(size_t i = 0; i < v.size(); ++i) {
+		EXPECT_EQ( i, x.rank(v[i].first) );
+		EXPECT_EQ( v[i].first, x.at(i)->key );
+	}
+}
+
+TEST_P(indexable_skip_list_test, assign_sorted_sets_spans)
+{
+	std::vector< std::pair<int32_t, int32_t> > v;
+	for(int i = 0; i < 3000; ++i) v.push_back(std::make_pair(GetParam() ? -i : i, i));
+
+	span_probe x(GetParam(), 2);
+	x.assign_sorted(v.begin(), v.end());
+	ASSERT_TRUE( x.spans_ok() );
+	for(size_t i = 0; i < v.size(); i += 7) {
+		EXPECT_EQ( v[i].first, x.at(i)->key );
+		EXPECT_EQ( i, x.rank(v[i].first) );
+	}
+}
+
+TEST_P(indexable_skip_list_test, load_sets_spans)
+{
+	span_probe x(GetParam(), 3);
+	for(int i = 0; i < 3000; ++i) x.insert(i * 7 % 3001, i);
+	std::string snapshot;
+	ASSERT_TRUE( x.save([&](char const * p, size_t n) { snapshot.append(p, n); return true; }, true) );
+
+	span_probe y(GetParam(), 4);
+	size_t at = 0;
+	ASSERT_TRUE( y.load([&](char * p, size_t n) {
+		if ( snapshot.size() - at < n ) return false;
+		snapshot.copy(p, n, at);
+		at += n;
+		return true;
+	}) );
+	EXPECT_TRUE( y.spans_ok() );
+	for(size_t i = 0; i < y.size(); i += 7) EXPECT_EQ( i, y.rank(y.at(i)->key) );
+}
+
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "lock_free_skip_list.hpp"
+
+using lock_free_type = lock_free_skip_list<int32_t, int64_t>;
+
+struct lock_free_skip_list_test : public ::testing::TestWithParam<int8_t> {};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, lock_free_skip_list_test, ::testing::Values(0,1));
+
+TEST_P(lock_free_skip_list_test, matches_set_single_threaded)
+{
+	lock_free_type x(GetParam());
+	lock_free_type::handle h(x, 5);
+	std::set<int> ref;
+	std::mt19937 rnd(3);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 1000;
+		switch( rnd() % 4 )
+		{
+			case 0:
+			case 1:
+				EXPECT_EQ( ref.insert(k).second, h.insert(k, k * 3) );
+				break;
+			case 2:
+				EXPECT_EQ( ref.erase(k), h.erase(k).second );
+				break;
+			case 3:
+				if ( !ref.empty() ) {
+					int const best = GetParam() ? *ref.rbegin() : *ref.begin();
+					auto const r = h.erase_head();
+					EXPECT_EQ( size_t(1), r.second );
+					EXPECT_EQ( best, r.first.first );
+					EXPECT_EQ( best * 3, r.first.second );
+					ref.erase(best);
+				}
+				else {
+					EXPECT_EQ( size_t(0), h.erase_head().second );
+				}
+				break;
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+	}
+
+	for(int k = 0; k < 1000; ++k) {
+		int64_t v = -1;
+		EXPECT_EQ( ref.count(k) == 1, h.find(k, v) );
+		if ( ref.count(k) ) {
+			EXPECT_EQ( k * 3, v );
+		}
+	}
+	auto const v = x.to_vector();
+	ASSERT_EQ( ref.size(), v.size() );
+	for(size_t i = 1; i < v.size(); ++i) EXPECT_TRUE( x.key_comp()(v[i-1].first, v[i].first) );
+}
+
+/*
+ * Several threads insert and erase the same small key range. Per key, successful
+ * inserts minus successful erases must come out as 0 or 1 and tell whether the key
+ * is in the final list. Run under -fsanitize=thread (SANITIZE_THREAD=ON).
+ */
+// aligned_allocator that gives out a set number of allocations, then null
+template<typename T, size_t Align>
+struct rationed_allocator : aligned_allocator<T, Align>
+{
+	static int left;
+	static T * allocate(size_t n)
+	{
+		if ( left <= 0 ) return nullptr;
+		--left;
+		return aligned_allocator<T, Align>::allocate(n);
+	}
+};
+template<typename T, size_t Align> int rationed_allocator<T, Align>::left = 0;
+
+TEST(lock_free_skip_list_test, insert_fails_out_of_memory)
+{
+	using rationed_type = lock_free_skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(4), rationed_allocator>;
+	rationed_type::allocator_type::left = 11;
+	rationed_type x(uint8_t(0));
+	rationed_type::handle h(x, 1);
+	for(int i = 0; i < 10; ++i) EXPECT_TRUE( h.insert(i, i) );
+	EXPECT_FALSE( h.insert(10, 10) );
+	EXPECT_EQ( 10u, x.size() );
+	EXPECT_FALSE( h.contains(10) );
+	EXPECT_TRUE( h.contains(9) );
+}
+
+TEST_P(lock_free_skip_list_test, torture)
+{
+	lock_free_type x(GetParam());
+	constexpr int keys = 512;
+	constexpr int threads = 6;
+	constexpr int ops = 40000;
+
+	std::vector< std::atomic<int> > balance(keys);
+	for(auto & b : balance) b.store(0);
+	std::atomic<size_t> bad{0};
+
+	std::vector<std::thread> ts;
+	for(int t = 0; t < threads; ++t) {
+		ts.emplace_back([&, t]{
+			lock_free_type::handle h(x, t + 1);
+			std::mt19937 rnd(t);
+			for(int i = 0; i < ops; ++i) {
+				int const k = rnd() % keys;
+				int64_t v = -1;
+				switch( rnd() % 5 )
+				{
+					case 0:
+					case 1:
+						if ( h.insert(k, k * 3) ) balance[k]++;
+						break;
+					case 2:
+						if ( h.erase(k).second ) balance[k]--;
+						break;
+					case 3: {
+						auto const r = h.erase_head();
+						if ( r.second ) {
+							if ( r.first.second != r.first.first * 3 ) bad++;
+							balance[r.first.first]--;
+						}
+						break;
+					}
+					case 4:
+						if ( h.find(k, v) && v != k * 3 ) bad++;
+						break;
+				}
+			}
+		});
+	}
+	for(auto & t : ts) t.join();
+
+	EXPECT_EQ( 0u, bad.load() );
+	std::set<int> ref;
+	for(int k = 0; k < keys; ++k) {
+		ASSERT_TRUE( balance[k] == 0 || balance[k] == 1 ) << "key " << k << ": " << balance[k];
+		if ( balance[k] ) ref.insert(k);
+	}
+
+	auto const v = x.to_vector();
+	std::set<int> got;
+	for(auto const & e : v) {
+		got.insert(e.first);
+		EXPECT_EQ( e.first * 3, e.second );
+	}
+	EXPECT_EQ( ref, got );
+	EXPECT_EQ( ref.size(), v.size() );
+	EXPECT_EQ( ref.size(), x.size() );
+	for(size_t i = 1; i < v.size(); ++i) EXPECT_TRUE( x.key_comp()(v[i-1].first, v[i].first) );
+}
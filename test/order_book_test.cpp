@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "order_book.hpp"
+
+using book_type = order_book<int32_t, int64_t, uint64_t>;
+
+struct order_book_test : public ::testing::TestWithParam<int8_t> {};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, order_book_test, ::testing::Values(0,1));
+
+TEST(id_index_test, matches_unordered_map)
+{
+	detail::id_index<uint64_t, int> x;
+	std::unordered_map<uint64_t, int*> ref;
+	std::vector<int> targets(64);
+	std::mt19937_64 rnd(5);
+
+	EXPECT_EQ( nullptr, x.find(1) );
+	EXPECT_EQ( nullptr, x.erase(1) );
+	for(int i = 0; i < 200000; ++i) {
+		// clustered ids, as exchanges hand them out, and some far apart
+		uint64_t const k = rnd() % 4 ? rnd() % 5000 : rnd();
+		int * const p = &targets[rnd() % targets.size()];
+		if ( rnd() % 2 ) {
+			bool const fresh = ref.emplace(k, p).second;
+			ASSERT_EQ( fresh, x.insert(k, p) ) << i;
+		}
+		else {
+			auto const it = ref.find(k);
+			ASSERT_EQ( it == ref.end() ? nullptr : it->second, x.erase(k) ) << i;
+			if ( it != ref.end() ) ref.erase(it);
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+		if ( i % 1000 == 0 ) {
+			for(auto const & e : ref) ASSERT_EQ( e.second, x.find(e.first) ) << i;
+		}
+	}
+	for(uint64_t k = 0; k < 5000; ++k) {
+		auto const it = ref.find(k);
+		ASSERT_EQ( it == ref.end() ? nullptr : it->second, x.find(k) ) << k;
+	}
+
+	size_t const capacity = x.capacity();
+	x.clear();
+	EXPECT_EQ( 0u, x.size() );
+	EXPECT_EQ( capacity, x.capacity() );
+	EXPECT_EQ( nullptr, x.find(ref.begin()->first) );
+	x.reserve(100000);
+	EXPECT_LE( 100000u, x.capacity() );
+}
+
+TEST_P(order_book_test, time_priority_within_levels)
+{
+	book_type b(GetParam());
+	int32_t const better = GetParam() ? 101 : 99;
+
+	EXPECT_TRUE( b.empty() );
+	EXPECT_EQ( nullptr, b.front() );
+	EXPECT_EQ( nullptr, b.best() );
+
+	EXPECT_TRUE( b.add(1, 100, 10) );
+	EXPECT_TRUE( b.add(2, 100, 20) );
+	EXPECT_TRUE( b.add(3, better, 5) );
+	EXPECT_FALSE( b.add(2, better, 7) );
+	EXPECT_TRUE( b.add(4, 100, 30) );
+	EXPECT_EQ( 4u, b.size() );
+	EXPECT_EQ( 2u, b.level_count() );
+
+	ASSERT_NE( nullptr, b.best() );
+	EXPECT_EQ( better, b.best()->price );
+	EXPECT_EQ( 3u, b.front()->id );
+	ASSERT_NE( nullptr, b.find_level(100) );
+	EXPECT_EQ( 60, b.find_level(100)->qty );
+	EXPECT_EQ( 3u, b.find_level(100)->count );
+
+	b.pop_front();
+	EXPECT_EQ( nullptr, b.find_level(better) );
+	EXPECT_EQ( 1u, b.front()->id );
+
+	// a cancel from the middle keeps the others' order, a partial fill keeps priority
+	EXPECT_TRUE( b.cancel(2) );
+	EXPECT_FALSE( b.cancel(2) );
+	EXPECT_EQ( 4, b.reduce(1, 4) );
+	EXPECT_EQ( 1u, b.front()->id );
+	EXPECT_EQ( 6, b.front()->qty );
+	EXPECT_EQ( 36, b.best()->qty );
+	EXPECT_EQ( 6, b.reduce(1, 100) );
+	EXPECT_EQ( 0, b.reduce(1, 1) );
+	EXPECT_EQ( 4u, b.front()->id );
+	EXPECT_TRUE( b.check() );
+
+	EXPECT_TRUE( b.cancel(4) );
+	EXPECT_TRUE( b.empty() );
+	EXPECT_EQ( 0u, b.level_count() );
+	EXPECT_TRUE( b.add(4, 100, 1) );
+	EXPECT_TRUE( b.check() );
+}
+
+TEST_P(order_book_test, replay_against_a_reference_book)
+{
+	book_type b(GetParam(), 9);
+	b.reserve(1000);
+
+	struct resting { int32_t px; int64_t qty; };
+	side_compare<int32_t> const before{uint8_t(GetParam())};
+	std::map<int32_t, std::deque<uint64_t>, side_compare<int32_t> > queues(before);
+	std::unordered_map<uint64_t, resting> orders;
+	std::vector<uint64_t> ids;
+	std::mt19937 rnd(9);
+	uint64_t next_id = 1;
+
+	auto const forget = [&](uint64_t id) {
+		auto & q = queues[orders[id].px];
+		q.erase(std::find(q.begin(), q.end(), id));
+		if ( q.empty() ) queues.erase(orders[id].px);
+		orders.erase(id);
+		ids.erase(std::find(ids.begin(), ids.end(), id));
+	};
+
+	for(int i = 0; i < 40000; ++i)
+	{
+		switch( rnd() % 6 )
+		{
+			case 0:
+			case 1: {
+				int32_t const px = 1000 + int32_t(rnd() % 40);
+				int64_t const qty = 1 + rnd() % 100;
+				ASSERT_TRUE( b.add(next_id, px, qty) );
+				queues[px].push_back(next_id);
+				orders[next_id] = resting{px, qty};
+				ids.push_back(next_id++);
+				break;
+			}
+			case 2:
+				if ( !ids.empty() ) {
+					uint64_t const id = ids[rnd() % ids.size()];
+					ASSERT_TRUE( b.cancel(id) );
+					forget(id);
+				}
+				else {
+					ASSERT_FALSE( b.cancel(next_id) );
+				}
+				break;
+			case 3:
+				if ( !ids.empty() ) {
+					uint64_t const id = ids[rnd() % ids.size()];
+					int64_t const qty = 1 + rnd() % 60;
+					int64_t const taken = std::min(qty, orders[id].qty);
+					ASSERT_EQ( taken, b.reduce(id, qty) );
+					if ( ( orders[id].qty -= taken ) == 0 ) forget(id);
+				}
+				break;
+			case 4:
+				if ( !ids.empty() ) {
+					uint64_t const id = queues.begin()->second.front();
+					ASSERT_EQ( id, b.front()->id );
+					b.pop_front();
+					forget(id);
+				}
+				break;
+			case 5:
+				// ids stay unique while their orders rest
+				if ( !ids.empty() ) {
+					ASSERT_FALSE( b.add(ids[rnd() % ids.size()], 1000, 1) );
+				}
+				break;
+		}
+		ASSERT_EQ( orders.size(), b.size() );
+		ASSERT_EQ( queues.size(), b.level_count() );
+		if ( !queues.empty() ) {
+			ASSERT_EQ( queues.begin()->first, b.best()->price );
+			ASSERT_EQ( queues.begin()->second.front(), b.front()->id );
+		}
+		if ( i % 200 == 0 ) {
+			std::string why;
+			ASSERT_TRUE( b.check(&why) ) << why << " i=" << i;
+			for(auto const & q : queues) {
+				book_type::level const * l = b.find_level(q.first);
+				ASSERT_NE( nullptr, l );
+				ASSERT_EQ( q.second.size(), l->count );
+				size_t n = 0;
+				for(auto const * o = l->first; o; o = o->next, ++n) {
+					ASSERT_EQ( q.second[n], o->id );
+					ASSERT_EQ( orders[o->id].qty, o->qty );
+				}
+			}
+		}
+	}
+
+	b.clear();
+	EXPECT_TRUE( b.empty() );
+	EXPECT_TRUE( b.check() );
+	EXPECT_TRUE( b.add(1, 1000, 1) );
+}
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+
+#include <csignal>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "skip_list.hpp"
+
+constexpr unsigned options = sl_compact_links | sl_indexable;
+
+using persistent_list = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(2, options),
+	mapped_arena_allocator, xorshift64star, side_compare<int32_t>, options>;
+using reference_list = skip_list<int32_t, int64_t>;
+
+// exposes the nodes, to damage them
+struct persistent_probe : persistent_list
+{
+	using persistent_list::persistent_list;
+
+	elem * node(size_t i) const
+	{
+		elem * p = head_;
+		while( i-- ) p = p->next(0);
+		return p;
+	}
+};
+
+struct persistent_skip_list_test : public ::testing::TestWithParam<int8_t>
+{
+	std::string path;
+
+	void SetUp() override
+	{
+		path = std::string(access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp")
+			+ "/skip_list_test." + std::to_string(getpid()) + "." + std::to_string(int(GetParam()));
+		unlink(path.c_str());
+	}
+	void TearDown() override { unlink(path.c_str()); }
+};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, persistent_skip_list_test, ::testing::Values(0,1));
+
+// the same stream of operations for the list in the file and the reference
+template<typename L> void apply_ops(L & x, uint32_t seed, int n)
+{
+	std::mt19937 rnd(seed);
+	for(int i = 0; i < n; ++i) {
+		int32_t const k = rnd() % 4000;
+		switch( rnd() % 4 ) {
+			case 0:
+			case 1: x.insert(k, int64_t(k) * 3); break;
+			case 2: x.erase(k); break;
+			case 3: if ( !x.empty() ) x.erase_head(); break;
+		}
+	}
+}
+
+TEST_P(persistent_skip_list_test, reopens_where_it_was_left)
+{
+	reference_list y(GetParam());
+	apply_ops(y, 1, 20000);
+	{
+		persistent_list x(GetParam());
+		ASSERT_TRUE( x.attach(path.c_str()) );
+		EXPECT_TRUE( x.attached() );
+		EXPECT_TRUE( x.empty() );
+		apply_ops(x, 1, 20000);
+		EXPECT_TRUE( x.checkpoint() );
+	}
+	persistent_list x(GetParam());
+	EXPECT_TRUE( x.empty() );
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	std::string why;
+	EXPECT_TRUE( x.check(&why) ) << why;
+	EXPECT_EQ( y.size(), x.size() );
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+	for(size_t i = 0; i < x.size(); i += 101) EXPECT_EQ( i, x.rank(x.at(i)->key) );
+
+	// and keeps going from there
+	apply_ops(x, 2, 5000);
+	apply_ops(y, 2, 5000);
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+
+	x.detach();
+	EXPECT_TRUE( x.empty() );
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+	x.clear();
+	x.detach();
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	EXPECT_TRUE( x.empty() );
+	EXPECT_TRUE( x.check() );
+
+	// a snapshot load starts from a cleared arena
+	auto const v = y.to_vector();
+	x.assign_sorted(v.begin(), v.end());
+	x.detach();
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	EXPECT_TRUE( x.check(&why) ) << why;
+	EXPECT_EQ( v, x.to_vector() );
+}
+
+// the parent kills the child at a random point, in the middle of a call as likely as
+// not; every reopening must pass check(), whatever the child got to
+template<typename L> void kill_and_reopen(std::string const & path, int8_t sd, int rounds)
+{
+	std::mt19937 rnd(5);
+	for(int round = 0; round < rounds; ++round) {
+		pid_t const pid = fork();
+		ASSERT_NE( -1, pid );
+		if ( pid == 0 ) {
+			// no destructors, no checkpoint: the pages are all the file gets
+			L x(sd);
+			if ( !x.attach(path.c_str()) ) _exit(1);
+			for(uint32_t seed = round;; seed += rounds) apply_ops(x, seed, 1000);
+		}
+		usleep(500 + rnd() % 5000);
+		kill(pid, SIGKILL);
+		int status = 0;
+		ASSERT_EQ( pid, waitpid(pid, &status, 0) );
+		ASSERT_TRUE( WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL ) << status;
+
+		L x(sd);
+		ASSERT_TRUE( x.attach(path.c_str()) ) << "round " << round;
+		std::string why;
+		ASSERT_TRUE( x.check(&why) ) << why << ", round " << round;
+	}
+}
+
+TEST_P(persistent_skip_list_test, reopens_after_kill)
+{
+	kill_and_reopen<persistent_list>(path, GetParam(), 100);
+
+	constexpr unsigned lazy = sl_compact_links | sl_cached_keys | sl_tombstones;
+	unlink(path.c_str());
+	kill_and_reopen<skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(2, lazy),
+		mapped_arena_allocator, xorshift64star, side_compare<int32_t>, lazy> >(path, GetParam(), 100);
+}
+
+// the graveyard stays behind in the process: tombstones found in the file are left to
+// compact()'s budgeted walk
+TEST_P(persistent_skip_list_test, compacts_reopened_tombstones_within_budget)
+{
+	constexpr unsigned lazy = sl_compact_links | sl_tombstones;
+	using lazy_list = skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(2, lazy),
+		mapped_arena_allocator, xorshift64star, side_compare<int32_t>, lazy>;
+	{
+		lazy_list x(GetParam(), 5);
+		ASSERT_TRUE( x.attach(path.c_str()) );
+		for(int i = 0; i < 2000; ++i) x.insert(i, i);
+		for(int i = 0; i < 2000; i += 10) x.erase(i);
+		EXPECT_EQ( 200u, x.tombstone_count() );
+	}
+	lazy_list x(GetParam(), 5);
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	EXPECT_EQ( 200u, x.tombstone_count() );
+
+	// 40 nodes per call, 41 keys with a head taken along, hold 5 tombstones at most
+	size_t calls = 0;
+	std::string why;
+	while( x.tombstone_count() > 0 ) {
+		ASSERT_LT( calls++, 60u );
+		EXPECT_GE( 5u, x.compact(40) );
+		ASSERT_TRUE( x.check(&why) ) << why;
+	}
+	EXPECT_EQ( 1800u, x.size() );
+	for(int i = 0; i < 2000; ++i) EXPECT_EQ( i % 10 != 0, x.contains(i) ) << i;
+}
+
+TEST_P(persistent_skip_list_test, refuses_other_layouts)
+{
+	{
+		persistent_list x(GetParam());
+		ASSERT_TRUE( x.attach(path.c_str()) );
+		x.insert(1, 1);
+	}
+	persistent_list other_side(1 - GetParam());
+	EXPECT_FALSE( other_side.attach(path.c_str()) );
+	EXPECT_FALSE( other_side.attached() );
+
+	skip_list<int32_t, int64_t, skip_list_levels<int32_t, int64_t>(1, sl_compact_links),
+		mapped_arena_allocator, xorshift64star, side_compare<int32_t>, sl_compact_links> shorter(GetParam());
+	EXPECT_FALSE( shorter.attach(path.c_str()) );
+
+	persistent_list x(GetParam());
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	EXPECT_EQ( 1u, x.size() );
+}
+
+TEST_P(persistent_skip_list_test, check_finds_damage)
+{
+	persistent_probe x(GetParam(), 4);
+	ASSERT_TRUE( x.attach(path.c_str()) );
+	for(int i = 0; i < 1000; ++i) x.insert(i, i);
+	std::string why;
+	ASSERT_TRUE( x.check(&why) ) << why;
+
+	std::swap(x.node(10)->key, x.node(11)->key);
+	EXPECT_FALSE( x.check(&why) );
+	EXPECT_NE( std::string::npos, why.find("out of order") ) << why;
+	std::swap(x.node(10)->key, x.node(11)->key);
+
+	size_t i = 1;
+	while( x.node(i)->height < 2 ) ++i;
+	x.node(i)->height = 1; // still linked in on level 1
+	EXPECT_FALSE( x.check(&why) );
+	EXPECT_NE( std::string::npos, why.find("level 1") ) << why;
+}
@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "skip_list.hpp"
+
+struct alignas(64) line { char bytes[64]; };
+
+using pool_type = pool_allocator<line, 64>;
+using pooled_list = skip_list<int32_t, void*, 6, pool_allocator>;
+using thread_pooled_list = skip_list<int32_t, void*, 6, thread_pool_allocator>;
+using arena_type = arena_allocator<line, 64>;
+
+TEST(pool_allocator_test, aligned_and_distinct)
+{
+	pool_type a;
+	std::set<line*> seen;
+
+	for(size_t i = 0; i < 3 * pool_type::blocks_per_slab; ++i)
+	{
+		line * p = a.allocate(1);
+		ASSERT_NE( nullptr, p );
+		EXPECT_EQ( 0u, reinterpret_cast<uintptr_t>(p) % 64 ) << "i=" << i;
+		EXPECT_TRUE( seen.insert(p).second ) << "i=" << i;
+	}
+	EXPECT_EQ( 3u, a.slab_count() );
+}
+
+// blocks that do not divide the slab: runs that no longer fit hand the tail out as
+// single blocks, which must stay inside the slab
+TEST(pool_allocator_test, odd_block_size)
+{
+	struct odd { char bytes[40]; };
+	using odd_pool = pool_allocator<odd, 8>;
+	static_assert( odd_pool::slab_size % odd_pool::block_size != 0, "a tail that is not a whole block" );
+	odd_pool a;
+	std::set<char*> seen;
+	for(size_t i = 0; i < 3 * odd_pool::blocks_per_slab; ++i) {
+		size_t const n = i % 7 == 0 ? 2 : 1;
+		char * p = reinterpret_cast<char*>(a.allocate(n));
+		ASSERT_NE( nullptr, p );
+		for(size_t j = 0; j < n; ++j) ASSERT_TRUE( seen.insert(p + j * odd_pool::block_size).second ) << "i=" << i;
+		std::memset(p, 0xa5, n * odd_pool::block_size);
+	}
+}
+
+TEST(pool_allocator_test, reuses_freed_blocks)
+{
+	pool_type a;
+
+	line * p = a.allocate(1);
+	line * q = a.allocate(1);
+	a.deallocate(p, 1);
+	EXPECT_EQ( p, a.allocate(1) );
+	a.deallocate(q, 1);
+	EXPECT_EQ( q, a.allocate(1) );
+	EXPECT_EQ( 1u, a.slab_count() );
+}
+
+TEST(pool_allocator_test, release_and_regrow)
+{
+	pool_type a;
+
+	for(size_t i = 0; i < pool_type::blocks_per_slab + 1; ++i) a.allocate(1);
+	EXPECT_EQ( 2u, a.slab_count() );
+
+	a.release();
+	EXPECT_EQ( 0u, a.slab_count() );
+	EXPECT_NE( nullptr, a.allocate(1) );
+	EXPECT_EQ( 1u, a.slab_count() );
+}
+
+TEST(pool_allocator_test, copy_starts_empty)
+{
+	pool_type a;
+	a.allocate(1);
+
+	pool_type b = a;
+	EXPECT_EQ( 1u, a.slab_count() );
+	EXPECT_EQ( 0u, b.slab_count() );
+
+	pool_type c = std::move(a);
+	EXPECT_EQ( 0u, a.slab_count() );
+	EXPECT_EQ( 1u, c.slab_count() );
+}
+
+TEST(pool_allocator_test, runs_are_pooled_per_length)
+{
+	pool_type a;
+
+	line * p = a.allocate(4);
+	line * q = a.allocate(2);
+	line * r = a.allocate(1);
+	ASSERT_NE( nullptr, p );
+	EXPECT_EQ( p + 4, q );
+	EXPECT_EQ( q + 2, r );
+
+	a.deallocate(p, 4);
+	a.deallocate(q, 2);
+	EXPECT_EQ( q, a.allocate(2) );
+	EXPECT_EQ( p, a.allocate(4) );
+	EXPECT_EQ( 1u, a.slab_count() );
+}
+
+TEST(pool_allocator_test, slab_tail_feeds_single_blocks)
+{
+	pool_type a;
+
+	size_t const runs = pool_type::blocks_per_slab / pool_type::max_run;
+	for(size_t i = 0; i < runs; ++i) ASSERT_NE( nullptr, a.allocate(pool_type::max_run) );
+	ASSERT_NE( nullptr, a.allocate(pool_type::max_run) );
+	EXPECT_EQ( 2u, a.slab_count() );
+
+	// the blocks left over at the end of the first slab are handed out one by one
+	for(size_t i = 0; i < pool_type::blocks_per_slab % pool_type::max_run; ++i) {
+		ASSERT_NE( nullptr, a.allocate(1) );
+	}
+	EXPECT_EQ( 2u, a.slab_count() );
+}
+
+TEST(pool_allocator_test, long_requests_bypass_pool)
+{
+	pool_type a;
+
+	line * p = a.allocate(pool_type::max_run + 1);
+	ASSERT_NE( nullptr, p );
+	EXPECT_EQ( 0u, reinterpret_cast<uintptr_t>(p) % 64 );
+	EXPECT_EQ( 0u, a.slab_count() );
+	a.deallocate(p, pool_type::max_run + 1);
+}
+
+TEST(arena_allocator_test, blocks_within_one_region)
+{
+	arena_type a;
+	EXPECT_EQ( nullptr, a.base() );
+
+	line * p = a.allocate(1);
+	ASSERT_NE( nullptr, p );
+	EXPECT_EQ( reinterpret_cast<char const*>(p), a.base() );
+	EXPECT_EQ( 0u, reinterpret_cast<uintptr_t>(p) % 64 );
+
+	// past the first commit, still contiguous
+	size_t const n = 2 * arena_type::commit_bytes / sizeof(line);
+	for(size_t i = 1; i < n; ++i) ASSERT_EQ( p + i, a.allocate(1) ) << "i=" << i;
+	EXPECT_EQ( 2 * arena_type::commit_bytes, a.capacity_bytes() );
+	p[n - 1].bytes[63] = 1;
+
+	a.release();
+	EXPECT_EQ( nullptr, a.base() );
+	EXPECT_EQ( 0u, a.capacity_bytes() );
+}
+
+TEST(arena_allocator_test, runs_are_recycled)
+{
+	arena_type a;
+
+	line * p = a.allocate(4);
+	line * q = a.allocate(2);
+	a.deallocate(p, 4);
+	EXPECT_EQ( p, a.allocate(4) );
+	a.deallocate(q, 2);
+	EXPECT_EQ( q, a.allocate(2) );
+
+	// longer runs come back as single blocks
+	line * r = a.allocate(arena_type::max_run + 2);
+	EXPECT_EQ( q + 2, r );
+	a.deallocate(r, arena_type::max_run + 2);
+	std::set<line*> seen;
+	for(size_t i = 0; i < arena_type::max_run + 2; ++i) seen.insert(a.allocate(1));
+	EXPECT_EQ( r, *seen.begin() );
+	EXPECT_EQ( r + arena_type::max_run + 1, *seen.rbegin() );
+}
+
+struct pooled_skip_list_test : public ::testing::TestWithParam<int8_t> {};
+
+INSTANTIATE_TEST_CASE_P(bid_or_ask, pooled_skip_list_test, ::testing::Values(0,1));
+
+TEST_P(pooled_skip_list_test, insert_and_erase_1000)
+{
+	pooled_list x(GetParam());
+	int N = 1000;
+
+	for(int i = 1; i <= N; ++i)
+	{
+		ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) ) << "i=" << i;
+	}
+	EXPECT_EQ( N, x.size() );
+	EXPECT_EQ( x.size(), x.count() );
+
+	for(int i = 1; i <= N; ++i)
+	{
+		EXPECT_EQ( (void*)(size_t)i, x.erase(i).first ) << "i=" << i;
+	}
+	EXPECT_TRUE( x.empty() );
+}
+
+TEST_P(pooled_skip_list_test, erase_recycles_nodes)
+{
+	pooled_list x(GetParam());
+	int N = 1000;
+
+	for(int i = 1; i <= N; ++i) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) );
+	size_t const slabs = x.get_allocator().slab_count();
+
+	for(int round = 0; round < 10; ++round)
+	{
+		for(int i = 1; i <= N; i += 2) ASSERT_EQ( 1u, x.erase(i).second ) << "i=" << i;
+		for(int i = 1; i <= N; i += 2) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) ) << "i=" << i;
+	}
+	EXPECT_EQ( slabs, x.get_allocator().slab_count() );
+	EXPECT_EQ( N, x.count() );
+}
+
+TEST_P(pooled_skip_list_test, clear_releases_slabs)
+{
+	pooled_list x(GetParam());
+
+	for(int i = 1; i <= 1000; ++i) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) );
+	EXPECT_LT( 0u, x.get_allocator().slab_count() );
+
+	x.clear();
+	EXPECT_TRUE( x.empty() );
+	EXPECT_EQ( 0, x.size() );
+	EXPECT_EQ( 0u, x.get_allocator().slab_count() );
+	EXPECT_FALSE( x.contains(1) );
+
+	EXPECT_TRUE( x.insert(7, (void*)7UL ) );
+	EXPECT_TRUE( x.contains(7) );
+	EXPECT_EQ( 1, x.count() );
+}
+
+TEST_P(pooled_skip_list_test, thread_pool_shared_between_lists)
+{
+	{
+		thread_pooled_list x(GetParam());
+		for(int i = 1; i <= 1000; ++i) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) );
+	}
+	thread_pooled_list y(GetParam());
+	for(int i = 1000; i >= 1; --i) ASSERT_TRUE( y.insert(i, (void*)(size_t)i ) );
+	for(int i = 1; i <= 1000; ++i) EXPECT_TRUE( y.contains(i) ) << "i=" << i;
+	y.clear();
+	EXPECT_TRUE( y.empty() );
+}
+
+TEST_P(pooled_skip_list_test, compact_links_match_pointers)
+{
+	constexpr unsigned options = sl_compact_links | sl_indexable | sl_cached_keys;
+	using compact_list = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(2, options),
+		arena_allocator, xorshift64star, side_compare<int32_t>, options>;
+	static_assert( skip_list_levels<int32_t, void*>(1, sl_compact_links) == 2 * skip_list_levels<int32_t, void*>(1),
+			"32-bit links double the levels per line" );
+
+	compact_list x(GetParam(), 5);
+	skip_list<int32_t, void*> y(GetParam(), 5);
+	std::mt19937 rnd(GetParam() + 3);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 5000;
+		switch( rnd() % 4 )
+		{
+			case 0:
+			case 1:
+				ASSERT_EQ( y.insert(k, (void*)(size_t)k), x.insert(k, (void*)(size_t)k) );
+				break;
+			case 2:
+				ASSERT_EQ( y.erase(k), x.erase(k) );
+				break;
+			case 3:
+				ASSERT_EQ( y.find(k) != nullptr, x.find(k) != nullptr );
+				if ( !y.empty() ) {
+					ASSERT_EQ( size_t(x.rank(y.begin()->key)), 0u );
+				}
+				break;
+		}
+	}
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+
+	std::vector< std::pair<int32_t, void*> > walked;
+	for(auto & e : x) walked.push_back(std::make_pair(e.key, e.value));
+	EXPECT_EQ( y.to_vector(), walked );
+	for(size_t i = 0; i < walked.size(); i += 97) {
+		EXPECT_EQ( walked[i].first, x.at(i)->key );
+		EXPECT_EQ( i, x.rank(walked[i].first) );
+	}
+
+	std::ostringstream o;
+	x.dump(o, ", ", 3);
+	EXPECT_NE( std::string::npos, o.str().find("...") );
+}
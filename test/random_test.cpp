@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "skip_list.hpp"
+
+using test_type = skip_list<int32_t, void*, 6>;
+
+// smallest x with bounded(x, m) == b, to drive the distributions through every bucket
+static uint64_t draw_for(uint64_t b, uint64_t m)
+{
+	return static_cast<uint64_t>( ((static_cast<unsigned __int128>(b) << 64) + m - 1) / m );
+}
+
+template<size_t N> static void check_against_float_formulas()
+{
+	using dist = level_distribution<N>;
+
+	for(uint64_t b = 0; b < N; ++b) {
+		EXPECT_EQ( size_t(b + 1), dist::uniform(draw_for(b, N)) ) << "b=" << b;
+	}
+
+	uint64_t const pow_n = uint64_t(1) << N;
+	for(uint64_t b = 0; b < pow_n - 1; ++b) {
+		double const u = double(b + 2);
+		uint64_t const x = draw_for(b, pow_n - 1);
+		EXPECT_EQ( size_t(std::log2(u)), dist::log(x) ) << "u=" << u;
+		EXPECT_EQ( size_t(N - std::log2(u) + 1), dist::rev_log(x) ) << "u=" << u;
+	}
+
+	for(uint64_t b = 0; b < N * N; ++b) {
+		double const u = double(b + 1);
+		uint64_t const x = draw_for(b, N * N);
+		EXPECT_EQ( size_t(std::sqrt(u)), dist::sqrt(x) ) << "u=" << u;
+		EXPECT_EQ( size_t(N - std::sqrt(u) + 1), dist::rev_sqrt(x) ) << "u=" << u;
+	}
+}
+
+TEST(level_distribution_test, matches_float_formulas_6)
+{
+	check_against_float_formulas<6>();
+}
+
+TEST(level_distribution_test, matches_float_formulas_16)
+{
+	check_against_float_formulas<16>();
+}
+
+TEST(level_distribution_test, extremes_stay_in_range)
+{
+	using dist = level_distribution<6>;
+	for(uint64_t x : { uint64_t(0), uint64_t(1), UINT64_MAX / 2, UINT64_MAX - 1, UINT64_MAX }) {
+		for(size_t r : { dist::uniform(x), dist::log(x), dist::rev_log(x), dist::sqrt(x), dist::rev_sqrt(x), dist::geometric(x, 6) }) {
+			EXPECT_LE( 1u, r ) << "x=" << x;
+			EXPECT_GE( 6u, r ) << "x=" << x;
+		}
+	}
+}
+
+TEST(level_distribution_test, geometric_counts_trailing_zeros)
+{
+	using dist = level_distribution<30>;
+	EXPECT_EQ( 1u, dist::geometric(1, 30) );
+	EXPECT_EQ( 4u, dist::geometric(8, 30) );
+	EXPECT_EQ( 3u, dist::geometric(8, 3) );
+	EXPECT_EQ( 30u, dist::geometric(0, 30) );
+	EXPECT_EQ( 1u, dist::geometric(0, 1) );
+}
+
+TEST(level_generator_test, seeded_sequences_repeat)
+{
+	xorshift64star a(42), b(42), c(43);
+	bool differs = false;
+	for(int i = 0; i < 100; ++i) {
+		uint64_t const x = a();
+		EXPECT_EQ( x, b() );
+		differs |= x != c();
+	}
+	EXPECT_TRUE( differs );
+
+	xorshift64star z(0);
+	EXPECT_NE( 0u, z() );
+}
+
+struct level_probe : test_type
+{
+	using test_type::test_type;
+	using test_type::random_level;
+};
+
+TEST(level_generator_test, seeded_lists_draw_same_levels)
+{
+	level_probe x(0, 7), y(1, 7);
+	for(int i = 0; i < 1000; ++i) {
+		EXPECT_EQ( x.random_level(), y.random_level() ) << "i=" << i;
+	}
+}
+
+TEST(level_generator_test, rev_log_is_geometric)
+{
+	level_probe x(0, 1234);
+	size_t const draws = 1 << 16;
+	std::array<size_t, 7> hist {};
+	for(size_t i = 0; i < draws; ++i) hist[ x.random_level() ]++;
+
+	EXPECT_EQ( 0u, hist[0] );
+	// P(level = 6 - k) = 2^k / 63
+	for(size_t k = 0; k < 6; ++k) {
+		double const expected = double(draws) * (1 << k) / 63;
+		EXPECT_NEAR( expected, double(hist[6 - k]), 5 * std::sqrt(expected) + 1 ) << "level=" << 6 - k;
+	}
+}
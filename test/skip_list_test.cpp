@@ -1,6 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
 
 #include "skip_list.hpp"
 
@@ -14,6 +22,7 @@ TEST_P(skip_list_test, instance)
 {
 	EXPECT_NO_THROW({
 			test_type x(GetParam());
+			x.insert(1, nullptr);
 			test_type y = x;
 			//const test_type x = y;
 	});
@@ -324,3 +333,1226 @@ TEST_P(skip_list_test, erase_10_perm)
 	EXPECT_TRUE( x.empty() );
 	EXPECT_EQ(0, x.size() );
 }
+
+struct tower_probe : test_type
+{
+	using test_type::test_type;
+	using test_type::elem;
+	using test_type::head_lines;
+
+	// level i must chain exactly the nodes taller than i, in level 0 order
+	::testing::AssertionResult towers_ok() const
+	{
+		if ( !head_ ) return ::testing::AssertionSuccess();
+		if ( head_->height != max_levels ) return ::testing::AssertionFailure() << "short head";
+
+		for(size_t i = 0; i < max_levels; ++i)
+		{
+			elem const * q = head_;
+			for(elem const * p = head_; p; p = p->next(0))
+			{
+				if ( p->height > p->capacity() ) return ::testing::AssertionFailure() << "tower overflow";
+				if ( p->height <= i ) continue;
+				if ( q != p ) return ::testing::AssertionFailure() << "level " << i << " skips a node";
+				q = p->next(i);
+			}
+			if ( q != nullptr ) return ::testing::AssertionFailure() << "level " << i << " not terminated";
+		}
+		return ::testing::AssertionSuccess();
+	}
+
+	size_t lines() const
+	{
+		size_t r = 0;
+		for(elem const * p = head_; p; p = p->next(0)) r += p->lines;
+		return r;
+	}
+
+	std::vector<size_t> heights() const
+	{
+		std::vector<size_t> r;
+		for(elem const * p = head_; p; p = p->next(0)) r.push_back(p->height);
+		return r;
+	}
+};
+
+TEST(skip_list_layout_test, size_classes)
+{
+	using elem = tower_probe::elem;
+
+	EXPECT_EQ( 1u, elem::lines_for(1) );
+	EXPECT_EQ( 1u, elem::lines_for(elem::capacity_of(1)) );
+	EXPECT_EQ( 2u, elem::lines_for(elem::capacity_of(1) + 1) );
+	EXPECT_EQ( 4u, elem::lines_for(elem::capacity_of(2) + 1) );
+	EXPECT_EQ( 4u, size_t(tower_probe::head_lines) );
+	EXPECT_LE( 20u, size_t(tower_probe::max_levels) );
+}
+
+TEST_P(skip_list_test, towers_after_inserts_and_erases)
+{
+	tower_probe x(GetParam(), 99);
+	std::set<int> ref;
+	std::mt19937 rnd(5);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 5000;
+		switch( rnd() % 4 )
+		{
+			case 0:
+				EXPECT_EQ( ref.erase(k), x.erase(k).second ) << "k=" << k;
+				break;
+			case 1:
+				if ( !x.empty() ) {
+					int const front = x.begin()->key;
+					EXPECT_EQ( GetParam() ? *ref.rbegin() : *ref.begin(), front );
+					x.erase_head();
+					ref.erase(front);
+				}
+				break;
+			default:
+				EXPECT_EQ( ref.insert(k).second, x.insert(k, (void*)(size_t)k) ) << "k=" << k;
+		}
+		if ( i % 1000 == 0 ) {
+			ASSERT_TRUE( x.towers_ok() ) << "i=" << i;
+		}
+	}
+	EXPECT_TRUE( x.towers_ok() );
+	EXPECT_EQ( ref.size(), x.size() );
+	EXPECT_EQ( x.size(), x.count() );
+	for(int k : ref) EXPECT_EQ( (void*)(size_t)k, *x.find(k) ) << "k=" << k;
+}
+
+TEST_P(skip_list_test, level_1_nodes_take_one_line)
+{
+	tower_probe x(GetParam(), 3);
+	int const n = 10000;
+	for(int i = 0; i < n; ++i) ASSERT_TRUE( x.insert(i, nullptr) );
+
+	// geometric towers: almost every node fits the one line class
+	EXPECT_LT( x.lines(), size_t(n * 1.1) );
+	EXPECT_TRUE( x.towers_ok() );
+}
+
+TEST_P(skip_list_test, erase_head_until_empty)
+{
+	tower_probe x(GetParam(), 11);
+	int const n = 1000;
+	for(int i = 1; i <= n; ++i) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) );
+
+	for(int i = 1; i <= n; ++i)
+	{
+		int const expected = GetParam() ? n - i + 1 : i;
+		ASSERT_EQ( expected, x.begin()->key );
+		ASSERT_EQ( (void*)(size_t)expected, x.begin()->value );
+		x.erase_head();
+		if ( i % 100 == 0 ) {
+			ASSERT_TRUE( x.towers_ok() ) << "i=" << i;
+		}
+	}
+	EXPECT_TRUE( x.empty() );
+}
+
+template<typename T> struct static_side_test : public ::testing::Test {};
+
+using static_side_types = ::testing::Types<
+	ascending_skip_list<int32_t, void*>,
+	descending_skip_list<int32_t, void*> >;
+TYPED_TEST_CASE(static_side_test, static_side_types);
+
+TYPED_TEST(static_side_test, matches_runtime_side)
+{
+	TypeParam x;
+	test_type y(x.side(), 1);
+	std::mt19937 rnd(17);
+
+	ASSERT_TRUE( x.side() == 0 || x.side() == 1 );
+	for(int i = 0; i < 5000; ++i)
+	{
+		int const k = rnd() % 2000;
+		if ( rnd() % 3 ) EXPECT_EQ( y.insert(k, (void*)(size_t)k), x.insert(k, (void*)(size_t)k) ) << "k=" << k;
+		else EXPECT_EQ( y.erase(k), x.erase(k) ) << "k=" << k;
+	}
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+	for(int k = 0; k < 2000; ++k) EXPECT_EQ( y.contains(k), x.contains(k) ) << "k=" << k;
+}
+
+// orders by distance from zero, negative first on ties
+struct by_magnitude
+{
+	bool operator()(int32_t a, int32_t b) const
+	{
+		return std::abs(a) != std::abs(b) ? std::abs(a) < std::abs(b) : a < b;
+	}
+};
+
+TEST(custom_compare_test, orders_by_functor)
+{
+	skip_list<int32_t, void*, 6, aligned_allocator, xorshift64star, by_magnitude> x;
+
+	EXPECT_EQ( -1, x.side() );
+	for(int k : { 3, -1, 0, 2, -3, 1, -2 }) ASSERT_TRUE( x.insert(k, nullptr) );
+	EXPECT_FALSE( x.insert(-3, nullptr) );
+
+	std::vector<int32_t> keys;
+	for(auto & e : x.to_vector()) keys.push_back(e.first);
+	EXPECT_EQ( (std::vector<int32_t>{ 0, -1, 1, -2, 2, -3, 3 }), keys );
+
+	EXPECT_EQ( 1u, x.erase(-2).second );
+	EXPECT_TRUE( x.contains(2) );
+	EXPECT_FALSE( x.contains(-2) );
+}
+
+TEST_P(skip_list_test, find_from_matches_find)
+{
+	test_type x(GetParam(), 21);
+	for(int i = 0; i < 2000; i += 2) ASSERT_TRUE( x.insert(i, (void*)(size_t)i ) );
+
+	std::vector<test_type::iterator> hints { x.end() };
+	for(auto it = x.begin(); it != x.end(); ++it) hints.push_back(it);
+
+	std::mt19937 rnd(8);
+	for(int i = 0; i < 20000; ++i)
+	{
+		auto const hint = hints[ rnd() % hints.size() ];
+		int const k = int(rnd() % 2004) - 2;
+		auto const it = x.find_from(hint, k);
+		if ( void ** v = x.find(k) ) {
+			ASSERT_NE( x.end(), it ) << "k=" << k;
+			EXPECT_EQ( k, it->key );
+			EXPECT_EQ( v, &it->value );
+		}
+		else {
+			EXPECT_EQ( x.end(), it ) << "k=" << k;
+		}
+	}
+}
+
+TEST_P(skip_list_test, insert_with_hint)
+{
+	tower_probe x(GetParam(), 22);
+	std::set<int> ref;
+	std::mt19937 rnd(9);
+
+	auto hint = x.end();
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 5000;
+		if ( rnd() % 8 == 0 ) hint = x.begin();
+		bool const fresh = ref.insert(k).second;
+		size_t const before = x.size();
+		hint = x.insert(hint, k, (void*)(size_t)k);
+		ASSERT_NE( x.end(), hint );
+		EXPECT_EQ( k, hint->key );
+		EXPECT_EQ( before + fresh, x.size() ) << "k=" << k;
+		if ( rnd() % 4 == 0 ) {
+			int const e = rnd() % 5000;
+			EXPECT_EQ( ref.erase(e), x.erase(e).second ) << "e=" << e;
+			hint = x.begin();
+		}
+		if ( i % 1000 == 0 ) {
+			ASSERT_TRUE( x.towers_ok() ) << "i=" << i;
+		}
+	}
+	EXPECT_TRUE( x.towers_ok() );
+	EXPECT_EQ( ref.size(), x.count() );
+	for(int k : ref) EXPECT_TRUE( x.contains(k) ) << "k=" << k;
+}
+
+TEST_P(skip_list_test, finger_ops_match_cold_search)
+{
+	tower_probe x(GetParam(), 23);
+	std::set<int> ref;
+	std::mt19937 rnd(10);
+
+	int k = 2500;
+	for(int i = 0; i < 50000; ++i)
+	{
+		k = std::max(0, std::min(4999, k + int(rnd() % 41) - 20));
+		switch( rnd() % 8 )
+		{
+			case 0: case 1: case 2:
+				EXPECT_EQ( ref.insert(k).second, x.insert_near(k, (void*)(size_t)k) ) << "k=" << k;
+				break;
+			case 3: case 4:
+				EXPECT_EQ( ref.erase(k), x.erase_near(k).second ) << "k=" << k;
+				break;
+			case 5:
+				EXPECT_EQ( x.find(k), x.find_near(k) ) << "k=" << k;
+				break;
+			case 6:
+				if ( rnd() % 2 ) EXPECT_EQ( ref.insert(k + 7).second, x.insert(k + 7, nullptr) );
+				else EXPECT_EQ( ref.erase(k - 7), x.erase(k - 7).second );
+				break;
+			default:
+				if ( !x.empty() && rnd() % 4 == 0 ) {
+					ref.erase(x.begin()->key);
+					x.erase_head();
+				}
+		}
+		if ( i % 2000 == 0 ) {
+			ASSERT_TRUE( x.towers_ok() ) << "i=" << i;
+		}
+	}
+	EXPECT_TRUE( x.towers_ok() );
+	EXPECT_EQ( ref.size(), x.count() );
+	for(int key : ref) EXPECT_NE( nullptr, x.find_near(key) ) << "k=" << key;
+}
+
+TEST_P(skip_list_test, assign_sorted)
+{
+	std::vector< std::pair<int32_t, void*> > v;
+	for(int i = 0; i < 5000; ++i) v.push_back(std::make_pair(GetParam() ? 10000 - 2 * i : 2 * i, (void*)(size_t)i));
+	v.push_back(v.back()); // repeated keys are dropped
+
+	tower_probe x(GetParam(), 1);
+	tower_probe y(GetParam(), 2);
+	x.insert(1, nullptr);
+	x.assign_sorted(v.begin(), v.end());
+	y.assign_sorted(v.begin(), v.end());
+	v.pop_back();
+
+	EXPECT_EQ( v, x.to_vector() );
+	EXPECT_EQ( v.size(), x.size() );
+	EXPECT_TRUE( x.towers_ok() );
+	EXPECT_EQ( x.heights(), y.heights() ) << "layout depends on the seed";
+	EXPECT_EQ( 1u, x.heights()[1] );
+	EXPECT_EQ( 3u, x.heights()[4] );
+
+	// an ordinary list from there on
+	for(auto const & e : v) {
+		EXPECT_TRUE( x.insert(e.first + 1, nullptr) );
+		EXPECT_EQ( 1u, x.erase(e.first).second );
+	}
+	EXPECT_TRUE( x.towers_ok() );
+	EXPECT_EQ( 5000u, x.count() );
+
+	test_type z(v.begin(), v.end(), side_compare<int32_t>{uint8_t(GetParam())});
+	EXPECT_EQ( v, z.to_vector() );
+	x.assign_sorted(v.end(), v.end());
+	EXPECT_TRUE( x.empty() );
+}
+
+TEST_P(skip_list_test, append_back)
+{
+	tower_probe x(GetParam(), 4);
+	std::vector< std::pair<int32_t, void*> > v;
+	for(int i = 0; i < 3000; ++i) {
+		int32_t const k = GetParam() ? -i : i;
+		EXPECT_TRUE( x.append_back(k, (void*)(size_t)i) );
+		v.push_back(std::make_pair(k, (void*)(size_t)i));
+		if ( i % 7 == 0 ) x.find(k / 2);
+	}
+	EXPECT_EQ( v, x.to_vector() );
+	EXPECT_TRUE( x.towers_ok() );
+}
+
+
+TEST_P(skip_list_test, batches_match_per_key_calls)
+{
+	tower_probe x(GetParam(), 8);
+	std::map<int, void*> ref;
+	std::mt19937 rnd(21);
+
+	for(int round = 0; round < 300; ++round)
+	{
+		size_t const n = 1 + rnd() % 64;
+		std::vector< std::pair<int32_t, void*> > kv(n);
+		std::vector<int32_t> keys(n);
+		for(size_t i = 0; i < n; ++i) {
+			keys[i] = rnd() % 3000;
+			kv[i] = std::make_pair(keys[i], (void*)(size_t)rnd());
+		}
+		if ( round % 5 == 0 ) std::sort(keys.begin(), keys.end());
+
+		switch( round % 3 )
+		{
+			case 0: {
+				std::unique_ptr<bool[]> inserted(new bool[n]);
+				size_t expected = 0;
+				for(size_t i = 0; i < n; ++i) expected += ref.insert(kv[i]).second;
+				ASSERT_EQ( expected, x.insert_batch(kv.data(), n, inserted.get()) );
+				for(size_t i = 0; i < n; ++i) EXPECT_EQ( ref[kv[i].first], *x.find(kv[i].first) );
+				break;
+			}
+			case 1: {
+				std::vector< std::pair<void*, size_t> > erased(n);
+				std::vector< std::pair<void*, size_t> > expected(n);
+				for(size_t i = 0; i < n; ++i) {
+					auto it = ref.find(keys[i]);
+					if ( it != ref.end() ) {
+						expected[i] = std::make_pair(it->second, 1);
+						ref.erase(it);
+					}
+				}
+				x.erase_batch(keys.data(), n, erased.data());
+				EXPECT_EQ( expected, erased );
+				break;
+			}
+			case 2: {
+				std::vector<void**> found(n);
+				size_t expected = 0;
+				for(size_t i = 0; i < n; ++i) expected += ref.count(keys[i]);
+				EXPECT_EQ( expected, x.find_batch<false>(keys.data(), n, found.data()) );
+				for(size_t i = 0; i < n; ++i) {
+					auto it = ref.find(keys[i]);
+					if ( it == ref.end() ) EXPECT_EQ( nullptr, found[i] );
+					else EXPECT_EQ( it->second, *found[i] );
+				}
+				break;
+			}
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+	}
+	EXPECT_TRUE( x.towers_ok() );
+}
+
+TEST_P(skip_list_test, prefetching_search_and_find_many)
+{
+	using prefetching_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, sl_prefetch>;
+	prefetching_type x(GetParam(), 6);
+	test_type y(GetParam(), 6);
+	std::mt19937 rnd(13);
+
+	for(int i = 0; i < 10000; ++i)
+	{
+		int const k = rnd() % 4000;
+		if ( rnd() % 3 ) EXPECT_EQ( y.insert(k, (void*)(size_t)k), x.insert(k, (void*)(size_t)k) );
+		else EXPECT_EQ( y.erase(k), x.erase(k) );
+	}
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+
+	std::vector<int32_t> keys;
+	for(int k = -5; k < 4005; ++k) keys.push_back(k);
+	std::shuffle(keys.begin(), keys.end(), rnd);
+	std::vector<void**> a(keys.size()), b(keys.size());
+	x.find_many(keys.data(), keys.size(), a.data());
+	y.find_many<3>(keys.data(), keys.size(), b.data());
+	for(size_t i = 0; i < keys.size(); ++i) {
+		EXPECT_EQ( x.find(keys[i]), a[i] ) << keys[i];
+		EXPECT_EQ( y.find(keys[i]), b[i] ) << keys[i];
+	}
+
+	test_type empty(GetParam());
+	empty.find_many(keys.data(), 5, b.data());
+	for(size_t i = 0; i < 5; ++i) EXPECT_EQ( nullptr, b[i] );
+}
+
+// every linked level's cached key must match the node it points to
+template<typename L> struct cached_key_probe : L
+{
+	using L::L;
+	using typename L::elem;
+
+	::testing::AssertionResult keys_ok() const
+	{
+		for(auto const * p = this->head_; p; p = p->next(0)) {
+			for(size_t i = 0; i < p->height; ++i) {
+				if ( p->next(i) && p->next_keys()[i] != p->next(i)->key )
+					return ::testing::AssertionFailure() << "stale key behind " << p->key << " on level " << i;
+			}
+		}
+		return ::testing::AssertionSuccess();
+	}
+};
+
+TEST_P(skip_list_test, cached_keys_follow_relinks)
+{
+	constexpr unsigned options = sl_cached_keys | sl_indexable;
+	using cached_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+	using probe = cached_key_probe<cached_type>;
+	EXPECT_LE( 2u, size_t(probe::elem::capacity_of(1)) ); // level-2 towers still take one line
+
+	probe x(GetParam(), 7);
+	test_type y(GetParam(), 7);
+	std::mt19937 rnd(17);
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int const k = rnd() % 3000;
+		switch( rnd() % 6 )
+		{
+			case 0:
+			case 1:
+				ASSERT_EQ( y.insert(k, (void*)(size_t)k), x.insert(k, (void*)(size_t)k) );
+				break;
+			case 2:
+				x.insert(x.find_from(x.begin(), k), k, (void*)(size_t)k);
+				y.insert(k, (void*)(size_t)k);
+				break;
+			case 3:
+				ASSERT_EQ( y.erase(k), x.erase(k) );
+				break;
+			case 4:
+				if ( !y.empty() ) {
+					y.erase_head();
+					x.erase_head();
+				}
+				break;
+			case 5:
+				if ( !y.empty() ) {
+					size_t const at = rnd() % y.size();
+					int const key = x.at(at)->key;
+					ASSERT_EQ( y.erase(key), x.erase_at(at) );
+				}
+				break;
+		}
+		ASSERT_EQ( y.size(), x.size() );
+		if ( i % 500 == 0 ) {
+			ASSERT_TRUE( x.keys_ok() ) << "i=" << i;
+		}
+	}
+	EXPECT_TRUE( x.keys_ok() );
+	EXPECT_EQ( y.to_vector(), x.to_vector() );
+	for(int k = -1; k < 3001; ++k) EXPECT_EQ( y.contains(k), x.contains(k) ) << k;
+
+	auto const v = y.to_vector();
+	x.assign_sorted(v.begin(), v.end());
+	EXPECT_TRUE( x.keys_ok() );
+	for(int k = -1; k < 3001; ++k) EXPECT_EQ( y.contains(k), x.contains(k) ) << k;
+}
+
+TEST_P(skip_list_test, snapshot_round_trip)
+{
+	tower_probe x(GetParam(), 31);
+	std::mt19937 rnd(31);
+	for(int i = 0; i < 20000; ++i) x.insert(int32_t(rnd() % 100000) - 50000, (void*)(size_t)i);
+
+	std::string plain, towers;
+	auto const to = [](std::string & s) {
+		return [&s](char const * p, size_t n) { s.append(p, n); return true; };
+	};
+	auto const from = [](std::string const & s) {
+		return [&s, at = size_t(0)](char * p, size_t n) mutable {
+			if ( s.size() - at < n ) return false;
+			std::memcpy(p, s.data() + at, n);
+			at += n;
+			return true;
+		};
+	};
+	ASSERT_TRUE( x.save(to(plain)) );
+	ASSERT_TRUE( x.save(to(towers), true) );
+	EXPECT_EQ( sizeof(skip_list_snapshot) + x.size() * (sizeof(int32_t) + sizeof(void*)), plain.size() );
+	EXPECT_EQ( plain.size() + x.size(), towers.size() );
+
+	tower_probe y(GetParam(), 32);
+	y.insert(7, nullptr);
+	ASSERT_TRUE( y.load(from(plain)) );
+	EXPECT_EQ( x.to_vector(), y.to_vector() );
+	EXPECT_TRUE( y.towers_ok() );
+	EXPECT_TRUE( y.check() );
+
+	ASSERT_TRUE( y.load(from(towers)) );
+	EXPECT_EQ( x.to_vector(), y.to_vector() );
+	EXPECT_EQ( x.heights(), y.heights() );
+	EXPECT_TRUE( y.towers_ok() );
+
+	// empty lists, and whatever is not a whole snapshot of this list
+	std::string empty;
+	tower_probe z(GetParam());
+	ASSERT_TRUE( z.save(to(empty)) );
+	EXPECT_TRUE( y.load(from(empty)) );
+	EXPECT_TRUE( y.empty() );
+
+	EXPECT_FALSE( y.load(from(plain.substr(0, plain.size() - 1))) );
+	EXPECT_TRUE( y.empty() );
+	tower_probe other_side(1 - GetParam());
+	EXPECT_FALSE( other_side.load(from(plain)) );
+	skip_list<int64_t, void*> wider(GetParam());
+	EXPECT_FALSE( wider.load(from(plain)) );
+
+	std::string shuffled = plain;
+	size_t const record = sizeof(int32_t) + sizeof(void*);
+	std::swap_ranges(&shuffled[sizeof(skip_list_snapshot)], &shuffled[sizeof(skip_list_snapshot) + record],
+			&shuffled[sizeof(skip_list_snapshot) + record]);
+	EXPECT_FALSE( y.load(from(shuffled)) );
+	EXPECT_TRUE( y.empty() );
+
+	// a writer that gives up
+	int calls = 0;
+	EXPECT_FALSE( x.save([&](char const *, size_t) { return ++calls < 3; }) );
+	EXPECT_EQ( 3, calls );
+}
+
+TEST_P(skip_list_test, bounds_and_ranges)
+{
+	test_type x(GetParam(), 41);
+	side_compare<int32_t> const before{uint8_t(GetParam())};
+	std::set<int32_t, side_compare<int32_t> > ref(before);
+	std::mt19937 rnd(41);
+	for(int i = 0; i < 3000; ++i) {
+		int32_t const k = 3 * int32_t(rnd() % 2000);
+		x.insert(k, (void*)(size_t)k);
+		ref.insert(k);
+	}
+
+	auto const key_or_end = [](test_type::iterator it) { return it.p ? it->key : INT32_MIN; };
+	auto const ref_or_end = [&](std::set<int32_t, side_compare<int32_t> >::const_iterator it) {
+		return it == ref.end() ? INT32_MIN : *it;
+	};
+	for(int32_t k = -5; k < 6005; ++k) {
+		ASSERT_EQ( ref_or_end(ref.lower_bound(k)), key_or_end(x.lower_bound(k)) ) << k;
+		ASSERT_EQ( ref_or_end(ref.upper_bound(k)), key_or_end(x.upper_bound(k)) ) << k;
+		auto const r = x.equal_range(k);
+		ASSERT_TRUE( r.first == x.lower_bound(k) && r.second == x.upper_bound(k) ) << k;
+	}
+
+	// volume within 100 ticks of the touch, whichever way the side runs
+	int32_t const touch = x.begin()->key;
+	int32_t const limit = GetParam() ? touch - 100 : touch + 100;
+	int64_t sum = 0;
+	size_t const n = x.for_each_in_range(touch, limit, [&](int32_t k, void * & v) {
+		EXPECT_EQ( (void*)(size_t)k, v );
+		sum += k;
+	});
+	int64_t ref_sum = 0;
+	size_t ref_n = 0;
+	for(auto it = ref.begin(); it != ref.end() && before(*it, limit); ++it, ++ref_n) ref_sum += *it;
+	EXPECT_EQ( ref_n, n );
+	EXPECT_EQ( ref_sum, sum );
+	EXPECT_LT( 0u, n );
+
+	EXPECT_EQ( 0u, x.for_each_in_range(limit, touch, [](int32_t, void * &) {}) );
+	test_type empty(GetParam());
+	EXPECT_TRUE( empty.lower_bound(1) == empty.end() );
+	EXPECT_EQ( 0u, empty.for_each_in_range(0, 10, [](int32_t, void * &) {}) );
+}
+
+TEST_P(skip_list_test, front_and_top_k)
+{
+	constexpr unsigned options = sl_top_cache | sl_indexable;
+	using cached_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+	EXPECT_EQ( 5u, size_t(cached_type::top_levels) );
+
+	cached_type x(GetParam(), 51);
+	test_type y(GetParam(), 51);
+	std::mt19937 rnd(51);
+	std::pair<int32_t, void*> a[9], b[9];
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		// few keys, so that changes land among the first ones
+		int const k = rnd() % 40;
+		switch( rnd() % 6 )
+		{
+			case 0:
+			case 1:
+				ASSERT_EQ( y.insert(k, (void*)(size_t)k), x.insert(k, (void*)(size_t)k) );
+				break;
+			case 2:
+				ASSERT_EQ( y.erase(k), x.erase(k) );
+				break;
+			case 3:
+				if ( !y.empty() ) {
+					auto const p = y.pop_front();
+					ASSERT_EQ( p, x.pop_front() );
+					EXPECT_EQ( (void*)(size_t)p.first, p.second );
+				}
+				break;
+			case 4:
+				if ( !y.empty() ) {
+					size_t const at = rnd() % y.size();
+					int const key = x.at(at)->key;
+					ASSERT_EQ( y.erase(key), x.erase_at(at) );
+				}
+				break;
+			case 5:
+				if ( rnd() % 50 == 0 ) {
+					auto const v = y.to_vector();
+					x.assign_sorted(v.begin(), v.end());
+				}
+				break;
+		}
+		ASSERT_EQ( y.size(), x.size() );
+		ASSERT_TRUE( x.check() ) << "i=" << i;
+		size_t const n = rnd() % 10;
+		ASSERT_EQ( y.top_k(n, a), x.top_k(n, b) );
+		ASSERT_TRUE( std::equal(a, a + std::min(n, y.size()), b) ) << "i=" << i;
+		if ( !y.empty() ) {
+			ASSERT_EQ( y.front().key, x.front().key );
+		}
+	}
+
+	// values changed in place show through
+	int32_t const best = GetParam() ? 100 : -1;
+	x.insert(best, nullptr);
+	*x.find(best) = (void*)7UL;
+	ASSERT_EQ( 1u, x.top_k(1, b) );
+	EXPECT_EQ( (void*)7UL, b[0].second );
+	x.clear();
+	EXPECT_EQ( 0u, x.top_k(5, b) );
+}
+
+TEST_P(skip_list_test, tombstones_and_compact)
+{
+	constexpr unsigned options = sl_tombstones | sl_cached_keys;
+	using lazy_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+
+	lazy_type x(GetParam(), 61);
+	side_compare<int32_t> const before{uint8_t(GetParam())};
+	std::map<int32_t, void*, side_compare<int32_t> > ref(before);
+	using pairs = std::vector< std::pair<int32_t, void*> >;
+	std::mt19937 rnd(61);
+
+	for(int i = 0; i < 30000; ++i)
+	{
+		int32_t const k = rnd() % 500;
+		void * const v = (void*)(size_t)(i + 1);
+		switch( rnd() % 8 )
+		{
+			case 0:
+			case 1:
+			case 2:
+				ASSERT_EQ( ref.emplace(k, v).second, x.insert(k, v) ) << i;
+				break;
+			case 3:
+			case 4: {
+				auto const it = ref.find(k);
+				auto const r = x.erase(k);
+				ASSERT_EQ( it != ref.end(), r.second == 1 ) << i;
+				if ( it != ref.end() ) {
+					EXPECT_EQ( it->second, r.first );
+					ref.erase(it);
+				}
+				break;
+			}
+			case 5:
+				if ( !ref.empty() ) {
+					ASSERT_EQ( ref.begin()->first, x.front().key );
+					auto const p = x.pop_front();
+					EXPECT_EQ( ref.begin()->first, p.first );
+					EXPECT_EQ( ref.begin()->second, p.second );
+					ref.erase(ref.begin());
+				}
+				break;
+			case 6:
+				x.compact(rnd() % 4);
+				break;
+			case 7:
+				if ( rnd() % 100 == 0 ) {
+					size_t const dead = x.tombstone_count();
+					EXPECT_EQ( dead, x.compact() );
+					EXPECT_EQ( 0u, x.tombstone_count() );
+				}
+				break;
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+		if ( i % 100 == 0 ) {
+			std::string why;
+			ASSERT_TRUE( x.check(&why) ) << why << " i=" << i;
+			ASSERT_EQ( pairs(ref.begin(), ref.end()), x.to_vector() ) << i;
+		}
+	}
+
+	ASSERT_LT( 0u, x.tombstone_count() );
+	EXPECT_EQ( ref.size(), x.count() );
+	for(int32_t k = -1; k < 501; ++k) {
+		auto const it = ref.find(k);
+		ASSERT_EQ( it == ref.end() ? nullptr : &it->second, x.find(k) ? &ref[k] : nullptr ) << k;
+		if ( it != ref.end() ) {
+			EXPECT_EQ( it->second, *x.find(k) );
+		}
+		auto const lb = x.lower_bound(k);
+		auto const rlb = ref.lower_bound(k);
+		ASSERT_EQ( rlb == ref.end(), lb == x.end() ) << k;
+		if ( rlb != ref.end() ) {
+			EXPECT_EQ( rlb->first, lb->key ) << k;
+		}
+	}
+
+	// iteration and ranges step over the dead nodes
+	std::vector<int32_t> keys;
+	for(auto const & e : x) keys.push_back(e.key);
+	ASSERT_EQ( ref.size(), keys.size() );
+	EXPECT_TRUE( std::equal(keys.begin(), keys.end(), ref.begin(),
+				[](int32_t a, std::pair<int32_t const, void*> const & b) { return a == b.first; }) );
+	int32_t const lo = GetParam() ? 400 : 100, hi = GetParam() ? 100 : 400;
+	size_t n = x.for_each_in_range(lo, hi, [](int32_t, void * &) {});
+	EXPECT_EQ( size_t(std::distance(ref.lower_bound(lo), ref.lower_bound(hi))), n );
+
+	size_t const dead = x.tombstone_count();
+	EXPECT_EQ( dead, x.compact() );
+	EXPECT_TRUE( x.check() );
+	EXPECT_EQ( pairs(ref.begin(), ref.end()), x.to_vector() );
+}
+
+// erase() keeps keys for the first 1024 tombstones only, compact() walks for the rest
+TEST_P(skip_list_test, compacts_tombstones_past_the_graveyard)
+{
+	constexpr unsigned options = sl_tombstones;
+	using lazy_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+
+	for(size_t budget : { size_t(100), SIZE_MAX }) {
+		lazy_type x(GetParam(), 67);
+		for(int32_t k = 0; k < 40000; ++k) ASSERT_TRUE( x.insert(k, nullptr) );
+		// too few for the single sweep, more than the graveyard holds
+		for(int32_t k = 7; k < 40000; k += 19) ASSERT_EQ( 1u, x.erase(k).second );
+		size_t const dead = x.tombstone_count();
+		ASSERT_EQ( 2105u, dead );
+
+		size_t n = 0, calls = 0;
+		while( x.tombstone_count() > 0 && calls++ < 10000 ) {
+			size_t const r = x.compact(budget);
+			EXPECT_GE( budget, r );
+			n += r;
+		}
+		EXPECT_EQ( 0u, x.tombstone_count() ) << budget;
+		EXPECT_EQ( dead, n ) << budget;
+		if ( budget == SIZE_MAX ) {
+			EXPECT_EQ( 1u, calls );
+		}
+		EXPECT_EQ( 40000u - dead, x.size() );
+		std::string why;
+		EXPECT_TRUE( x.check(&why) ) << why;
+		EXPECT_EQ( nullptr, x.find(7) );
+		EXPECT_NE( nullptr, x.find(8) );
+	}
+}
+
+namespace {
+
+// a level's resting quantity, counting how often it gets copied
+struct level_qty
+{
+	static int copies;
+	int64_t q = 0;
+
+	level_qty() = default;
+	explicit level_qty(int64_t x) : q(x) {}
+	level_qty(level_qty const & o) : q(o.q) { ++copies; }
+	level_qty(level_qty && o) noexcept : q(o.q) {}
+	level_qty & operator=(level_qty const & o) { q = o.q; ++copies; return *this; }
+	level_qty & operator=(level_qty && o) noexcept { q = o.q; return *this; }
+};
+int level_qty::copies = 0;
+
+}
+
+TEST_P(skip_list_test, upsert_modify_and_erase_if)
+{
+	skip_list<int32_t, level_qty> x(GetParam(), 71);
+	std::map<int32_t, int64_t> ref;
+	std::mt19937 rnd(71);
+	level_qty::copies = 0;
+
+	for(int i = 0; i < 20000; ++i)
+	{
+		int32_t const k = rnd() % 300;
+		int64_t const q = 1 + rnd() % 5;
+		switch( rnd() % 4 )
+		{
+			case 0: {
+				auto const r = x.try_emplace(k, q);
+				bool const fresh = ref.emplace(k, q).second;
+				ASSERT_EQ( fresh, r.second );
+				ASSERT_EQ( k, r.first->key );
+				ASSERT_EQ( ref[k], r.first->value.q );
+				break;
+			}
+			case 1: {
+				auto const r = x.insert_or_assign(k, level_qty(q));
+				ASSERT_EQ( !ref.count(k), r.second );
+				ref[k] = q;
+				ASSERT_EQ( q, r.first->value.q );
+				break;
+			}
+			case 2:
+				ASSERT_EQ( ref.count(k) == 1, x.modify(k, [&](level_qty & v) { v.q += q; }) );
+				if ( ref.count(k) ) ref[k] += q;
+				break;
+			case 3: {
+				// a fill of q: the level goes when nothing is left
+				size_t const n = x.erase_if(k, [&](level_qty & v) { return ( v.q -= std::min(v.q, q) ) == 0; });
+				auto const it = ref.find(k);
+				if ( it == ref.end() ) {
+					ASSERT_EQ( 0u, n );
+					break;
+				}
+				it->second -= std::min(it->second, q);
+				ASSERT_EQ( it->second == 0, n == 1 );
+				if ( it->second == 0 ) ref.erase(it);
+				break;
+			}
+		}
+		ASSERT_EQ( ref.size(), x.size() );
+	}
+	EXPECT_EQ( 0, level_qty::copies );
+	EXPECT_TRUE( x.check() );
+	for(auto const & e : ref) {
+		ASSERT_NE( nullptr, x.find(e.first) );
+		EXPECT_EQ( e.second, x.find(e.first)->q );
+	}
+
+	// insert() still copies an lvalue, and keeps the value already there
+	level_qty const one(1);
+	int32_t const fresh = 1000;
+	EXPECT_TRUE( x.insert(fresh, one) );
+	EXPECT_EQ( 1, level_qty::copies );
+	EXPECT_FALSE( x.insert(fresh, level_qty(2)) );
+	EXPECT_EQ( 1, x.find(fresh)->q );
+	EXPECT_FALSE( x.modify(-1, [](level_qty & v) { v.q = 0; }) );
+	EXPECT_EQ( 0u, x.erase_if(fresh, [](level_qty const &) { return false; }) );
+	EXPECT_EQ( 1u, x.erase_if(fresh, [](level_qty const &) { return true; }) );
+}
+
+namespace {
+
+template<typename L>
+void split_join_and_truncate(int8_t sd)
+{
+	using pairs = std::vector< std::pair<int32_t, void*> >;
+	side_compare<int32_t> const before{uint8_t(sd)};
+	std::mt19937 rnd(83);
+	std::string why;
+
+	for(int round = 0; round < 200; ++round)
+	{
+		L x(uint8_t(sd), round + 1);
+		int const n = rnd() % 300;
+		for(int i = 0; i < n; ++i) {
+			int32_t const k = rnd() % 1000;
+			x.insert(k, (void*)(size_t)(k + 1));
+			if ( rnd() % 4 == 0 ) x.erase(rnd() % 1000);
+		}
+		pairs const ref = x.to_vector();
+		int32_t const k = int32_t(rnd() % 1002) - 1;
+		auto const from = std::find_if(ref.begin(), ref.end(),
+				[&](std::pair<int32_t, void*> const & e) { return !before(e.first, k); });
+		auto const past = std::find_if(ref.begin(), ref.end(),
+				[&](std::pair<int32_t, void*> const & e) { return before(k, e.first); });
+
+		L y = x.clone();
+		L z = y.split_at(k);
+		ASSERT_TRUE( y.check(&why) ) << why << " round=" << round;
+		ASSERT_TRUE( z.check(&why) ) << why << " round=" << round;
+		ASSERT_EQ( pairs(ref.begin(), from), y.to_vector() ) << round;
+		ASSERT_EQ( pairs(from, ref.end()), z.to_vector() ) << round;
+		ASSERT_EQ( size_t(from - ref.begin()), y.size() );
+		ASSERT_EQ( size_t(ref.end() - from), z.size() );
+
+		if ( !y.empty() && !z.empty() ) {
+			EXPECT_FALSE( z.join(y) );
+		}
+		ASSERT_TRUE( y.join(z) );
+		EXPECT_TRUE( z.empty() );
+		ASSERT_TRUE( y.check(&why) ) << why << " round=" << round;
+		ASSERT_EQ( ref, y.to_vector() ) << round;
+		ASSERT_EQ( ref.size(), y.size() );
+
+		// copies are deep, x saw none of it
+		ASSERT_EQ( ref, x.to_vector() ) << round;
+		ASSERT_TRUE( x.check(&why) ) << why << " round=" << round;
+
+		EXPECT_EQ( size_t(ref.end() - past), y.truncate_after(k) );
+		ASSERT_TRUE( y.check(&why) ) << why << " round=" << round;
+		ASSERT_EQ( pairs(ref.begin(), past), y.to_vector() ) << round;
+
+		size_t const m = rnd() % ( ref.size() + 2 );
+		L t{uint8_t(sd)};
+		t = x;
+		EXPECT_EQ( ref.size() - std::min(m, ref.size()), t.keep_top(m) );
+		ASSERT_TRUE( t.check(&why) ) << why << " round=" << round;
+		ASSERT_EQ( pairs(ref.begin(), ref.begin() + std::min(m, ref.size())), t.to_vector() ) << round;
+
+		// what is left keeps working, moved or not
+		L w(std::move(t));
+		EXPECT_TRUE( t.empty() );
+		w.insert(k, nullptr);
+		z.insert(k, nullptr);
+		y.erase(k);
+		ASSERT_TRUE( w.check(&why) ) << why << " round=" << round;
+		ASSERT_TRUE( y.check(&why) ) << why << " round=" << round;
+		EXPECT_EQ( 1u, z.size() );
+	}
+}
+
+}
+
+TEST_P(skip_list_test, split_join_and_truncate)
+{
+	constexpr unsigned indexed = sl_indexable | sl_cached_keys;
+	constexpr unsigned lazy = sl_tombstones;
+	constexpr unsigned top = sl_top_cache;
+	using side = side_compare<int32_t>;
+
+	// stateless allocators hand the nodes over, pools move them into new ones
+	split_join_and_truncate<test_type>(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4), pool_allocator> >(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, indexed),
+		aligned_allocator, xorshift64star, side, indexed> >(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, indexed),
+		pool_allocator, xorshift64star, side, indexed> >(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, lazy),
+		aligned_allocator, xorshift64star, side, lazy> >(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, lazy),
+		pool_allocator, xorshift64star, side, lazy> >(GetParam());
+	split_join_and_truncate< skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, top),
+		aligned_allocator, xorshift64star, side, top> >(GetParam());
+}
+
+TEST_P(skip_list_test, stats_follow_the_list)
+{
+	constexpr unsigned options = sl_stats_latency;
+	using stats_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+		aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+	using snapshot = skip_list_stats<stats_type::max_levels>;
+	auto const footprint = [](stats_type const & l) {
+		uint64_t b = 0;
+		for(auto const & e : l) b += e.lines * cache_line_size;
+		return b;
+	};
+
+	stats_type x(GetParam(), 91);
+	std::mt19937 rnd(91);
+	uint64_t calls[snapshot::ops] = {};
+	uint64_t draws = 0;
+
+	// a reader takes snapshots while the list changes: counters only go up
+	std::atomic<bool> done{false};
+	std::atomic<bool> monotonic{true};
+	std::thread reader([&]{
+		snapshot last = x.stats();
+		while( !done.load() ) {
+			snapshot const s = x.stats();
+			for(size_t i = 0; i < snapshot::ops; ++i) {
+				if ( s.calls[i] < last.calls[i] ) monotonic = false;
+			}
+			if ( s.allocations < last.allocations || s.frees < last.frees ) monotonic = false;
+			last = s;
+		}
+	});
+	for(int i = 0; i < 20000; ++i)
+	{
+		int32_t const k = rnd() % 2000;
+		switch( rnd() % 3 )
+		{
+			case 0: {
+				bool const was_empty = x.empty();
+				if ( x.insert(k, nullptr) && !was_empty ) ++draws;
+				++calls[snapshot::insert_op];
+				break;
+			}
+			case 1:
+				x.erase(k);
+				++calls[snapshot::erase_op];
+				break;
+			case 2:
+				(void)x.find(k);
+				++calls[snapshot::find_op];
+				break;
+		}
+	}
+	done = true;
+	reader.join();
+	EXPECT_TRUE( monotonic.load() );
+
+	snapshot const s = x.stats();
+	for(size_t i = 0; i < snapshot::ops; ++i) {
+		EXPECT_EQ( calls[i], s.calls[i] ) << i;
+		uint64_t timed = 0;
+		for(uint64_t n : s.latency[i]) timed += n;
+		EXPECT_EQ( calls[i], timed ) << i;
+	}
+	uint64_t drawn = 0, hops = 0;
+	for(uint64_t n : s.heights) drawn += n;
+	for(uint64_t n : s.hops) hops += n;
+	EXPECT_EQ( 0u, s.heights[0] );
+	EXPECT_EQ( draws, drawn );
+	EXPECT_LT( 0u, s.hops[0] );
+	EXPECT_LT( hops, 20000u * 64 );
+	EXPECT_EQ( x.size(), s.nodes );
+	EXPECT_EQ( footprint(x), s.bytes );
+	EXPECT_EQ( s.nodes, s.allocations - s.frees );
+
+	// batches count every key, whether it descends the list or not
+	std::vector<int32_t> keys(100);
+	for(size_t i = 0; i < keys.size(); ++i) keys[i] = int32_t(i * 20) - 10;
+	std::vector<void**> found(keys.size());
+	x.find_many(keys.data(), keys.size(), found.data());
+	EXPECT_EQ( calls[snapshot::find_op] + keys.size(), x.stats().calls[snapshot::find_op] );
+
+	// and so do inserts after a hint
+	uint64_t const inserts = x.stats().calls[snapshot::insert_op];
+	uint64_t const timed_inserts = [&]{
+		uint64_t n = 0;
+		for(uint64_t c : x.stats().latency[snapshot::insert_op]) n += c;
+		return n;
+	}();
+	auto hint = x.begin();
+	for(int32_t k = 5001; k < 5101; k += 2) hint = x.insert(hint, GetParam() ? -k : k, nullptr);
+	EXPECT_EQ( inserts + 50, x.stats().calls[snapshot::insert_op] );
+	uint64_t timed = 0;
+	for(uint64_t c : x.stats().latency[snapshot::insert_op]) timed += c;
+	EXPECT_EQ( timed_inserts + 50, timed );
+
+	// the footprint follows the nodes through copies, splits and joins
+	stats_type y = x.clone();
+	EXPECT_EQ( x.size(), y.stats().nodes );
+	stats_type z = y.split_at(1000);
+	EXPECT_EQ( y.size(), y.stats().nodes );
+	EXPECT_EQ( z.size(), z.stats().nodes );
+	EXPECT_EQ( footprint(y), y.stats().bytes );
+	EXPECT_EQ( footprint(z), z.stats().bytes );
+	ASSERT_TRUE( y.join(z) );
+	EXPECT_EQ( x.size(), y.stats().nodes );
+	EXPECT_EQ( 0u, z.stats().nodes );
+	y.clear();
+	EXPECT_EQ( 0u, y.stats().nodes );
+	EXPECT_EQ( 0u, y.stats().bytes );
+	EXPECT_EQ( y.stats().allocations, y.stats().frees );
+}
+
+namespace {
+
+template<unsigned options>
+using dist_type = skip_list<int32_t, void*, skip_list_levels<int32_t, void*>(4, options),
+	aligned_allocator, xorshift64star, side_compare<int32_t>, options>;
+
+// the head node is always full height, so the first element does not count
+template<typename L> size_t tallest(L const & l)
+{
+	size_t h = 0;
+	for(auto it = l.begin(); it != l.end(); ++it) {
+		if ( it != l.begin() ) h = std::max<size_t>(h, it->height);
+	}
+	return h;
+}
+
+// grows the list to 5000 keys and back down to 50, checking it against a std::set;
+// returns the tallest tower at the peak
+template<typename L>
+size_t grow_and_shrink(int8_t sd)
+{
+	L x(uint8_t(sd), 17);
+	std::set<int32_t> ref;
+	std::mt19937 rnd(17);
+	std::string why;
+
+	while( ref.size() < 5000 ) {
+		int32_t const k = rnd() % 20000;
+		EXPECT_EQ( ref.insert(k).second, x.insert(k, nullptr) );
+		if ( ref.size() % 1000 == 0 ) {
+			EXPECT_TRUE( x.check(&why) ) << why << " size=" << ref.size();
+		}
+	}
+	size_t const peak = tallest(x);
+	while( ref.size() > 50 ) {
+		int32_t const k = rnd() % 20000;
+		EXPECT_EQ( ref.erase(k), x.erase(k).second );
+		if ( ref.size() % 1000 == 0 ) {
+			EXPECT_TRUE( x.check(&why) ) << why << " size=" << ref.size();
+		}
+	}
+	EXPECT_TRUE( x.check(&why) ) << why;
+	EXPECT_EQ( ref.size(), x.size() );
+	for(int32_t k : ref) EXPECT_TRUE( x.contains(k) ) << k;
+	return peak;
+}
+
+}
+
+TEST_P(skip_list_test, level_distributions_grow_and_shrink)
+{
+	grow_and_shrink< dist_type<0> >(GetParam());
+	grow_and_shrink< dist_type<sl_uniform_levels> >(GetParam());
+	grow_and_shrink< dist_type<sl_log_levels> >(GetParam());
+	grow_and_shrink< dist_type<sl_sqrt_levels> >(GetParam());
+	grow_and_shrink< dist_type<sl_rev_sqrt_levels> >(GetParam());
+
+	// adaptive towers stop near log2 of the size and come down with it
+	constexpr unsigned adaptive = sl_adaptive_levels;
+	size_t const peak = grow_and_shrink< dist_type<adaptive> >(GetParam());
+	EXPECT_LE( peak, 2u + 12u );
+	EXPECT_GE( peak, 8u );
+	grow_and_shrink< dist_type<adaptive | sl_indexable> >(GetParam());
+	grow_and_shrink< dist_type<adaptive | sl_tombstones> >(GetParam());
+
+	// the 64 tallest towers of 64K nodes stay, cut down to the cap for 64 nodes,
+	// 2 + log2(65), or at most one level above it
+	dist_type<adaptive> x(GetParam(), 5);
+	for(int i = 0; i < 1 << 16; ++i) x.insert(i, nullptr);
+	std::vector< std::pair<size_t, int32_t> > towers;
+	for(auto it = ++x.begin(); it != x.end(); ++it) towers.emplace_back(it->height, it->key);
+	std::sort(towers.rbegin(), towers.rend());
+	EXPECT_LE( 12u, towers[0].first );
+	for(size_t i = 64; i < towers.size(); ++i) x.erase(towers[i].second);
+	x.erase_head();
+	std::string why;
+	EXPECT_TRUE( x.check(&why) ) << why;
+	EXPECT_EQ( 64u, x.size() );
+	EXPECT_GE( 2u + 6u + 1u, tallest(x) );
+	for(size_t i = 0; i < 64; ++i) EXPECT_TRUE( x.contains(towers[i].second) );
+}
+
+namespace {
+
+template<unsigned options>
+struct adaptive_probe : dist_type<sl_adaptive_levels | options>
+{
+	using dist_type<sl_adaptive_levels | options>::dist_type;
+	size_t levels_in_use() const { return this->used_levels_; }
+};
+
+// loads 16K keys whose first and last 8 towers after the head are 14 levels tall,
+// the others balanced, drains the list to 64 with drain(list), and checks that the
+// search starts within a level of the cap for 64 nodes, 2 + log2(65): every drain
+// below keeps some of the tall towers
+template<unsigned options, typename F>
+void drain_to_64(int8_t sd, F && drain)
+{
+	constexpr size_t n = 1 << 14;
+	constexpr size_t record = sizeof(int32_t) + sizeof(void*) + 1;
+	skip_list_snapshot h{};
+	std::memcpy(h.magic, "SLsnap", sizeof(h.magic));
+	h.version = 1;
+	h.side = sd;
+	h.key_size = sizeof(int32_t);
+	h.value_size = sizeof(void*);
+	h.towers = 1;
+	h.size = n;
+	std::string file(reinterpret_cast<char const*>(&h), sizeof(h));
+	for(size_t i = 0; i < n; ++i) {
+		int32_t const k = sd ? -int32_t(i) : int32_t(i);
+		char r[record] = {};
+		std::memcpy(r, &k, sizeof(k));
+		r[record - 1] = char( ( i >= 1 && i <= 8 ) || i >= n - 8 ? 14 : 0 );
+		file.append(r, record);
+	}
+	size_t at = 0;
+	adaptive_probe<options> x(sd, 9);
+	ASSERT_TRUE( x.load([&](char * out, size_t len) {
+		if ( at + len > file.size() ) return false;
+		std::memcpy(out, file.data() + at, len);
+		at += len;
+		return true;
+	}) );
+	EXPECT_EQ( 14u, x.levels_in_use() );
+	drain(x);
+	std::string why;
+	EXPECT_TRUE( x.check(&why) ) << why;
+	EXPECT_EQ( 64u, x.size() );
+	EXPECT_GE( 2u + 6u + 1u, x.levels_in_use() );
+	EXPECT_GE( 2u + 6u + 1u, tallest(x) );
+}
+
+}
+
+TEST_P(skip_list_test, adaptive_levels_follow_every_drain)
+{
+	int8_t const sd = GetParam();
+	// the best levels going one by one, as top-of-book churn takes them
+	drain_to_64<0>(sd, [](adaptive_probe<0> & x) { while( x.size() > 64 ) x.erase_head(); });
+	drain_to_64<0>(sd, [](adaptive_probe<0> & x) { while( x.size() > 64 ) x.pop_front(); });
+	drain_to_64<sl_indexable>(sd, [](adaptive_probe<sl_indexable> & x) { while( x.size() > 64 ) x.erase_at(x.size() / 2); });
+	drain_to_64<sl_tombstones>(sd, [sd](adaptive_probe<sl_tombstones> & x) {
+		for(int32_t i = 64; i < 1 << 14; ++i) x.erase(sd ? -i : i);
+		while( x.tombstone_count() > 0 ) x.compact(1000);
+	});
+	drain_to_64<0>(sd, [sd](adaptive_probe<0> & x) { x.truncate_after(sd ? -63 : 63); });
+	drain_to_64<0>(sd, [](adaptive_probe<0> & x) { x.keep_top(64); });
+}
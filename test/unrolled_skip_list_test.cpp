@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "skip_list.hpp"
+#include "unrolled_skip_list.hpp"
+
+// exposes the blocks: sorted and non empty, ordered across blocks, towers chaining
+// exactly the blocks taller than their level
+template<typename L> struct block_probe : L
+{
+	using L::L;
+
+	::testing::AssertionResult blocks_ok() const
+	{
+		auto const * head = this->head_;
+		auto const * prev = head;
+		for(auto const * p = head->forwards[0]; p; prev = p, p = p->forwards[0]) {
+			if ( p->count == 0 || p->count > L::block_keys ) return ::testing::AssertionFailure() << "block count " << int(p->count);
+			for(size_t i = 1; i < p->count; ++i) {
+				if ( !this->lt( p->keys[i-1], p->keys[i] ) ) return ::testing::AssertionFailure() << "unsorted block";
+			}
+			if ( prev != head && !this->lt( prev->keys[prev->count - 1], p->keys[0] ) )
+				return ::testing::AssertionFailure() << "blocks out of order";
+		}
+		for(size_t l = 0; l < L::max_levels; ++l) {
+			auto const * q = head->forwards[l];
+			for(auto const * p = head->forwards[0]; p; p = p->forwards[0]) {
+				if ( p->height <= l ) continue;
+				if ( q != p ) return ::testing::AssertionFailure() << "level " << l << " skips a block";
+				q = p->forwards[l];
+			}
+			if ( q ) return ::testing::AssertionFailure() << "level " << l << " not terminated";
+		}
+		return ::testing::AssertionSuccess();
+	}
+};
+
+template<typename T> struct unrolled_skip_list_test : public ::testing::Test {};
+
+// small blocks for frequent splits and merges, full lines, 64 bit keys, and a functor
+// that takes the scalar path
+struct by_tick
+{
+	bool operator()(int32_t a, int32_t b) const { return a < b; }
+};
+
+using unrolled_types = ::testing::Types<
+	unrolled_skip_list<int32_t, void*, 8>,
+	unrolled_skip_list<int32_t, void*>,
+	unrolled_skip_list<int64_t, void*>,
+	unrolled_skip_list<int32_t, void*, 8, 24, aligned_allocator, xorshift64star, by_tick> >;
+TYPED_TEST_CASE(unrolled_skip_list_test, unrolled_types);
+
+template<typename L> std::unique_ptr<L> make_list(uint8_t sd, std::true_type) { return std::unique_ptr<L>(new L(sd, 5)); }
+template<typename L> std::unique_ptr<L> make_list(uint8_t, std::false_type) { return std::unique_ptr<L>(new L(typename L::key_compare(), 5)); }
+
+TYPED_TEST(unrolled_skip_list_test, matches_skip_list)
+{
+	using key_type = typename decltype(std::declval<TypeParam const &>().to_vector())::value_type::first_type;
+	using runtime_side = std::is_same<typename TypeParam::key_compare, side_compare<key_type> >;
+
+	for(uint8_t sd : { 0, 1 })
+	{
+		if ( !runtime_side::value && sd ) continue;
+		auto const px = make_list< block_probe<TypeParam> >(sd, runtime_side{});
+		auto & x = *px;
+		skip_list<key_type, void*> y(sd, 5);
+		std::mt19937 rnd(sd + 1);
+
+		for(int i = 0; i < 30000; ++i)
+		{
+			key_type const k = key_type(rnd() % 3000) * (sizeof(key_type) > 4 ? 10000000000LL : 1) - 1000;
+			void * const v = (void*)(size_t)rnd();
+			switch( rnd() % 5 )
+			{
+				case 0:
+				case 1:
+					ASSERT_EQ( y.insert(k, v), x.insert(k, v) ) << "k=" << k;
+					break;
+				case 2:
+					ASSERT_EQ( y.erase(k), x.erase(k) ) << "k=" << k;
+					break;
+				case 3:
+					if ( !y.empty() ) {
+						ASSERT_EQ( y.begin()->key, x.begin()->key );
+						y.erase_head();
+						x.erase_head();
+					}
+					break;
+				case 4: {
+					void ** a = y.find(k);
+					void ** b = x.find(k);
+					ASSERT_EQ( a == nullptr, b == nullptr ) << "k=" << k;
+					if ( a ) {
+						ASSERT_EQ( *a, *b );
+					}
+					break;
+				}
+			}
+			ASSERT_EQ( y.size(), x.size() );
+			if ( i % 1000 == 0 ) {
+				ASSERT_TRUE( x.blocks_ok() ) << "i=" << i;
+			}
+		}
+		EXPECT_TRUE( x.blocks_ok() );
+		EXPECT_EQ( y.to_vector(), x.to_vector() );
+
+		std::vector< std::pair<key_type, void*> > walked;
+		for(auto it = x.begin(); it != x.end(); ++it) walked.push_back(std::make_pair(it->key, it->value));
+		EXPECT_EQ( y.to_vector(), walked );
+
+		while( !x.empty() ) x.erase_head();
+		EXPECT_EQ( 0u, x.blocks() );
+		EXPECT_TRUE( x.begin() == x.end() );
+	}
+}
+
+TEST(unrolled_skip_list_layout_test, blocks_stay_dense)
+{
+	block_probe< unrolled_skip_list<int32_t, void*> > x(uint8_t(1), 3);
+	for(int i = 0; i < 100000; ++i) ASSERT_TRUE( x.insert(i, nullptr) );
+	// descending inserts at the front split blocks in halves at worst
+	EXPECT_LE( x.blocks(), 2 * x.size() / x.block_keys + 1 );
+	for(int i = 0; i < 100000; i += 2) ASSERT_EQ( 1u, x.erase(i).second );
+	EXPECT_TRUE( x.blocks_ok() );
+	EXPECT_LE( x.blocks(), 4 * x.size() / x.block_keys + 1 );
+}